@@ -0,0 +1,278 @@
+/*
+ * Benchmarks the payload encoder against canvasToBin() of the web page, and
+ * checks that every kernel set gives the same bytes.
+ *
+ *   encode_bench [--json] [--min-ms N] [--check]
+ *
+ * Each image size and pixel format runs through the reference port of
+ * canvasToBin() and every kernel set the CPU supports, then every dithering
+ * with the widest kernels, for at least --min-ms (default 200). The outputs
+ * are compared before timing; --check only compares, over many small odd
+ * sizes and pixel values around the threshold, also every dithering with a
+ * plain whole-image port, checks that dithering a flat mid gray gives about
+ * half black, and exits non-zero on the first failure.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bin_encode.h"
+
+#define MAX_KERNELS 8
+#define REFERENCE   -1      // measure() runs the canvasToBin() port
+
+typedef struct {
+    const char *name;
+    int width;
+    int height;
+} bench_size_t;
+
+static const bench_size_t sizes[] = {
+    { "price",       121,  58 },    // PRICE_W x PRICE_H
+    { "description", 215,  92 },    // DESC_W x DESC_H
+    { "panel",       416, 240 },
+    { "photo",      1600, 1200 },
+};
+
+static uint32_t rng_state = 0x12345678;
+static volatile uint32_t sink;      // Keeps the optimizer from dropping the work
+
+static uint32_t rng(void)
+{
+    rng_state = rng_state * 1664525 + 1013904223;
+    return rng_state >> 8;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Noise and values just around the threshold, where an off-by-one in a kernel shows
+static void fill_pixels(uint8_t *px, size_t len, int level)
+{
+    for (size_t i = 0; i < len; i++) {
+        uint32_t r = rng();
+        px[i] = r & 1 ? (uint8_t)(r >> 8) : (uint8_t)(level - 2 + (int)((r >> 8) % 5));
+    }
+}
+
+static bool encode_matches(const bin_image_t *img, int level, uint8_t *expected, uint8_t *actual)
+{
+    size_t len = bin_encoded_size(img->width, img->height);
+    bin_encode_reference(img, level, expected);
+    memset(actual, 0xA5, len);
+    return bin_encode(img, level, actual) == 0 && memcmp(expected, actual, len) == 0;
+}
+
+static const char *dither_names[] = { "none", "floyd-steinberg", "atkinson", "bayer" };
+
+// Share of black pixels, in percent
+static double black_share(const uint8_t *payload, size_t len, int pixels)
+{
+    long black = 0;
+    for (size_t i = 0; i < len; i++) black += __builtin_popcount(payload[i]);
+    return 100.0 * black / pixels;
+}
+
+/**
+ * @brief Dithering must give the bytes of the reference with every kernel set, and keep the tone of a flat mid gray.
+ */
+static int check_dither(const char **kernels, int kernel_count)
+{
+    static const double tolerance[] = { 0, 1.0, 3.0, 0 };
+    uint8_t *pixels = malloc(100 * 4 * 80);
+    uint8_t *expected = malloc(96 * 10);
+    uint8_t *actual = malloc(96 * 10);
+
+    if (pixels == NULL || expected == NULL || actual == NULL) return 2;
+    for (int dither = BIN_DITHER_FLOYD_STEINBERG; dither <= BIN_DITHER_BAYER; dither++) {
+        memset(pixels, BIN_DITHER_LEVEL, 96 * 80);
+        bin_image_t flat = { pixels, 96, 80, 96, BIN_PIXELS_GRAY };
+        bin_kernel_select("scalar");
+        bin_encode_dithered(&flat, dither, BIN_DITHER_LEVEL, expected);
+        double share = black_share(expected, bin_encoded_size(96, 80), 96 * 80);
+        if (share < 50 - tolerance[dither] || share > 50 + tolerance[dither]) {
+            fprintf(stderr, "%s turns mid gray %.1f%% black\n", dither_names[dither], share);
+            return 1;
+        }
+
+        for (int w = 1; w <= 96; w += 1 + w / 4) {
+            for (int h = 1; h <= 80; h += 1 + h / 4) {
+                int format = rng() & 1 ? BIN_PIXELS_RGBA : BIN_PIXELS_GRAY;
+                int bpp = format == BIN_PIXELS_RGBA ? 4 : 1;
+                bin_image_t img = { pixels, w, h, w * bpp + (int)(rng() % 4) * bpp, format };
+                fill_pixels(pixels, (size_t)img.stride * h, BIN_DITHER_LEVEL);
+                if (bin_encode_dithered_reference(&img, dither, BIN_DITHER_LEVEL, expected) != 0) return 2;
+                for (int k = 0; k < kernel_count; k++) {
+                    bin_kernel_select(kernels[k]);
+                    memset(actual, 0xA5, bin_encoded_size(w, h));
+                    if (bin_encode_dithered(&img, dither, BIN_DITHER_LEVEL, actual) != 0 ||
+                        memcmp(expected, actual, bin_encoded_size(w, h)) != 0) {
+                        fprintf(stderr, "%s dithering with %s differs from the reference for %dx%d\n",
+                                dither_names[dither], kernels[k], w, h);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+    printf("dithering identical to the reference, mid gray half black\n");
+    free(pixels);
+    free(expected);
+    free(actual);
+    return 0;
+}
+
+/**
+ * @brief Compares every kernel set with the reference over small sizes, strides and levels.
+ */
+static int check(const char **kernels, int kernel_count)
+{
+    static const int levels[] = { 1, 2, 127, 128, 149, 150, 151, 200, 254, 255 };
+    uint8_t *pixels = malloc(100 * 4 * 80);
+    uint8_t *expected = malloc(96 * 10);
+    uint8_t *actual = malloc(96 * 10);
+    long images = 0;
+
+    if (pixels == NULL || expected == NULL || actual == NULL) return 2;
+    for (int k = 0; k < kernel_count; k++) {
+        bin_kernel_select(kernels[k]);
+        for (int format = BIN_PIXELS_RGBA; format <= BIN_PIXELS_GRAY; format++) {
+            int bpp = format == BIN_PIXELS_RGBA ? 4 : 1;
+            for (int w = 1; w <= 96; w++) {
+                for (int h = 1; h <= 80; h += 1 + h / 8) {
+                    int level = levels[rng() % (sizeof(levels) / sizeof(levels[0]))];
+                    bin_image_t img = { pixels, w, h, w * bpp + (int)(rng() % 4) * bpp, format };
+                    fill_pixels(pixels, (size_t)img.stride * h, level);
+                    images++;
+                    if (!encode_matches(&img, level, expected, actual)) {
+                        fprintf(stderr, "%s differs from canvasToBin() for %s %dx%d, stride %d, level %d\n",
+                                kernels[k], format == BIN_PIXELS_RGBA ? "rgba" : "gray", w, h, img.stride, level);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+    printf("%ld images identical to canvasToBin() with", images);
+    for (int k = 0; k < kernel_count; k++) printf(" %s", kernels[k]);
+    printf("\n");
+    free(pixels);
+    free(expected);
+    free(actual);
+    return check_dither(kernels, kernel_count);
+}
+
+// Doubles the iteration count until one run takes at least min_ns
+static double measure(const bin_image_t *img, int dither, uint8_t *out, double min_ns, long *iterations)
+{
+    long n = 1;
+    for (;;) {
+        double start = now_ns();
+        for (long i = 0; i < n; i++) {
+            if (dither == REFERENCE) {
+                bin_encode_reference(img, BIN_DEFAULT_LEVEL, out);
+            } else if (dither == BIN_DITHER_NONE) {
+                bin_encode(img, BIN_DEFAULT_LEVEL, out);
+            } else {
+                bin_encode_dithered(img, dither, BIN_DITHER_LEVEL, out);
+            }
+            sink += out[i % bin_encoded_size(img->width, img->height)];
+        }
+        double elapsed = now_ns() - start;
+        if (elapsed >= min_ns) {
+            *iterations = n;
+            return elapsed;
+        }
+        n *= 2;
+    }
+}
+
+static void report(bool json, const bench_size_t *size, const char *format, const char *kernel, double ns_per_op,
+                   double reference_ns, long n)
+{
+    double pixels_per_s = (double)size->width * size->height * 1e9 / ns_per_op;
+    if (json) {
+        printf("{\"case\":\"%s\",\"format\":\"%s\",\"kernel\":\"%s\",\"ops\":%ld,\"ns_per_op\":%.1f,"
+               "\"pixels_per_s\":%.0f,\"speedup\":%.2f}\n",
+               size->name, format, kernel, n, ns_per_op, pixels_per_s, reference_ns / ns_per_op);
+    } else {
+        printf("%-12s %-5s %-16s %12.1f %12.1f %8.2fx %10ld\n", size->name, format, kernel, ns_per_op,
+               pixels_per_s / 1e6, reference_ns / ns_per_op, n);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--json] [--min-ms N] [--check]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false, check_only = false;
+    double min_ms = 200;
+    const char *kernels[MAX_KERNELS];
+    int kernel_count = bin_kernel_list(kernels, MAX_KERNELS);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check_only = true;
+        } else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+            min_ms = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (check_only) return check(kernels, kernel_count);
+
+    if (!json) {
+        printf("%-12s %-5s %-16s %12s %12s %9s %10s\n", "case", "fmt", "kernel", "ns/image", "Mpixels/s", "speedup",
+               "ops");
+    }
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        const bench_size_t *size = &sizes[s];
+        uint8_t *pixels = malloc((size_t)size->width * size->height * 4);
+        size_t len = bin_encoded_size(size->width, size->height);
+        uint8_t *expected = malloc(len);
+        uint8_t *actual = malloc(len);
+        if (pixels == NULL || expected == NULL || actual == NULL) return 2;
+
+        for (int format = BIN_PIXELS_RGBA; format <= BIN_PIXELS_GRAY; format++) {
+            const char *format_name = format == BIN_PIXELS_RGBA ? "rgba" : "gray";
+            int bpp = format == BIN_PIXELS_RGBA ? 4 : 1;
+            bin_image_t img = { pixels, size->width, size->height, size->width * bpp, format };
+            fill_pixels(pixels, (size_t)img.stride * img.height, BIN_DEFAULT_LEVEL);
+
+            long n;
+            double reference_ns = measure(&img, REFERENCE, expected, min_ms * 1e6, &n) / n;
+            report(json, size, format_name, "reference", reference_ns, reference_ns, n);
+            for (int k = 0; k < kernel_count; k++) {
+                bin_kernel_select(kernels[k]);
+                if (!encode_matches(&img, BIN_DEFAULT_LEVEL, expected, actual)) {
+                    fprintf(stderr, "%s differs from canvasToBin() for %s %s\n", kernels[k], size->name, format_name);
+                    return 1;
+                }
+                double ns = measure(&img, BIN_DITHER_NONE, actual, min_ms * 1e6, &n) / n;
+                report(json, size, format_name, kernels[k], ns, reference_ns, n);
+            }
+
+            // Dithering is listed by its name, with the widest kernels
+            bin_kernel_select("auto");
+            for (int dither = BIN_DITHER_FLOYD_STEINBERG; dither <= BIN_DITHER_BAYER; dither++) {
+                double ns = measure(&img, dither, actual, min_ms * 1e6, &n) / n;
+                report(json, size, format_name, dither_names[dither], ns, reference_ns, n);
+            }
+        }
+        free(pixels);
+        free(expected);
+        free(actual);
+    }
+    return 0;
+}
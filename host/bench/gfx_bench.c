@@ -0,0 +1,203 @@
+/*
+ * Benchmarks the epd_graphics primitives against a host framebuffer.
+ *
+ *   gfx_bench [--json] [--min-ms N] [--filter NAME]
+ *
+ * Every case runs for at least --min-ms (default 200) and is reported per
+ * rotation. --json prints one object per line for regression tracking.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "epd_display.h"
+#include "epd_graphics.h"
+
+typedef struct {
+    const char *name;       // Primitive and variant, e.g. "char_24"
+    const char *unit;       // What one operation is: "pixel", "glyph", "blit", ...
+    long pixels_per_op;     // Pixels touched by one operation
+    void (*run)(long iterations);
+} bench_case_t;
+
+static uint8_t framebuffer[EPD_BUF_SIZE];
+static uint8_t bitmap[215 * 12];    // Large enough for the description region, 215x92
+static volatile uint32_t sink;      // Keeps the optimizer from dropping the work
+
+static const epd_rotation_t rotations[] = { EPD_ROTATE_0, EPD_ROTATE_90, EPD_ROTATE_180, EPD_ROTATE_270 };
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// All cases stay inside the 240x240 area common to every rotation
+static void run_pixel(long n)
+{
+    long i = 0;
+    while (i < n) {
+        for (int y = 0; y < 240 && i < n; y++) {
+            for (int x = 0; x < 240 && i < n; x++, i++) {
+                epd_draw_pixel(x, y, (x ^ y) & 1 ? WHITE : BLACK);
+            }
+        }
+    }
+}
+
+static void run_clear_region(long n)
+{
+    for (long i = 0; i < n; i++) {
+        epd_clear_buffer_region(10, 80, 121, 58, i & 1 ? WHITE : BLACK);
+    }
+}
+
+static void run_clear_buffer(long n)
+{
+    for (long i = 0; i < n; i++) {
+        epd_clear_buffer(i & 1 ? WHITE : BLACK);
+    }
+}
+
+#define DEFINE_CHAR_CASE(size)                                      \
+    static void run_char_##size(long n)                             \
+    {                                                               \
+        for (long i = 0; i < n; i++) {                              \
+            epd_draw_char(8, 8, ' ' + (i % 95), size, BLACK);       \
+        }                                                           \
+    }
+DEFINE_CHAR_CASE(8)
+DEFINE_CHAR_CASE(12)
+DEFINE_CHAR_CASE(16)
+DEFINE_CHAR_CASE(24)
+DEFINE_CHAR_CASE(48)
+
+static void run_image(long n)
+{
+    for (long i = 0; i < n; i++) {
+        epd_draw_image(10, 80, 121, 58, bitmap, BLACK);
+    }
+}
+
+static void run_bin_price(long n)
+{
+    for (long i = 0; i < n; i++) {
+        epd_draw_bin_image(bitmap, 10, 90, 121, 58);
+    }
+}
+
+static void run_bin_description(long n)
+{
+    for (long i = 0; i < n; i++) {
+        epd_draw_bin_image(bitmap, 10, 80, 215, 92);
+    }
+}
+
+static void run_circle(long n)
+{
+    for (long i = 0; i < n; i++) {
+        epd_draw_circle(120, 120, 40, BLACK, false);
+    }
+}
+
+static void run_circle_fill(long n)
+{
+    for (long i = 0; i < n; i++) {
+        epd_draw_circle(120, 120, 40, BLACK, true);
+    }
+}
+
+static const bench_case_t cases[] = {
+    { "pixel",           "pixel", 1,           run_pixel },
+    { "clear_buffer",    "clear", EPD_WIDTH * EPD_HEIGHT, run_clear_buffer },
+    { "clear_region",    "blit",  121 * 58,    run_clear_region },
+    { "char_8",          "glyph", 6 * 8,       run_char_8 },
+    { "char_12",         "glyph", 6 * 16,      run_char_12 },
+    { "char_16",         "glyph", 8 * 16,      run_char_16 },
+    { "char_24",         "glyph", 12 * 24,     run_char_24 },
+    { "char_48",         "glyph", 24 * 48,     run_char_48 },
+    { "image_121x58",    "blit",  121 * 58,    run_image },
+    { "bin_121x58",      "blit",  121 * 58,    run_bin_price },
+    { "bin_215x92",      "blit",  215 * 92,    run_bin_description },
+    { "circle_r40",      "call",  251,         run_circle },
+    { "circle_fill_r40", "call",  5025,        run_circle_fill },
+};
+
+// Doubles the iteration count until one run takes at least min_ns
+static double measure(const bench_case_t *c, double min_ns, long *iterations)
+{
+    long n = 1;
+    for (;;) {
+        double start = now_ns();
+        c->run(n);
+        double elapsed = now_ns() - start;
+        if (elapsed >= min_ns) {
+            *iterations = n;
+            return elapsed;
+        }
+        n *= 2;
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [--json] [--min-ms N] [--filter NAME]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    double min_ms = 200;
+    const char *filter = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--min-ms") == 0 && i + 1 < argc) {
+            min_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // A fixed pseudo-random pattern, so every run blits the same content
+    uint32_t state = 0x12345678;
+    for (size_t i = 0; i < sizeof(bitmap); i++) {
+        state = state * 1664525 + 1013904223;
+        bitmap[i] = state >> 24;
+    }
+
+    if (!json) {
+        printf("%-16s %4s %12s %14s %12s\n", "case", "rot", "ns/op", "Mpixels/s", "ops");
+    }
+
+    for (size_t r = 0; r < sizeof(rotations) / sizeof(rotations[0]); r++) {
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+            const bench_case_t *c = &cases[i];
+            if (filter && strstr(c->name, filter) == NULL) continue;
+
+            epd_set_buffer(framebuffer, EPD_WIDTH, EPD_HEIGHT, rotations[r], WHITE);
+            epd_clear_buffer(WHITE);
+
+            long n;
+            double elapsed = measure(c, min_ms * 1e6, &n);
+            double ns_per_op = elapsed / n;
+            double pixels_per_s = c->pixels_per_op * 1e9 / ns_per_op;
+            sink += framebuffer[n % EPD_BUF_SIZE];
+
+            if (json) {
+                printf("{\"case\":\"%s\",\"rotation\":%d,\"unit\":\"%s\",\"ops\":%ld,"
+                       "\"ns_per_op\":%.1f,\"pixels_per_s\":%.0f}\n",
+                       c->name, rotations[r], c->unit, n, ns_per_op, pixels_per_s);
+            } else {
+                printf("%-16s %4d %12.1f %14.2f %12ld\n", c->name, rotations[r], ns_per_op,
+                       pixels_per_s / 1e6, n);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include "host_log.h"
+
+host_log_level_t host_log_level = HOST_LOG_WARN;
+const char *host_log_prefix = "";
+
+static const char level_codes[] = { [HOST_LOG_ERROR] = 'E', [HOST_LOG_WARN] = 'W', [HOST_LOG_INFO] = 'I',
+                                    [HOST_LOG_DEBUG] = 'D' };
+
+/**
+ * @brief Prints one log line in the ESP-IDF "L (tag) message" form.
+ */
+void host_log(host_log_level_t level, const char *tag, const char *fmt, ...)
+{
+    char line[256];
+    va_list args;
+
+    if (level > host_log_level || level == HOST_LOG_NONE) return;
+
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    fprintf(stderr, "%c %s(%s) %s\n", level_codes[level], host_log_prefix, tag, line);
+}
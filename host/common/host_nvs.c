@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+#include "nvs.h"
+
+#define NVS_MAX_ENTRIES     16
+#define NVS_MAX_NAMESPACES  4
+#define NVS_NAME_LEN        16
+
+typedef struct {
+    nvs_handle_t ns;
+    char key[NVS_NAME_LEN];
+    void *value;
+    size_t len;
+} nvs_entry_t;
+
+static char namespaces[NVS_MAX_NAMESPACES][NVS_NAME_LEN];
+static int namespace_count;
+static nvs_entry_t entries[NVS_MAX_ENTRIES];
+static int entry_count;
+
+// Handles are namespace indices plus one, so 0 is never valid
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    (void)mode;
+    if (strlen(name) >= NVS_NAME_LEN) return ESP_ERR_INVALID_ARG;
+
+    for (int i = 0; i < namespace_count; i++) {
+        if (strcmp(namespaces[i], name) == 0) {
+            *handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    if (namespace_count == NVS_MAX_NAMESPACES) return ESP_ERR_NO_MEM;
+    strcpy(namespaces[namespace_count], name);
+    *handle = ++namespace_count;
+    return ESP_OK;
+}
+
+static nvs_entry_t *find(nvs_handle_t handle, const char *key)
+{
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].ns == handle && strcmp(entries[i].key, key) == 0) return &entries[i];
+    }
+    return NULL;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *len)
+{
+    nvs_entry_t *entry = find(handle, key);
+    if (entry == NULL) return ESP_ERR_NVS_NOT_FOUND;
+
+    // Like the real call, a NULL buffer only queries the length
+    if (out != NULL) {
+        if (*len < entry->len) return ESP_ERR_INVALID_SIZE;
+        memcpy(out, entry->value, entry->len);
+    }
+    *len = entry->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t len)
+{
+    if (handle == 0 || strlen(key) >= NVS_NAME_LEN) return ESP_ERR_INVALID_ARG;
+
+    nvs_entry_t *entry = find(handle, key);
+    if (entry == NULL) {
+        if (entry_count == NVS_MAX_ENTRIES) return ESP_ERR_NO_MEM;
+        entry = &entries[entry_count++];
+        entry->ns = handle;
+        strcpy(entry->key, key);
+        entry->value = NULL;
+    }
+
+    void *copy = malloc(len ? len : 1);
+    if (copy == NULL) return ESP_ERR_NO_MEM;
+    memcpy(copy, value, len);
+    free(entry->value);
+    entry->value = copy;
+    entry->len = len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    nvs_entry_t *entry = find(handle, key);
+    if (entry == NULL) return ESP_ERR_NVS_NOT_FOUND;
+
+    free(entry->value);
+    *entry = entries[--entry_count];
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
@@ -0,0 +1,105 @@
+#include <errno.h>
+#include <time.h>
+#include "host_panel.h"
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "epd_display.h"
+#include "esp_timer.h"
+
+#define WIRE_SLEEP_NS   1000000     // Wire time is slept off in steps of this much
+
+static mock_panel_t panel;
+static uint32_t byte_cost_ns;
+static uint64_t wire_debt_ns;       // Wire time of the bytes sent and not slept off yet
+static int64_t busy_until_us;
+static int dc_level;
+static int rst_level = 1;
+
+void host_panel_init(const mock_panel_timing_t *timing, uint32_t byte_ns)
+{
+    mock_panel_init(&panel, timing);
+    byte_cost_ns = byte_ns;
+    wire_debt_ns = 0;
+    busy_until_us = 0;
+}
+
+const mock_panel_t *host_panel_get(void)
+{
+    return &panel;
+}
+
+static void settle_wire(uint64_t at_least_ns)
+{
+    if (wire_debt_ns < at_least_ns) return;
+    struct timespec ts = { .tv_sec = wire_debt_ns / 1000000000, .tv_nsec = wire_debt_ns % 1000000000 };
+    wire_debt_ns = 0;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dma_chan)
+{
+    (void)host;
+    (void)config;
+    (void)dma_chan;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config,
+                             spi_device_handle_t *handle)
+{
+    (void)host;
+    (void)config;
+    *handle = (spi_device_handle_t)&panel;
+    return ESP_OK;
+}
+
+/**
+ * @brief Hands the bytes to the model as commands or data, by the level of DC.
+ */
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans)
+{
+    const uint8_t *bytes = trans->tx_buffer;
+    size_t len = trans->length / 8;
+
+    (void)handle;
+    for (size_t i = 0; i < len; i++) {
+        if (dc_level) {
+            mock_panel_data(&panel, &bytes[i], 1);
+        } else {
+            settle_wire(1);
+            uint32_t busy_us = mock_panel_command(&panel, bytes[i]);
+            if (busy_us) busy_until_us = esp_timer_get_time() + busy_us;
+        }
+        wire_debt_ns += byte_cost_ns;
+    }
+    settle_wire(WIRE_SLEEP_NS);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode)
+{
+    (void)gpio;
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    if (gpio == PIN_EPD_DC) {
+        dc_level = level != 0;
+    } else if (gpio == PIN_EPD_RST) {
+        // The controller comes out of reset on the rising edge
+        if (level && !rst_level) mock_panel_reset(&panel);
+        rst_level = level != 0;
+    }
+    return ESP_OK;
+}
+
+// BUSY is active low, as on the UC8253
+int gpio_get_level(gpio_num_t gpio)
+{
+    if (gpio != PIN_EPD_BUSY) return 0;
+    settle_wire(1);
+    return esp_timer_get_time() >= busy_until_us;
+}
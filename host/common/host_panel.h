@@ -0,0 +1,12 @@
+#ifndef _HOST_PANEL_H
+#define _HOST_PANEL_H
+
+#include <stdint.h>
+#include "mock_panel.h"
+
+// The panel behind the SPI and GPIO stand-ins, so epd_display.c runs unchanged on the host.
+// BUSY stays low for the time the model reports; each byte on the wire costs byte_ns.
+void host_panel_init(const mock_panel_timing_t *timing, uint32_t byte_ns);
+const mock_panel_t *host_panel_get(void);
+
+#endif // _HOST_PANEL_H
@@ -0,0 +1,71 @@
+#include "latency_hist.h"
+
+// Values below LATENCY_HIST_SUB get one bucket each, above that 16 per power of two
+static int bucket_of(uint64_t us)
+{
+    if (us < LATENCY_HIST_SUB) return (int)us;
+
+    int msb = 63 - __builtin_clzll(us);
+    int shift = msb - 4;    // log2(LATENCY_HIST_SUB)
+    int bucket = (shift + 1) * LATENCY_HIST_SUB + (int)((us >> shift) - LATENCY_HIST_SUB);
+    return bucket < LATENCY_HIST_BUCKETS ? bucket : LATENCY_HIST_BUCKETS - 1;
+}
+
+// Upper bound of a bucket, reported for percentiles that fall into it
+static uint64_t bucket_limit(int bucket)
+{
+    if (bucket < LATENCY_HIST_SUB) return (uint64_t)bucket;
+
+    int shift = bucket / LATENCY_HIST_SUB - 1;
+    uint64_t base = (uint64_t)(LATENCY_HIST_SUB + bucket % LATENCY_HIST_SUB) << shift;
+    return base + ((1ull << shift) - 1);
+}
+
+void latency_hist_add(latency_hist_t *hist, uint64_t us)
+{
+    hist->buckets[bucket_of(us)]++;
+    hist->count++;
+    hist->sum_us += us;
+    if (us > hist->max_us) hist->max_us = us;
+}
+
+void latency_hist_merge(latency_hist_t *into, const latency_hist_t *from)
+{
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        into->buckets[i] += from->buckets[i];
+    }
+    into->count += from->count;
+    into->sum_us += from->sum_us;
+    if (from->max_us > into->max_us) into->max_us = from->max_us;
+}
+
+/**
+ * @brief Latency below which the given share of samples fall.
+ *
+ * @param percentile 0 to 100, e.g. 99.9
+ *
+ * @return Microseconds, never above the largest sample, 0 if the histogram is empty
+ */
+uint64_t latency_hist_percentile(const latency_hist_t *hist, double percentile)
+{
+    if (hist->count == 0) return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * hist->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > hist->count) rank = hist->count;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t limit = bucket_limit(i);
+            return limit < hist->max_us ? limit : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+double latency_hist_mean(const latency_hist_t *hist)
+{
+    return hist->count ? (double)hist->sum_us / hist->count : 0.0;
+}
@@ -0,0 +1,24 @@
+#ifndef _HOST_LATENCY_HIST_H
+#define _HOST_LATENCY_HIST_H
+
+#include <stdint.h>
+
+// Log-linear histogram of microsecond latencies: 16 sub-buckets per power of two,
+// so any percentile is within about 6% of the true value. Fixed size, so it can be
+// sent between processes as is and merged.
+#define LATENCY_HIST_SUB        16
+#define LATENCY_HIST_BUCKETS    (LATENCY_HIST_SUB * 32)
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t max_us;
+    uint32_t buckets[LATENCY_HIST_BUCKETS];
+} latency_hist_t;
+
+void latency_hist_add(latency_hist_t *hist, uint64_t us);
+void latency_hist_merge(latency_hist_t *into, const latency_hist_t *from);
+uint64_t latency_hist_percentile(const latency_hist_t *hist, double percentile);
+double latency_hist_mean(const latency_hist_t *hist);
+
+#endif // _HOST_LATENCY_HIST_H
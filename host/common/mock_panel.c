@@ -0,0 +1,156 @@
+#include <string.h>
+#include "mock_panel.h"
+
+#define CMD_PSR     0x00    // Panel setting
+#define CMD_POF     0x02    // Power off
+#define CMD_PON     0x04    // Power on
+#define CMD_DSLP    0x07    // Deep sleep, followed by 0xA5
+#define CMD_DTM1    0x10    // Old frame plane
+#define CMD_DRF     0x12    // Display refresh
+#define CMD_DTM2    0x13    // New frame plane
+#define CMD_CDI     0x50    // VCOM and data interval
+#define CMD_CCSET   0xE0    // Cascade setting
+#define CMD_TSSET   0xE5    // Force temperature, selects the waveform
+
+#define DSLP_CHECK  0xA5
+
+// Nominal values; replace them with the refresh_ms and wait figures of a real tag's stats
+const mock_panel_timing_t mock_panel_default_timing = {
+    .power_on_us = 40000,
+    .power_off_us = 40000,
+    .refresh_us = {
+        [MOCK_PANEL_FULL] = 3000000,
+        [MOCK_PANEL_FAST] = 1500000,
+        [MOCK_PANEL_PARTIAL] = 420000,
+    },
+};
+
+static void protocol_error(mock_panel_t *panel, const char *what)
+{
+    panel->errors++;
+    panel->last_error = what;
+}
+
+/**
+ * @brief Initializes the model in its power-up state, with white planes.
+ *
+ * @param timing BUSY durations to report, NULL for mock_panel_default_timing
+ */
+void mock_panel_init(mock_panel_t *panel, const mock_panel_timing_t *timing)
+{
+    memset(panel, 0, sizeof(*panel));
+    memset(panel->old_plane, 0xFF, EPD_BUF_SIZE);
+    memset(panel->new_plane, 0xFF, EPD_BUF_SIZE);
+    memset(panel->glass, 0xFF, EPD_BUF_SIZE);
+    panel->timing = timing ? *timing : mock_panel_default_timing;
+}
+
+/**
+ * @brief Hardware reset: wakes the controller and clears its registers, the planes and glass are kept.
+ */
+void mock_panel_reset(mock_panel_t *panel)
+{
+    panel->asleep = false;
+    panel->powered = false;
+    panel->temp_setting = 0;
+    panel->cmd = CMD_PSR;
+    panel->pos = 0;
+}
+
+mock_panel_mode_t mock_panel_mode(const mock_panel_t *panel)
+{
+    switch (panel->temp_setting) {
+        case 0x6E: return MOCK_PANEL_PARTIAL;
+        case 0x5F: return MOCK_PANEL_FAST;
+        default:   return MOCK_PANEL_FULL;
+    }
+}
+
+/**
+ * @brief Receives a command byte (DC low).
+ *
+ * @return BUSY time the command starts, in microseconds
+ */
+uint32_t mock_panel_command(mock_panel_t *panel, uint8_t cmd)
+{
+    if (panel->asleep) {
+        protocol_error(panel, "command while in deep sleep, reset first");
+        return 0;
+    }
+
+    panel->cmd = cmd;
+    panel->pos = 0;
+
+    switch (cmd) {
+        case CMD_PON:
+            panel->powered = true;
+            return panel->timing.power_on_us;
+        case CMD_POF:
+            panel->powered = false;
+            return panel->timing.power_off_us;
+        case CMD_DRF:
+            if (!panel->powered) {
+                protocol_error(panel, "refresh without power on");
+                return 0;
+            }
+            memcpy(panel->glass, panel->new_plane, EPD_BUF_SIZE);
+            panel->refreshes++;
+            return panel->timing.refresh_us[mock_panel_mode(panel)];
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Receives data bytes (DC high) for the last command.
+ */
+void mock_panel_data(mock_panel_t *panel, const uint8_t *data, size_t len)
+{
+    if (panel->asleep) {
+        protocol_error(panel, "data while in deep sleep, reset first");
+        return;
+    }
+
+    for (size_t i = 0; i < len; i++, panel->pos++) {
+        uint8_t byte = data[i];
+        switch (panel->cmd) {
+            case CMD_DTM1:
+            case CMD_DTM2:
+                if (panel->pos >= EPD_BUF_SIZE) {
+                    protocol_error(panel, "frame data past the end of the plane");
+                    return;
+                }
+                (panel->cmd == CMD_DTM1 ? panel->old_plane : panel->new_plane)[panel->pos] = byte;
+                break;
+            case CMD_TSSET:
+                panel->temp_setting = byte;
+                break;
+            case CMD_DSLP:
+                if (byte == DSLP_CHECK) panel->asleep = true;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * @brief Name of a command from the UC8253 datasheet, "?" for commands the firmware does not use.
+ */
+const char *mock_panel_command_name(uint8_t cmd)
+{
+    switch (cmd) {
+        case CMD_PSR:   return "PSR";
+        case CMD_POF:   return "POF";
+        case CMD_PON:   return "PON";
+        case CMD_DSLP:  return "DSLP";
+        case CMD_DTM1:  return "DTM1";
+        case CMD_DRF:   return "DRF";
+        case CMD_DTM2:  return "DTM2";
+        case 0x20:      return "LUTC";
+        case CMD_CDI:   return "CDI";
+        case CMD_CCSET: return "CCSET";
+        case CMD_TSSET: return "TSSET";
+        default:        return "?";
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef _HOST_MOCK_PANEL_H
+#define _HOST_MOCK_PANEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "epd_display.h"
+
+// Refresh waveform selected by the 0xE5 value the init sequence writes
+typedef enum {
+    MOCK_PANEL_FULL = 0,    // epd_init()
+    MOCK_PANEL_FAST,        // epd_fast_init()
+    MOCK_PANEL_PARTIAL,     // epd_part_init()
+    MOCK_PANEL_MODE_COUNT
+} mock_panel_mode_t;
+
+// BUSY durations the model reports, in microseconds
+typedef struct {
+    uint32_t power_on_us;
+    uint32_t power_off_us;
+    uint32_t refresh_us[MOCK_PANEL_MODE_COUNT];
+} mock_panel_timing_t;
+
+extern const mock_panel_timing_t mock_panel_default_timing;
+
+// UC8253 as driven by epd_display.c: two frame planes, power and deep sleep state
+typedef struct {
+    uint8_t old_plane[EPD_BUF_SIZE];    // Written with 0x10
+    uint8_t new_plane[EPD_BUF_SIZE];    // Written with 0x13
+    uint8_t glass[EPD_BUF_SIZE];        // New plane as of the last refresh
+    uint8_t cmd;                        // Command the following data belongs to
+    uint32_t pos;                       // Data bytes since the command
+    uint8_t temp_setting;               // Last 0xE5 value
+    bool powered;
+    bool asleep;
+    mock_panel_timing_t timing;
+    uint32_t refreshes;
+    uint32_t errors;                    // Protocol violations
+    const char *last_error;             // Description of the most recent one
+} mock_panel_t;
+
+void mock_panel_init(mock_panel_t *panel, const mock_panel_timing_t *timing);
+void mock_panel_reset(mock_panel_t *panel);
+uint32_t mock_panel_command(mock_panel_t *panel, uint8_t cmd);
+void mock_panel_data(mock_panel_t *panel, const uint8_t *data, size_t len);
+mock_panel_mode_t mock_panel_mode(const mock_panel_t *panel);
+const char *mock_panel_command_name(uint8_t cmd);
+
+#endif // _HOST_MOCK_PANEL_H
@@ -0,0 +1,385 @@
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "mqtt_lite.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#define MQTT_CONNECT        0x10
+#define MQTT_CONNACK        0x20
+#define MQTT_PUBLISH        0x30
+#define MQTT_PUBACK         0x40
+#define MQTT_SUBSCRIBE      0x82
+#define MQTT_SUBACK         0x90
+#define MQTT_UNSUBSCRIBE    0xA2
+#define MQTT_UNSUBACK       0xB0
+#define MQTT_PINGREQ        0xC0
+#define MQTT_PINGRESP       0xD0
+#define MQTT_DISCONNECT     0xE0
+
+#define RX_CHUNK            4096
+#define CLIENT_ID_MAX       64
+
+static const char *TAG_MQTT = "MQTT";
+
+void mqtt_lite_init(esp_mqtt_client_handle_t client, mqtt_lite_publish_cb_t on_publish, void *ctx)
+{
+    memset(client, 0, sizeof(*client));
+    pthread_mutex_init(&client->send_lock, NULL);
+    client->fd = -1;
+    client->next_id = 1;
+    client->on_publish = on_publish;
+    client->ctx = ctx;
+}
+
+/**
+ * @brief Splits "mqtt://host[:port]" (or "host[:port]") into host and port, 1883 by default.
+ *
+ * @return 0 on success, -1 if the host does not fit
+ */
+int mqtt_lite_parse_broker(const char *uri, char *host, size_t host_len, int *port)
+{
+    if (strncmp(uri, "mqtt://", 7) == 0) uri += 7;
+
+    const char *colon = strrchr(uri, ':');
+    size_t len = colon ? (size_t)(colon - uri) : strlen(uri);
+    if (len == 0 || len >= host_len) return -1;
+
+    memcpy(host, uri, len);
+    host[len] = '\0';
+    *port = colon ? atoi(colon + 1) : 1883;
+    return 0;
+}
+
+static uint16_t next_packet_id(esp_mqtt_client_handle_t client)
+{
+    pthread_mutex_lock(&client->send_lock);
+    uint16_t id = client->next_id++;
+    if (client->next_id == 0) client->next_id = 1;
+    pthread_mutex_unlock(&client->send_lock);
+    return id;
+}
+
+static int send_all(esp_mqtt_client_handle_t client, const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(client->fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+        client->bytes_sent += n;
+    }
+    client->last_send_us = esp_timer_get_time();
+    return 0;
+}
+
+// Sends a packet made of a fixed header, up to two variable parts and a payload
+static int send_packet(esp_mqtt_client_handle_t client, uint8_t type, const uint8_t *head, size_t head_len,
+                       const uint8_t *payload, size_t payload_len)
+{
+    uint8_t fixed[5];
+    size_t remaining = head_len + payload_len;
+    size_t n = 0;
+
+    fixed[n++] = type;
+    do {
+        uint8_t byte = remaining % 128;
+        remaining /= 128;
+        fixed[n++] = byte | (remaining ? 0x80 : 0);
+    } while (remaining && n < sizeof(fixed));
+
+    pthread_mutex_lock(&client->send_lock);
+    int result = client->fd >= 0 && send_all(client, fixed, n) == 0 &&
+                 (head_len == 0 || send_all(client, head, head_len) == 0) &&
+                 (payload_len == 0 || send_all(client, payload, payload_len) == 0) ? 0 : -1;
+    pthread_mutex_unlock(&client->send_lock);
+    return result;
+}
+
+static size_t put_string(uint8_t *buf, const char *str)
+{
+    size_t len = strlen(str);
+    buf[0] = len >> 8;
+    buf[1] = len & 0xFF;
+    memcpy(buf + 2, str, len);
+    return len + 2;
+}
+
+// Reads whatever is available into the receive buffer, -1 once the broker closes the connection
+static int fill_rx(esp_mqtt_client_handle_t client)
+{
+    if (client->rx_cap - client->rx_len < RX_CHUNK) {
+        size_t cap = client->rx_cap ? client->rx_cap * 2 : RX_CHUNK * 4;
+        uint8_t *rx = realloc(client->rx, cap);
+        if (rx == NULL) return -1;
+        client->rx = rx;
+        client->rx_cap = cap;
+    }
+
+    ssize_t n = recv(client->fd, client->rx + client->rx_len, client->rx_cap - client->rx_len, 0);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return 0;
+    if (n <= 0) return -1;
+    client->rx_len += n;
+    client->bytes_received += n;
+    return 0;
+}
+
+// Length of the complete packet at buf, 0 if it is still incomplete
+static size_t complete_packet(const uint8_t *buf, size_t len, size_t *header_len, size_t *body_len)
+{
+    size_t remaining = 0;
+    int shift = 0;
+
+    for (size_t i = 1; i < 5; i++) {
+        if (i >= len) return 0;
+        uint8_t byte = buf[i];
+        remaining |= (size_t)(byte & 0x7F) << shift;
+        shift += 7;
+        if (!(byte & 0x80)) {
+            *header_len = i + 1;
+            *body_len = remaining;
+            return len >= i + 1 + remaining ? i + 1 + remaining : 0;
+        }
+    }
+    return 0;
+}
+
+static void handle_packet(esp_mqtt_client_handle_t client, const uint8_t *pkt, size_t header_len, size_t body_len)
+{
+    const uint8_t *body = pkt + header_len;
+
+    if ((pkt[0] & 0xF0) == MQTT_PUBACK && body_len >= 2 && client->on_puback) {
+        client->on_puback(client->ctx, body[0] << 8 | body[1]);
+        return;
+    }
+    if ((pkt[0] & 0xF0) != MQTT_PUBLISH || body_len < 2) return;   // Other acks need no action
+
+    int qos = (pkt[0] >> 1) & 0x03;
+    int topic_len = body[0] << 8 | body[1];
+    size_t pos = 2 + topic_len;
+    int msg_id = 0;
+    if (pos + (qos > 0 ? 2 : 0) > body_len) return;
+    if (qos > 0) {
+        msg_id = body[pos] << 8 | body[pos + 1];
+        pos += 2;
+    }
+
+    // Acknowledge before handling, as esp-mqtt does
+    if (qos == 1) {
+        uint8_t ack[2] = { msg_id >> 8, msg_id & 0xFF };
+        send_packet(client, MQTT_PUBACK, ack, sizeof(ack), NULL, 0);
+    }
+
+    if (client->on_publish) {
+        client->on_publish(client->ctx, (const char *)body + 2, topic_len, body + pos, (int)(body_len - pos), msg_id);
+    }
+}
+
+/**
+ * @brief Waits for packets and handles every complete one, sending keepalive pings as needed.
+ *
+ * @param timeout_ms Longest wait for the first byte, 0 to only handle what has arrived
+ *
+ * @return Number of packets handled, -1 if the connection is lost
+ */
+int mqtt_lite_poll(esp_mqtt_client_handle_t client, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = client->fd, .events = POLLIN };
+    int handled = 0;
+
+    if (client->fd < 0) return -1;
+
+    if (client->keepalive_s && esp_timer_get_time() - client->last_send_us > client->keepalive_s * 500000LL) {
+        if (send_packet(client, MQTT_PINGREQ, NULL, 0, NULL, 0) != 0) return -1;
+    }
+
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready < 0 && errno != EINTR) return -1;
+    if (ready > 0) {
+        if (pfd.revents & (POLLERR | POLLHUP) && !(pfd.revents & POLLIN)) return -1;
+        if (fill_rx(client) != 0) return -1;
+    }
+
+    size_t header_len, body_len, len;
+    size_t offset = 0;
+    while ((len = complete_packet(client->rx + offset, client->rx_len - offset, &header_len, &body_len)) > 0) {
+        handle_packet(client, client->rx + offset, header_len, body_len);
+        offset += len;
+        handled++;
+    }
+    if (offset) {
+        memmove(client->rx, client->rx + offset, client->rx_len - offset);
+        client->rx_len -= offset;
+    }
+    return handled;
+}
+
+/**
+ * @brief Opens the TCP connection and completes the MQTT handshake.
+ *
+ * @param client_id     At most CLIENT_ID_MAX bytes
+ * @param clean_session false to resume the broker session of client_id, with its queued QoS 1 messages
+ * @param keepalive_s   Ping interval announced to the broker, 0 for none
+ * @param timeout_ms    Longest wait for CONNACK
+ *
+ * @return 1 if the broker resumed a session, 0 for a new session, -1 on failure
+ */
+int mqtt_lite_connect(esp_mqtt_client_handle_t client, const char *host, int port, const char *client_id,
+                      bool clean_session, int keepalive_s, int timeout_ms)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *res;
+    char port_str[8];
+    uint8_t head[10];
+    uint8_t id[2 + CLIENT_ID_MAX];
+
+    if (strlen(client_id) > CLIENT_ID_MAX) {
+        ESP_LOGE(TAG_MQTT, "Client ID %s is longer than %d bytes", client_id, CLIENT_ID_MAX);
+        return -1;
+    }
+
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    if (getaddrinfo(host, port_str, &hints, &res) != 0) {
+        ESP_LOGE(TAG_MQTT, "Cannot resolve %s", host);
+        return -1;
+    }
+
+    client->fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (client->fd >= 0 && connect(client->fd, res->ai_addr, res->ai_addrlen) != 0) {
+        ESP_LOGW(TAG_MQTT, "Cannot connect to %s:%d: %s", host, port, strerror(errno));
+        close(client->fd);
+        client->fd = -1;
+    }
+    freeaddrinfo(res);
+    if (client->fd < 0) return -1;
+
+    int one = 1;
+    setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    size_t n = put_string(head, "MQTT");
+    head[n++] = 4;                              // Protocol level 3.1.1
+    head[n++] = clean_session ? 0x02 : 0x00;
+    head[n++] = keepalive_s >> 8;
+    head[n++] = keepalive_s & 0xFF;
+    client->keepalive_s = keepalive_s;
+    client->rx_len = 0;
+
+    size_t id_len = put_string(id, client_id);
+    if (send_packet(client, MQTT_CONNECT, head, n, id, id_len) != 0) {
+        mqtt_lite_disconnect(client);
+        return -1;
+    }
+
+    // CONNACK is the first packet from the broker
+    struct pollfd pfd = { .fd = client->fd, .events = POLLIN };
+    size_t header_len, body_len;
+    while (complete_packet(client->rx, client->rx_len, &header_len, &body_len) == 0) {
+        if (poll(&pfd, 1, timeout_ms) <= 0 || fill_rx(client) != 0) {
+            ESP_LOGW(TAG_MQTT, "No CONNACK from %s:%d", host, port);
+            mqtt_lite_disconnect(client);
+            return -1;
+        }
+    }
+
+    if (client->rx[0] != MQTT_CONNACK || body_len != 2 || client->rx[header_len + 1] != 0) {
+        ESP_LOGW(TAG_MQTT, "Connection refused by %s:%d", host, port);
+        mqtt_lite_disconnect(client);
+        return -1;
+    }
+    int session_present = client->rx[header_len] & 0x01;
+
+    size_t len = header_len + body_len;
+    memmove(client->rx, client->rx + len, client->rx_len - len);
+    client->rx_len -= len;
+    return session_present;
+}
+
+/**
+ * @brief Sends DISCONNECT, so the broker drops no will and keeps a persistent session, and closes the socket.
+ */
+void mqtt_lite_disconnect(esp_mqtt_client_handle_t client)
+{
+    if (client->fd < 0) return;
+
+    send_packet(client, MQTT_DISCONNECT, NULL, 0, NULL, 0);
+    pthread_mutex_lock(&client->send_lock);
+    close(client->fd);
+    client->fd = -1;
+    pthread_mutex_unlock(&client->send_lock);
+    client->rx_len = 0;
+}
+
+void mqtt_lite_free(esp_mqtt_client_handle_t client)
+{
+    mqtt_lite_disconnect(client);
+    free(client->rx);
+    client->rx = NULL;
+    client->rx_cap = 0;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    uint8_t head[2 + 2 + 128 + 1];
+    uint16_t id = next_packet_id(client);
+
+    if (strlen(topic) > 128) return -1;
+    head[0] = id >> 8;
+    head[1] = id & 0xFF;
+    size_t n = 2 + put_string(head + 2, topic);
+    head[n++] = (uint8_t)qos;
+    return send_packet(client, MQTT_SUBSCRIBE, head, n, NULL, 0) == 0 ? id : -1;
+}
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic)
+{
+    uint8_t head[2 + 2 + 128];
+    uint16_t id = next_packet_id(client);
+
+    if (strlen(topic) > 128) return -1;
+    head[0] = id >> 8;
+    head[1] = id & 0xFF;
+    size_t n = 2 + put_string(head + 2, topic);
+    return send_packet(client, MQTT_UNSUBSCRIBE, head, n, NULL, 0) == 0 ? id : -1;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain)
+{
+    uint8_t head[2 + 128 + 2];
+    int id = 0;
+
+    if (strlen(topic) > 128) return -1;
+    if (len == 0 && data) len = (int)strlen(data);
+
+    size_t n = put_string(head, topic);
+    if (qos > 0) {
+        id = next_packet_id(client);
+        head[n++] = id >> 8;
+        head[n++] = id & 0xFF;
+    }
+    uint8_t type = MQTT_PUBLISH | (qos & 0x03) << 1 | (retain ? 1 : 0);
+    return send_packet(client, type, head, n, (const uint8_t *)data, len) == 0 ? id : -1;
+}
+
+// There is no outbox: messages are written to the socket right away, so nothing is kept across reconnects
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain, bool store)
+{
+    (void)store;
+    return esp_mqtt_client_publish(client, topic, data, len, qos, retain);
+}
+
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    (void)client;
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef _HOST_MQTT_LITE_H
+#define _HOST_MQTT_LITE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "mqtt_client.h"
+
+// Called for every PUBLISH received, after QoS 1 messages have been acknowledged
+typedef void (*mqtt_lite_publish_cb_t)(void *ctx, const char *topic, int topic_len, const uint8_t *data, int len,
+                                       int msg_id);
+
+// Called when the broker acknowledges a QoS 1 message this client published
+typedef void (*mqtt_lite_puback_cb_t)(void *ctx, int msg_id);
+
+// Minimal blocking MQTT 3.1.1 client over TCP: QoS 0 and 1, no TLS, no authentication.
+// Also backs the esp_mqtt_client_* calls of the firmware modules built for the host.
+// Packets may be sent from any thread; receiving, connecting and disconnecting stay on one.
+struct esp_mqtt_client {
+    int fd;
+    pthread_mutex_t send_lock;      // One packet at a time on the socket, and the packet ID counter
+    uint16_t next_id;
+    int keepalive_s;
+    int64_t last_send_us;
+    uint8_t *rx;                    // Bytes received and not parsed yet
+    size_t rx_len;
+    size_t rx_cap;
+    mqtt_lite_publish_cb_t on_publish;
+    mqtt_lite_puback_cb_t on_puback;    // Optional, set after mqtt_lite_init()
+    void *ctx;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+};
+
+void mqtt_lite_init(esp_mqtt_client_handle_t client, mqtt_lite_publish_cb_t on_publish, void *ctx);
+int mqtt_lite_connect(esp_mqtt_client_handle_t client, const char *host, int port, const char *client_id,
+                      bool clean_session, int keepalive_s, int timeout_ms);
+int mqtt_lite_poll(esp_mqtt_client_handle_t client, int timeout_ms);
+void mqtt_lite_disconnect(esp_mqtt_client_handle_t client);
+void mqtt_lite_free(esp_mqtt_client_handle_t client);
+int mqtt_lite_parse_broker(const char *uri, char *host, size_t host_len, int *port);
+
+#endif // _HOST_MQTT_LITE_H
@@ -0,0 +1,103 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pbm.h"
+
+/**
+ * @brief Allocates a white image.
+ *
+ * @return 0 on success, -1 if out of memory
+ */
+int pbm_alloc(pbm_image_t *img, int width, int height)
+{
+    img->width = width;
+    img->height = height;
+    img->row_bytes = (width + 7) / 8;
+    img->bits = calloc((size_t)img->row_bytes * height, 1);
+    return img->bits ? 0 : -1;
+}
+
+void pbm_free(pbm_image_t *img)
+{
+    free(img->bits);
+    img->bits = NULL;
+}
+
+int pbm_get(const pbm_image_t *img, int x, int y)
+{
+    return (img->bits[y * img->row_bytes + x / 8] >> (7 - x % 8)) & 1;
+}
+
+void pbm_set(pbm_image_t *img, int x, int y, int black)
+{
+    uint8_t mask = 0x80 >> (x % 8);
+    if (black) {
+        img->bits[y * img->row_bytes + x / 8] |= mask;
+    } else {
+        img->bits[y * img->row_bytes + x / 8] &= ~mask;
+    }
+}
+
+// Reads one header number, skipping whitespace and # comments
+static int read_header_int(FILE *f)
+{
+    int c = fgetc(f);
+    for (;;) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) c = fgetc(f);
+        } else if (isspace(c)) {
+            c = fgetc(f);
+        } else {
+            break;
+        }
+    }
+
+    int value = 0;
+    if (!isdigit(c)) return -1;
+    while (isdigit(c)) {
+        value = value * 10 + (c - '0');
+        c = fgetc(f);
+    }
+    return value;   // The single whitespace after the number is consumed
+}
+
+/**
+ * @brief Reads a binary (P4) PBM file.
+ *
+ * @return 0 on success, -1 if the file is missing or not a P4 image
+ */
+int pbm_read(const char *path, pbm_image_t *img)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return -1;
+
+    int ok = fgetc(f) == 'P' && fgetc(f) == '4';
+    int width = ok ? read_header_int(f) : -1;
+    int height = ok ? read_header_int(f) : -1;
+    ok = width > 0 && height > 0 && pbm_alloc(img, width, height) == 0;
+    if (ok) {
+        size_t size = (size_t)img->row_bytes * height;
+        ok = fread(img->bits, 1, size, f) == size;
+        if (!ok) pbm_free(img);
+    }
+
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Writes a binary (P4) PBM file.
+ *
+ * @return 0 on success, -1 on an I/O error
+ */
+int pbm_write(const char *path, const pbm_image_t *img)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return -1;
+
+    size_t size = (size_t)img->row_bytes * img->height;
+    fprintf(f, "P4\n%d %d\n", img->width, img->height);
+    int ok = fwrite(img->bits, 1, size, f) == size;
+    return fclose(f) == 0 && ok ? 0 : -1;
+}
@@ -0,0 +1,21 @@
+#ifndef _HOST_PBM_H
+#define _HOST_PBM_H
+
+#include <stdint.h>
+
+// 1-bpp image, rows MSB first, set bit = black as in the PBM format
+typedef struct {
+    int width;
+    int height;
+    int row_bytes;
+    uint8_t *bits;
+} pbm_image_t;
+
+int pbm_alloc(pbm_image_t *img, int width, int height);
+void pbm_free(pbm_image_t *img);
+int pbm_get(const pbm_image_t *img, int x, int y);
+void pbm_set(pbm_image_t *img, int x, int y, int black);
+int pbm_read(const char *path, pbm_image_t *img);
+int pbm_write(const char *path, const pbm_image_t *img);
+
+#endif // _HOST_PBM_H
@@ -0,0 +1,37 @@
+#include <string.h>
+#include "region_payload.h"
+#include "epd_display.h"
+#include "epd_graphics.h"
+
+/**
+ * @brief Checks a region of a layout and returns the length of its payload.
+ *
+ * @return w * ceil(h / 8) bytes, or -1 if the name is too long for a region or the size does not fit the panel
+ */
+int region_payload_len(const char *name, int w, int h)
+{
+    if (strlen(name) >= REGION_NAME_LEN || w <= 0 || h <= 0 || w > EPD_HEIGHT || h > EPD_WIDTH) return -1;
+    return w * ((h + 7) / 8);
+}
+
+// Largest font whose glyphs, size/2 wide and size high, fit the text into w x h
+int region_fit_font(int len, int w, int h)
+{
+    static const int sizes[] = { 48, 24, 16, 12, 8 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (sizes[i] <= h && len * sizes[i] / 2 <= w) return sizes[i];
+    }
+    return 0;
+}
+
+// Column-major, MSB the top pixel of each byte, set for black: what epd_draw_bin_image() reads
+void region_pack(int w, int h, uint8_t *out)
+{
+    int bytes_per_col = (h + 7) / 8;
+    memset(out, 0, (size_t)w * bytes_per_col);
+    for (int x = 0; x < w; x++) {
+        for (int y = 0; y < h; y++) {
+            if (epd_get_pixel(x, y) == BLACK) out[x * bytes_per_col + y / 8] |= 0x80 >> (y % 8);
+        }
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef _HOST_REGION_PAYLOAD_H
+#define _HOST_REGION_PAYLOAD_H
+
+#include <stdint.h>
+
+// Region payloads as the tools render them for the tags: drawn into the top left
+// of the current draw target, then packed column-major for epd_draw_bin_image()
+#define REGION_NAME_LEN     16
+
+int region_payload_len(const char *name, int w, int h);
+int region_fit_font(int len, int w, int h);
+void region_pack(int w, int h, uint8_t *out);
+
+#endif // _HOST_REGION_PAYLOAD_H
@@ -0,0 +1,46 @@
+// Host stand-in for the SPI master driver, as far as epd_display.c uses it.
+// Transactions go to the panel model of host/common/host_panel.c.
+#ifndef _HOST_DRIVER_SPI_MASTER_H
+#define _HOST_DRIVER_SPI_MASTER_H
+
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"  // epd_display.c gets the task API through the driver headers, as in the IDF
+
+typedef enum {
+    SPI1_HOST,
+    SPI2_HOST,
+    SPI3_HOST,
+} spi_host_device_t;
+
+#define SPI_DMA_CH_AUTO 3
+
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+    int max_transfer_sz;
+} spi_bus_config_t;
+
+typedef struct {
+    int clock_speed_hz;
+    int mode;
+    int spics_io_num;
+    int queue_size;
+} spi_device_interface_config_t;
+
+typedef struct {
+    size_t length;              // In bits
+    const void *tx_buffer;
+} spi_transaction_t;
+
+typedef struct host_spi_device *spi_device_handle_t;
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int dma_chan);
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config,
+                             spi_device_handle_t *handle);
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t *trans);
+
+#endif // _HOST_DRIVER_SPI_MASTER_H
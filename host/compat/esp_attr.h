@@ -0,0 +1,8 @@
+// Host stand-in for esp_attr.h: RTC memory is ordinary memory, which for a
+// simulated tag lasts through its sleep periods like RTC memory does
+#ifndef _HOST_ESP_ATTR_H
+#define _HOST_ESP_ATTR_H
+
+#define RTC_DATA_ATTR
+
+#endif // _HOST_ESP_ATTR_H
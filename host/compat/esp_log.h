@@ -0,0 +1,12 @@
+// Host stand-in for ESP-IDF logging, printed to stderr at or below host_log_level
+#ifndef _HOST_ESP_LOG_H
+#define _HOST_ESP_LOG_H
+
+#include "host_log.h"
+
+#define ESP_LOGE(tag, fmt, ...) host_log(HOST_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) host_log(HOST_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) host_log(HOST_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) host_log(HOST_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+
+#endif // _HOST_ESP_LOG_H
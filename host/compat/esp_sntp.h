@@ -0,0 +1,17 @@
+// Host stand-in for SNTP: the host clock is already synchronized, so starting
+// SNTP reports one sync right away (host/common/host_sntp.c)
+#ifndef _HOST_ESP_SNTP_H
+#define _HOST_ESP_SNTP_H
+
+#include <sys/time.h>
+
+#define SNTP_OPMODE_POLL    0
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval *tv);
+
+void esp_sntp_setoperatingmode(int mode);
+void esp_sntp_setservername(int index, const char *server);
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
+void esp_sntp_init(void);
+
+#endif // _HOST_ESP_SNTP_H
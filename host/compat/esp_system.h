@@ -0,0 +1,16 @@
+// Host stand-in for esp_system.h: a simulated tag never resets, so it always booted from power-on
+#ifndef _HOST_ESP_SYSTEM_H
+#define _HOST_ESP_SYSTEM_H
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_DEEPSLEEP,
+} esp_reset_reason_t;
+
+static inline esp_reset_reason_t esp_reset_reason(void)
+{
+    return ESP_RST_POWERON;
+}
+
+#endif // _HOST_ESP_SYSTEM_H
@@ -0,0 +1,38 @@
+// Host stand-in for the FreeRTOS kernel the firmware modules use, on POSIX
+// threads (host/common/host_rtos.c). A tick is a millisecond.
+#ifndef _HOST_FREERTOS_H
+#define _HOST_FREERTOS_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+#define portMAX_DELAY       ((TickType_t)0xFFFFFFFF)
+#define configTICK_RATE_HZ  1000
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+#define BIT0    0x01
+#define BIT1    0x02
+#define BIT2    0x04
+#define BIT3    0x08
+
+// Critical sections are a mutex, every caller on the board is a task
+typedef struct {
+    pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { PTHREAD_MUTEX_INITIALIZER }
+#define portENTER_CRITICAL(mux)         pthread_mutex_lock(&(mux)->mutex)
+#define portEXIT_CRITICAL(mux)          pthread_mutex_unlock(&(mux)->mutex)
+
+// The IDF header brings in the task API too (idf_additions.h), which epd_display.c relies on
+#include "freertos/task.h"
+
+#endif // _HOST_FREERTOS_H
@@ -0,0 +1,18 @@
+#ifndef _HOST_LOG_H
+#define _HOST_LOG_H
+
+typedef enum {
+    HOST_LOG_NONE = 0,
+    HOST_LOG_ERROR,
+    HOST_LOG_WARN,
+    HOST_LOG_INFO,
+    HOST_LOG_DEBUG,
+} host_log_level_t;
+
+extern host_log_level_t host_log_level;
+extern const char *host_log_prefix;    // Printed before every line, e.g. the tag id
+
+void host_log(host_log_level_t level, const char *tag, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#endif // _HOST_LOG_H
@@ -0,0 +1,33 @@
+// Host stand-in for the esp-mqtt calls the firmware modules make, implemented
+// by the fleet simulator on top of its own client (host/common/mqtt_lite.c)
+#ifndef _HOST_MQTT_CLIENT_H
+#define _HOST_MQTT_CLIENT_H
+
+#include <stdbool.h>
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+// The fields of an MQTT_EVENT_DATA event: one chunk of a PUBLISH, the topic only with the first
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    int msg_id;
+    const char *topic;
+    int topic_len;
+    const char *data;
+    int data_len;
+    int total_data_len;
+    int current_data_offset;
+    int session_present;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain);
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain, bool store);
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client);
+
+#endif // _HOST_MQTT_CLIENT_H
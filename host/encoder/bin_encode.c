@@ -0,0 +1,766 @@
+/*
+ * Threshold encoder of region payloads, byte for byte what canvasToBin() of
+ * the web page produces.
+ *
+ * canvasToBin() walks the image column by column, reading one pixel per row
+ * at a stride of the image width. Here the image is cut into strips of
+ * TILE_COLS columns. Within a strip, every band of 8 rows is thresholded row
+ * by row, reading whole cache lines of pixels, into one mask byte per pixel;
+ * the 8 masks of a band are packed into one payload byte per column; and the
+ * strip is transposed at the end, so each column's bytes are written
+ * contiguously. Thresholding and packing come in scalar, SSE2, AVX2 and NEON
+ * kernels, chosen at run time.
+ *
+ * The average of r, g and b is below the level exactly when r + g + b is
+ * below three times the level, so the kernels compare integer sums.
+ *
+ * Dithering streams the image a row at a time instead: the row's brightness,
+ * the same average, then Floyd-Steinberg or Atkinson error diffusion, or a
+ * compare against the Bayer matrix, into the masks of the current band. The
+ * error state is two rows wide, never the image. Every 8 bands are packed,
+ * and each column gets its 8 bytes in one go.
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bin_encode.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define BIN_X86 1
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define TILE_COLS   32      // Pixels per strip, two cache lines of RGBA per row
+
+typedef struct {
+    const char *name;
+    bool (*supported)(void);
+    // One mask byte per pixel, 0xFF for black
+    void (*threshold_rgba)(const uint8_t *px, int n, int limit, uint8_t *mask);
+    void (*threshold_gray)(const uint8_t *px, int n, int level, uint8_t *mask);
+    // out[i] takes bit 7 - r from rows[r][i]
+    void (*pack8)(const uint8_t *const rows[8], int n, uint8_t *out);
+    // Average of r, g and b per pixel, rounded down
+    void (*gray_rgba)(const uint8_t *px, int n, uint8_t *gray);
+    // 0xFF where gray[i] < thresholds[i]
+    void (*threshold_row)(const uint8_t *gray, const uint8_t *thresholds, int n, uint8_t *mask);
+} bin_kernels_t;
+
+static const uint8_t zero_row[TILE_COLS];
+
+static bool always(void)
+{
+    return true;
+}
+
+static void threshold_rgba_scalar(const uint8_t *px, int n, int limit, uint8_t *mask)
+{
+    for (int i = 0; i < n; i++, px += 4) {
+        mask[i] = px[0] + px[1] + px[2] < limit ? 0xFF : 0x00;
+    }
+}
+
+static void threshold_gray_scalar(const uint8_t *px, int n, int level, uint8_t *mask)
+{
+    for (int i = 0; i < n; i++) {
+        mask[i] = px[i] < level ? 0xFF : 0x00;
+    }
+}
+
+static void pack8_scalar(const uint8_t *const rows[8], int n, uint8_t *out)
+{
+    for (int i = 0; i < n; i++) {
+        uint8_t byte = 0;
+        for (int r = 0; r < 8; r++) byte |= rows[r][i] & (0x80 >> r);
+        out[i] = byte;
+    }
+}
+
+static void gray_rgba_scalar(const uint8_t *px, int n, uint8_t *gray)
+{
+    for (int i = 0; i < n; i++, px += 4) {
+        gray[i] = (px[0] + px[1] + px[2]) / 3;
+    }
+}
+
+static void threshold_row_scalar(const uint8_t *gray, const uint8_t *thresholds, int n, uint8_t *mask)
+{
+    for (int i = 0; i < n; i++) {
+        mask[i] = gray[i] < thresholds[i] ? 0xFF : 0x00;
+    }
+}
+
+#ifdef BIN_X86
+// r + g + b of 8 RGBA pixels as 16-bit lanes: widened, each pixel gives r + g and b, then the pairs are added
+static inline __m128i rgb_sums_sse2(const uint8_t *p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgb = _mm_setr_epi16(1, 1, 1, 0, 1, 1, 1, 0);
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+    __m128i pa = _mm_packs_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(a, zero), rgb),
+                                 _mm_madd_epi16(_mm_unpackhi_epi8(a, zero), rgb));
+    __m128i pb = _mm_packs_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(b, zero), rgb),
+                                 _mm_madd_epi16(_mm_unpackhi_epi8(b, zero), rgb));
+    return _mm_packs_epi32(_mm_madd_epi16(pa, ones), _mm_madd_epi16(pb, ones));
+}
+
+static void threshold_rgba_sse2(const uint8_t *px, int n, int limit, uint8_t *mask)
+{
+    const __m128i lim = _mm_set1_epi16((short)limit);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i lo = _mm_cmplt_epi16(rgb_sums_sse2(px + 4 * i), lim);
+        __m128i hi = _mm_cmplt_epi16(rgb_sums_sse2(px + 4 * i + 32), lim);
+        _mm_storeu_si128((__m128i *)(mask + i), _mm_packs_epi16(lo, hi));
+    }
+    threshold_rgba_scalar(px + 4 * i, n - i, limit, mask + i);
+}
+
+static void gray_rgba_sse2(const uint8_t *px, int n, uint8_t *gray)
+{
+    // sum * 21846 >> 16 is sum / 3 rounded down for every sum up to 765
+    const __m128i third = _mm_set1_epi16(21846);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i lo = _mm_mulhi_epu16(rgb_sums_sse2(px + 4 * i), third);
+        __m128i hi = _mm_mulhi_epu16(rgb_sums_sse2(px + 4 * i + 32), third);
+        _mm_storeu_si128((__m128i *)(gray + i), _mm_packus_epi16(lo, hi));
+    }
+    gray_rgba_scalar(px + 4 * i, n - i, gray + i);
+}
+
+static void threshold_row_sse2(const uint8_t *gray, const uint8_t *thresholds, int n, uint8_t *mask)
+{
+    // Flipping the top bit turns the unsigned compare into the signed one SSE2 has
+    const __m128i flip = _mm_set1_epi8((char)0x80);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(gray + i)), flip);
+        __m128i t = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(thresholds + i)), flip);
+        _mm_storeu_si128((__m128i *)(mask + i), _mm_cmplt_epi8(v, t));
+    }
+    threshold_row_scalar(gray + i, thresholds + i, n - i, mask + i);
+}
+
+static void threshold_gray_sse2(const uint8_t *px, int n, int level, uint8_t *mask)
+{
+    // Unsigned v < level is min(v, level - 1) == v
+    const __m128i below = _mm_set1_epi8((char)(level - 1));
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(px + i));
+        _mm_storeu_si128((__m128i *)(mask + i), _mm_cmpeq_epi8(_mm_min_epu8(v, below), v));
+    }
+    threshold_gray_scalar(px + i, n - i, level, mask + i);
+}
+
+static void pack8_sse2(const uint8_t *const rows[8], int n, uint8_t *out)
+{
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i acc = _mm_setzero_si128();
+        for (int r = 0; r < 8; r++) {
+            __m128i m = _mm_loadu_si128((const __m128i *)(rows[r] + i));
+            acc = _mm_or_si128(acc, _mm_and_si128(m, _mm_set1_epi8((char)(0x80 >> r))));
+        }
+        _mm_storeu_si128((__m128i *)(out + i), acc);
+    }
+    if (i < n) {
+        const uint8_t *tail[8];
+        for (int r = 0; r < 8; r++) tail[r] = rows[r] + i;
+        pack8_scalar(tail, n - i, out + i);
+    }
+}
+
+static bool avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+// r + g + b of 16 RGBA pixels as 16-bit lanes, in the lane order of _mm256_packs_epi32
+__attribute__((target("avx2")))
+static inline __m256i rgb_sums_avx2(const uint8_t *p)
+{
+    const __m256i rgb = _mm256_set1_epi32(0x00010101);
+    const __m256i ones = _mm256_set1_epi16(1);
+    // r + g and b as 16 bits, then added to one 32-bit sum per pixel
+    __m256i a = _mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i *)p), rgb), ones);
+    __m256i b = _mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_loadu_si256((const __m256i *)(p + 32)), rgb), ones);
+    return _mm256_packs_epi32(a, b);
+}
+
+__attribute__((target("avx2")))
+static void threshold_rgba_avx2(const uint8_t *px, int n, int limit, uint8_t *mask)
+{
+    const __m256i lim = _mm256_set1_epi16((short)limit);
+    // Packing works within 128-bit lanes, this puts the 4-pixel groups back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i lo = _mm256_cmpgt_epi16(lim, rgb_sums_avx2(px + 4 * i));
+        __m256i hi = _mm256_cmpgt_epi16(lim, rgb_sums_avx2(px + 4 * i + 64));
+        __m256i black = _mm256_permutevar8x32_epi32(_mm256_packs_epi16(lo, hi), order);
+        _mm256_storeu_si256((__m256i *)(mask + i), black);
+    }
+    // GCC tail-calls the SSE2 code without clearing the upper halves, which slows every SSE instruction after it
+    _mm256_zeroupper();
+    threshold_rgba_sse2(px + 4 * i, n - i, limit, mask + i);
+}
+
+__attribute__((target("avx2")))
+static void gray_rgba_avx2(const uint8_t *px, int n, uint8_t *gray)
+{
+    const __m256i third = _mm256_set1_epi16(21846);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i lo = _mm256_mulhi_epu16(rgb_sums_avx2(px + 4 * i), third);
+        __m256i hi = _mm256_mulhi_epu16(rgb_sums_avx2(px + 4 * i + 64), third);
+        __m256i g = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), order);
+        _mm256_storeu_si256((__m256i *)(gray + i), g);
+    }
+    _mm256_zeroupper();
+    gray_rgba_sse2(px + 4 * i, n - i, gray + i);
+}
+
+__attribute__((target("avx2")))
+static void threshold_row_avx2(const uint8_t *gray, const uint8_t *thresholds, int n, uint8_t *mask)
+{
+    const __m256i flip = _mm256_set1_epi8((char)0x80);
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(gray + i)), flip);
+        __m256i t = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(thresholds + i)), flip);
+        _mm256_storeu_si256((__m256i *)(mask + i), _mm256_cmpgt_epi8(t, v));
+    }
+    _mm256_zeroupper();
+    threshold_row_sse2(gray + i, thresholds + i, n - i, mask + i);
+}
+
+__attribute__((target("avx2")))
+static void threshold_gray_avx2(const uint8_t *px, int n, int level, uint8_t *mask)
+{
+    const __m256i below = _mm256_set1_epi8((char)(level - 1));
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(px + i));
+        _mm256_storeu_si256((__m256i *)(mask + i), _mm256_cmpeq_epi8(_mm256_min_epu8(v, below), v));
+    }
+    _mm256_zeroupper();
+    threshold_gray_sse2(px + i, n - i, level, mask + i);
+}
+
+__attribute__((target("avx2")))
+static void pack8_avx2(const uint8_t *const rows[8], int n, uint8_t *out)
+{
+    int i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int r = 0; r < 8; r++) {
+            __m256i m = _mm256_loadu_si256((const __m256i *)(rows[r] + i));
+            acc = _mm256_or_si256(acc, _mm256_and_si256(m, _mm256_set1_epi8((char)(0x80 >> r))));
+        }
+        _mm256_storeu_si256((__m256i *)(out + i), acc);
+    }
+    if (i < n) {
+        const uint8_t *tail[8];
+        for (int r = 0; r < 8; r++) tail[r] = rows[r] + i;
+        _mm256_zeroupper();
+        pack8_sse2(tail, n - i, out + i);
+    }
+}
+#endif // BIN_X86
+
+#ifdef __ARM_NEON
+static void threshold_rgba_neon(const uint8_t *px, int n, int limit, uint8_t *mask)
+{
+    const uint16x8_t lim = vdupq_n_u16(limit);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t v = vld4q_u8(px + 4 * i);      // r, g, b and a of 16 pixels, deinterleaved
+        uint16x8_t lo = vaddw_u8(vaddl_u8(vget_low_u8(v.val[0]), vget_low_u8(v.val[1])), vget_low_u8(v.val[2]));
+        uint16x8_t hi = vaddw_u8(vaddl_u8(vget_high_u8(v.val[0]), vget_high_u8(v.val[1])), vget_high_u8(v.val[2]));
+        vst1q_u8(mask + i, vcombine_u8(vmovn_u16(vcltq_u16(lo, lim)), vmovn_u16(vcltq_u16(hi, lim))));
+    }
+    threshold_rgba_scalar(px + 4 * i, n - i, limit, mask + i);
+}
+
+static void gray_rgba_neon(const uint8_t *px, int n, uint8_t *gray)
+{
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x4_t v = vld4q_u8(px + 4 * i);
+        uint16x8_t lo = vaddw_u8(vaddl_u8(vget_low_u8(v.val[0]), vget_low_u8(v.val[1])), vget_low_u8(v.val[2]));
+        uint16x8_t hi = vaddw_u8(vaddl_u8(vget_high_u8(v.val[0]), vget_high_u8(v.val[1])), vget_high_u8(v.val[2]));
+        // sum * 21846 >> 16 is sum / 3 rounded down for every sum up to 765
+        uint16x8_t glo = vcombine_u16(vshrn_n_u32(vmull_n_u16(vget_low_u16(lo), 21846), 16),
+                                      vshrn_n_u32(vmull_n_u16(vget_high_u16(lo), 21846), 16));
+        uint16x8_t ghi = vcombine_u16(vshrn_n_u32(vmull_n_u16(vget_low_u16(hi), 21846), 16),
+                                      vshrn_n_u32(vmull_n_u16(vget_high_u16(hi), 21846), 16));
+        vst1q_u8(gray + i, vcombine_u8(vmovn_u16(glo), vmovn_u16(ghi)));
+    }
+    gray_rgba_scalar(px + 4 * i, n - i, gray + i);
+}
+
+static void threshold_row_neon(const uint8_t *gray, const uint8_t *thresholds, int n, uint8_t *mask)
+{
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u8(mask + i, vcltq_u8(vld1q_u8(gray + i), vld1q_u8(thresholds + i)));
+    }
+    threshold_row_scalar(gray + i, thresholds + i, n - i, mask + i);
+}
+
+static void threshold_gray_neon(const uint8_t *px, int n, int level, uint8_t *mask)
+{
+    const uint8x16_t lvl = vdupq_n_u8(level);
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u8(mask + i, vcltq_u8(vld1q_u8(px + i), lvl));
+    }
+    threshold_gray_scalar(px + i, n - i, level, mask + i);
+}
+
+static void pack8_neon(const uint8_t *const rows[8], int n, uint8_t *out)
+{
+    int i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t acc = vdupq_n_u8(0);
+        for (int r = 0; r < 8; r++) {
+            acc = vorrq_u8(acc, vandq_u8(vld1q_u8(rows[r] + i), vdupq_n_u8(0x80 >> r)));
+        }
+        vst1q_u8(out + i, acc);
+    }
+    if (i < n) {
+        const uint8_t *tail[8];
+        for (int r = 0; r < 8; r++) tail[r] = rows[r] + i;
+        pack8_scalar(tail, n - i, out + i);
+    }
+}
+#endif // __ARM_NEON
+
+// Narrowest first, "auto" takes the last one supported
+static const bin_kernels_t kernel_sets[] = {
+    { "scalar", always, threshold_rgba_scalar, threshold_gray_scalar, pack8_scalar, gray_rgba_scalar,
+      threshold_row_scalar },
+#ifdef BIN_X86
+    { "sse2", always, threshold_rgba_sse2, threshold_gray_sse2, pack8_sse2, gray_rgba_sse2, threshold_row_sse2 },
+    { "avx2", avx2_supported, threshold_rgba_avx2, threshold_gray_avx2, pack8_avx2, gray_rgba_avx2,
+      threshold_row_avx2 },
+#endif
+#ifdef __ARM_NEON
+    { "neon", always, threshold_rgba_neon, threshold_gray_neon, pack8_neon, gray_rgba_neon, threshold_row_neon },
+#endif
+};
+
+#define KERNEL_SET_COUNT ((int)(sizeof(kernel_sets) / sizeof(kernel_sets[0])))
+
+static const bin_kernels_t *selected;
+
+static const bin_kernels_t *kernels(void)
+{
+    if (selected) return selected;
+    for (int i = KERNEL_SET_COUNT - 1; i > 0; i--) {
+        if (kernel_sets[i].supported()) return &kernel_sets[i];
+    }
+    return &kernel_sets[0];
+}
+
+/**
+ * @brief Selects the kernels bin_encode() uses.
+ *
+ * @param name "auto", or one of the names bin_kernel_list() returns
+ *
+ * @return 0, or -1 if the kernels are unknown or the CPU lacks the instructions
+ */
+int bin_kernel_select(const char *name)
+{
+    if (strcmp(name, "auto") == 0) {
+        selected = NULL;
+        return 0;
+    }
+    for (int i = 0; i < KERNEL_SET_COUNT; i++) {
+        if (strcmp(kernel_sets[i].name, name) == 0 && kernel_sets[i].supported()) {
+            selected = &kernel_sets[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *bin_kernel_name(void)
+{
+    return kernels()->name;
+}
+
+// Names of the kernel sets this CPU runs, narrowest first
+int bin_kernel_list(const char **names, int max)
+{
+    int count = 0;
+    for (int i = 0; i < KERNEL_SET_COUNT && count < max; i++) {
+        if (kernel_sets[i].supported()) names[count++] = kernel_sets[i].name;
+    }
+    return count;
+}
+
+size_t bin_encoded_size(int width, int height)
+{
+    return (size_t)width * ((height + 7) / 8);
+}
+
+static bool valid_image(const bin_image_t *img)
+{
+    int bpp = img->format == BIN_PIXELS_RGBA ? 4 : 1;
+    return img->pixels && img->width > 0 && img->height > 0 && img->stride >= img->width * bpp;
+}
+
+/**
+ * @brief Encodes an image into the column-major 1-bpp payload of a region.
+ *
+ * @param level Black below this average of r, g and b (or gray value), 1 to 255
+ * @param out   bin_encoded_size() bytes
+ *
+ * @return 0, or -1 for an invalid image or level
+ */
+int bin_encode(const bin_image_t *img, int level, uint8_t *out)
+{
+    const bin_kernels_t *k = kernels();
+    uint8_t masks[8][TILE_COLS];
+    int bpp = img->format == BIN_PIXELS_RGBA ? 4 : 1;
+    int bytes_per_col = (img->height + 7) / 8;
+
+    if (!valid_image(img) || level < 1 || level > 255) return -1;
+    uint8_t *strip = malloc((size_t)bytes_per_col * TILE_COLS);
+    if (strip == NULL) return -1;
+
+    for (int x0 = 0; x0 < img->width; x0 += TILE_COLS) {
+        int n = img->width - x0 < TILE_COLS ? img->width - x0 : TILE_COLS;
+
+        for (int band = 0; band < bytes_per_col; band++) {
+            const uint8_t *rows[8];
+            for (int r = 0; r < 8; r++) {
+                int y = band * 8 + r;
+                if (y >= img->height) {
+                    rows[r] = zero_row;
+                    continue;
+                }
+                const uint8_t *px = img->pixels + (size_t)y * img->stride + (size_t)x0 * bpp;
+                if (img->format == BIN_PIXELS_RGBA) {
+                    k->threshold_rgba(px, n, 3 * level, masks[r]);
+                } else {
+                    k->threshold_gray(px, n, level, masks[r]);
+                }
+                rows[r] = masks[r];
+            }
+            k->pack8(rows, n, strip + band * TILE_COLS);
+        }
+
+        // The strip holds one band per row; the payload wants one column after the other
+        uint8_t *dst = out + (size_t)x0 * bytes_per_col;
+        for (int i = 0; i < n; i++) {
+            for (int band = 0; band < bytes_per_col; band++) *dst++ = strip[band * TILE_COLS + i];
+        }
+    }
+
+    free(strip);
+    return 0;
+}
+
+// Ordered dithering thresholds in 64ths of the gray range
+static const uint8_t bayer8[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+static const char *dither_names[] = {
+    [BIN_DITHER_NONE]            = "none",
+    [BIN_DITHER_FLOYD_STEINBERG] = "floyd-steinberg",
+    [BIN_DITHER_ATKINSON]        = "atkinson",
+    [BIN_DITHER_BAYER]           = "bayer",
+};
+
+int bin_dither_parse(const char *name, bin_dither_t *dither)
+{
+    for (int i = BIN_DITHER_NONE; i <= BIN_DITHER_BAYER; i++) {
+        if (strcmp(name, dither_names[i]) == 0) {
+            *dither = (bin_dither_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Error diffusion state, two rows padded by 2 columns on both sides: err[0] holds the
+// error reaching the row being dithered, err[1] what has reached the row below so far
+typedef struct {
+    int width;
+    int level;
+    int *err[2];
+    bool reverse;
+} diffusion_t;
+
+// The row below becomes the current one. The row just done holds whatever the
+// diffusion left in it for the row after, which each diffuser sets in full.
+static void diffusion_advance(diffusion_t *d)
+{
+    int *done = d->err[0];
+    d->err[0] = d->err[1];
+    d->err[1] = done;
+}
+
+/**
+ * @brief Floyd-Steinberg: 7/16 of the error to the next pixel, 3/16, 5/16 and 1/16 to the row below.
+ *
+ * Rows alternate direction, which avoids the diagonal drift of one-way scanning.
+ * Errors are kept in 16ths and rounded once per pixel. Every cell of the row
+ * below is stored once, so it needs no clearing before it is reused.
+ */
+static void diffuse_floyd_steinberg(diffusion_t *d, const uint8_t *gray, uint8_t *mask)
+{
+    int *cur = d->err[0] + 2, *next = d->err[1] + 2;
+    int dir = d->reverse ? -1 : 1;
+    int x = d->reverse ? d->width - 1 : 0;
+    // Shares for the pixels below x - dir and below x, held until complete so each is stored once
+    int carry = 0, behind = 0, below = 0;
+
+    for (int i = 0; i < d->width; i++, x += dir) {
+        int v = gray[x] + ((cur[x] + carry + 8) >> 4);
+        int black = (v - d->level) >> 31;      // All ones below the level; noise would defeat a branch
+        int e = v - (~black & 255);
+        mask[x] = (uint8_t)black;
+        carry = e * 7;
+        next[x - dir] = behind + e * 3;
+        behind = below + e * 5;
+        below = e;
+    }
+    next[x - dir] = behind;
+    d->reverse = !d->reverse;
+    diffusion_advance(d);
+}
+
+/**
+ * @brief Atkinson: 1/8 of the error each to two pixels ahead, three below and one two rows below.
+ *
+ * The other quarter is dropped, so highlights and shadows stay clean at some
+ * loss of tone, which suits logos and line art. Errors are kept in 8ths.
+ * The share two rows below lands only under x, so it replaces cur[x] once that
+ * is read, and the current row turns into the one after next. The row below
+ * already holds the shares from two rows up and is added to.
+ */
+static void diffuse_atkinson(diffusion_t *d, const uint8_t *gray, uint8_t *mask)
+{
+    int *cur = d->err[0] + 2, *next = d->err[1] + 2;
+    int prev1 = 0, prev2 = 0;      // Errors of the two pixels before x, which also reach x
+
+    for (int x = 0; x < d->width; x++) {
+        int v = gray[x] + ((cur[x] + prev1 + prev2 + 4) >> 3);
+        int black = (v - d->level) >> 31;
+        int e = v - (~black & 255);
+        mask[x] = (uint8_t)black;
+        next[x - 1] += prev2 + prev1 + e;
+        cur[x] = e;
+        prev2 = prev1;
+        prev1 = e;
+    }
+    next[d->width - 1] += prev2 + prev1;
+    diffusion_advance(d);
+}
+
+/**
+ * @brief Encodes an image into the payload of a region, dithered.
+ *
+ * The image is read a row at a time: its brightness (the average of r, g and
+ * b, as canvasToBin() measures it) is dithered into the masks of the current
+ * band, bands are packed as they fill, and every 8 packed bands are written
+ * column by column. Besides the output, memory is a few rows of the width.
+ *
+ * @param dither BIN_DITHER_NONE is bin_encode()
+ * @param level  Gray level the dithering centres on, BIN_DITHER_LEVEL for an even spread
+ * @param out    bin_encoded_size() bytes
+ *
+ * @return 0, or -1 for an invalid image, level or dithering, or out of memory
+ */
+int bin_encode_dithered(const bin_image_t *img, bin_dither_t dither, int level, uint8_t *out)
+{
+    if (dither == BIN_DITHER_NONE) return bin_encode(img, level, out);
+    if (!valid_image(img) || level < 1 || level > 255 || dither > BIN_DITHER_BAYER) return -1;
+
+    const bin_kernels_t *k = kernels();
+    int w = img->width;
+    int bytes_per_col = (img->height + 7) / 8;
+    diffusion_t d = { .width = w, .level = level };
+    uint8_t *gray = malloc(w);
+    uint8_t *masks = malloc((size_t)8 * w);
+    uint8_t *bands = malloc((size_t)8 * w);
+    uint8_t *thresholds = dither == BIN_DITHER_BAYER ? malloc((size_t)8 * w) : NULL;
+    int *errors = dither != BIN_DITHER_BAYER ? calloc((size_t)2 * (w + 4), sizeof(int)) : NULL;
+    int result = -1;
+
+    if (gray == NULL || masks == NULL || bands == NULL || (thresholds == NULL && errors == NULL)) goto out;
+    for (int i = 0; errors && i < 2; i++) d.err[i] = errors + (size_t)i * (w + 4);
+    if (thresholds) {
+        // Mid gray at level 128 turns exactly half the pixels black
+        for (int r = 0; r < 8; r++) {
+            for (int x = 0; x < w; x++) {
+                int t = bayer8[r][x % 8] * 4 + 2 + level - BIN_DITHER_LEVEL;
+                thresholds[(size_t)r * w + x] = t < 0 ? 0 : t > 255 ? 255 : t;
+            }
+        }
+    }
+
+    for (int y = 0; y < img->height; y++) {
+        const uint8_t *row = img->pixels + (size_t)y * img->stride;
+        uint8_t *mask = masks + (size_t)(y % 8) * w;
+        if (img->format == BIN_PIXELS_RGBA) {
+            k->gray_rgba(row, w, gray);
+            row = gray;
+        }
+
+        if (dither == BIN_DITHER_BAYER) {
+            k->threshold_row(row, thresholds + (size_t)(y % 8) * w, w, mask);
+        } else if (dither == BIN_DITHER_FLOYD_STEINBERG) {
+            diffuse_floyd_steinberg(&d, row, mask);
+        } else {
+            diffuse_atkinson(&d, row, mask);
+        }
+
+        bool last = y == img->height - 1;
+        if (y % 8 != 7 && !last) continue;
+
+        int band = y / 8;
+        const uint8_t *rows[8];
+        for (int r = 0; r < 8; r++) {
+            if (r > y % 8) memset(masks + (size_t)r * w, 0, w);     // Below the image
+            rows[r] = masks + (size_t)r * w;
+        }
+        k->pack8(rows, w, bands + (size_t)(band % 8) * w);
+        if (band % 8 != 7 && !last) continue;
+
+        // Each column takes its bytes of up to 8 bands at once
+        int first = band - band % 8;
+        int count = band % 8 + 1;
+        for (int x = 0; x < w; x++) {
+            uint8_t *dst = out + (size_t)x * bytes_per_col + first;
+            for (int b = 0; b < count; b++) dst[b] = bands[(size_t)b * w + x];
+        }
+    }
+    result = 0;
+
+out:
+    free(gray);
+    free(masks);
+    free(bands);
+    free(thresholds);
+    free(errors);
+    return result;
+}
+
+void bin_encode_reference(const bin_image_t *img, int level, uint8_t *out)
+{
+    int bpp = img->format == BIN_PIXELS_RGBA ? 4 : 1;
+    size_t n = 0;
+
+    for (int x = 0; x < img->width; x++) {
+        for (int byte_row = 0; byte_row < (img->height + 7) / 8; byte_row++) {
+            uint8_t byte = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                int y = byte_row * 8 + bit;
+                if (y >= img->height) continue;
+
+                const uint8_t *px = img->pixels + (size_t)y * img->stride + (size_t)x * bpp;
+                double avg = img->format == BIN_PIXELS_RGBA ? (px[0] + px[1] + px[2]) / 3.0 : px[0];
+                if (avg < level) {
+                    byte |= 1 << (7 - bit);     // Top pixel is MSB
+                }
+            }
+            out[n++] = byte;
+        }
+    }
+}
+
+/**
+ * @brief bin_encode_dithered() as the textbook has it, for checking the streaming version against.
+ *
+ * One pixel at a time, spreading its error into an array the size of the
+ * image, with the same integer rounding.
+ *
+ * @return 0, or -1 if out of memory
+ */
+int bin_encode_dithered_reference(const bin_image_t *img, bin_dither_t dither, int level, uint8_t *out)
+{
+    if (dither == BIN_DITHER_NONE) {
+        bin_encode_reference(img, level, out);
+        return 0;
+    }
+
+    int w = img->width, h = img->height;
+    int bpp = img->format == BIN_PIXELS_RGBA ? 4 : 1;
+    int pitch = w + 4;              // Two columns of margin on both sides, and two rows below the image
+    int *err = calloc((size_t)pitch * (h + 2), sizeof(int));
+    if (err == NULL) return -1;
+
+    memset(out, 0, bin_encoded_size(w, h));
+    for (int y = 0; y < h; y++) {
+        bool reverse = dither == BIN_DITHER_FLOYD_STEINBERG && y % 2 == 1;
+        int dir = reverse ? -1 : 1;
+        for (int i = 0; i < w; i++) {
+            int x = reverse ? w - 1 - i : i;
+            const uint8_t *px = img->pixels + (size_t)y * img->stride + (size_t)x * bpp;
+            int gray = img->format == BIN_PIXELS_RGBA ? (px[0] + px[1] + px[2]) / 3 : px[0];
+            int *at = err + (size_t)y * pitch + x + 2;
+            bool black;
+
+            if (dither == BIN_DITHER_BAYER) {
+                int t = bayer8[y % 8][x % 8] * 4 + 2 + level - BIN_DITHER_LEVEL;
+                black = gray < (t < 0 ? 0 : t > 255 ? 255 : t);
+            } else if (dither == BIN_DITHER_FLOYD_STEINBERG) {
+                int v = gray + ((*at + 8) >> 4);
+                black = v < level;
+                int e = v - (black ? 0 : 255);
+                at[dir] += 7 * e;
+                at[pitch - dir] += 3 * e;
+                at[pitch] += 5 * e;
+                at[pitch + dir] += e;
+            } else {
+                int v = gray + ((*at + 4) >> 3);
+                black = v < level;
+                int e = v - (black ? 0 : 255);
+                at[1] += e;
+                at[2] += e;
+                at[pitch - 1] += e;
+                at[pitch] += e;
+                at[pitch + 1] += e;
+                at[2 * pitch] += e;
+            }
+            if (black) out[(size_t)x * ((h + 7) / 8) + y / 8] |= 0x80 >> (y % 8);
+        }
+    }
+    free(err);
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef _HOST_BIN_ENCODE_H
+#define _HOST_BIN_ENCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// canvasToBin() of the web page: black where the average of r, g and b is below this
+#define BIN_DEFAULT_LEVEL   150
+// Dithering spreads the tones around mid gray
+#define BIN_DITHER_LEVEL    128
+
+typedef enum {
+    BIN_PIXELS_RGBA,        // 4 bytes per pixel as getImageData() returns them, alpha ignored
+    BIN_PIXELS_GRAY,        // 1 byte per pixel
+} bin_pixels_t;
+
+typedef enum {
+    BIN_DITHER_NONE,            // Hard threshold, as canvasToBin()
+    BIN_DITHER_FLOYD_STEINBERG, // Error diffusion to 4 neighbours, serpentine
+    BIN_DITHER_ATKINSON,        // Error diffusion of 3/4 of the error to 6 neighbours, keeps highlights clean
+    BIN_DITHER_BAYER,           // Ordered 8x8, no diffusion, stable between similar images
+} bin_dither_t;
+
+typedef struct {
+    const uint8_t *pixels;
+    int width;
+    int height;
+    int stride;             // Bytes from one row to the next, so a region of a larger image can be encoded
+    bin_pixels_t format;
+} bin_image_t;
+
+// Column-major payload epd_draw_bin_image() reads: (height + 7) / 8 bytes per column, MSB the top pixel, set for black
+size_t bin_encoded_size(int width, int height);
+int bin_encode(const bin_image_t *img, int level, uint8_t *out);
+int bin_encode_dithered(const bin_image_t *img, bin_dither_t dither, int level, uint8_t *out);
+int bin_dither_parse(const char *name, bin_dither_t *dither);
+
+// canvasToBin() as written, column by column over the image, for checking bin_encode() against
+void bin_encode_reference(const bin_image_t *img, int level, uint8_t *out);
+// The same for bin_encode_dithered(): pixel by pixel, with the error of the whole image in memory
+int bin_encode_dithered_reference(const bin_image_t *img, bin_dither_t dither, int level, uint8_t *out);
+
+// Kernel set used by bin_encode(): "auto" (the default) picks the widest one the CPU supports.
+// Not thread-safe, select before encoding from several threads.
+int bin_kernel_select(const char *name);
+const char *bin_kernel_name(void);
+int bin_kernel_list(const char **names, int max);
+
+#endif // _HOST_BIN_ENCODE_H
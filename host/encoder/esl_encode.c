@@ -0,0 +1,294 @@
+/*
+ * Converts an image into the payload of a region, as the web page's
+ * canvasToBin() does for a rendered region.
+ *
+ *   esl_encode IMAGE -o OUT.bin [--level N] [--dither NAME] [--kernel NAME] [--pbm PREVIEW.pbm]
+ *   esl_encode IMAGE... -o OUTDIR [--jobs N] [--pbm PREVIEWDIR] [...]
+ *
+ * IMAGE is a binary netpbm file of 8-bit samples: PGM (P5), PPM (P6), or PAM
+ * (P7) with 1 to 4 channels. The payload fits a region of the image's size,
+ * which is printed; --pbm writes what the tag will show.
+ *
+ * --dither floyd-steinberg, atkinson or bayer replaces the hard threshold for
+ * photos and logos, with the level moved to mid gray unless --level is given.
+ * With several images -o and --pbm name directories, each output is named
+ * after its input, and --jobs threads (default 4) encode them in parallel.
+ */
+#include <libgen.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bin_encode.h"
+#include "pbm.h"
+
+#define MAX_JOBS    64
+
+typedef struct {
+    int width;
+    int height;
+    bin_pixels_t format;
+    uint8_t *pixels;
+} image_t;
+
+// Next header token, skipping whitespace and comments
+static int read_token(FILE *f, char *buf, size_t len)
+{
+    int c;
+    size_t n = 0;
+
+    while ((c = fgetc(f)) != EOF) {
+        if (c == '#') {
+            while ((c = fgetc(f)) != EOF && c != '\n') {}
+        } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+    }
+    while (c != EOF && c != ' ' && c != '\t' && c != '\n' && c != '\r' && n + 1 < len) {
+        buf[n++] = (char)c;
+        c = fgetc(f);
+    }
+    buf[n] = '\0';
+    return n ? 0 : -1;
+}
+
+/**
+ * @brief Reads a PGM, PPM or PAM file into gray or RGBA pixels.
+ */
+static int read_image(const char *path, image_t *img)
+{
+    char token[32];
+    int channels = 0, maxval = 0;
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL || read_token(f, token, sizeof(token)) != 0) goto fail;
+    if (strcmp(token, "P5") == 0 || strcmp(token, "P6") == 0) {
+        channels = token[1] == '5' ? 1 : 3;
+        char w[16], h[16], m[16];
+        if (read_token(f, w, sizeof(w)) || read_token(f, h, sizeof(h)) || read_token(f, m, sizeof(m))) goto fail;
+        img->width = atoi(w);
+        img->height = atoi(h);
+        maxval = atoi(m);
+    } else if (strcmp(token, "P7") == 0) {
+        char value[32];
+        while (read_token(f, token, sizeof(token)) == 0 && strcmp(token, "ENDHDR") != 0) {
+            if (read_token(f, value, sizeof(value)) != 0) goto fail;
+            if (strcmp(token, "WIDTH") == 0) img->width = atoi(value);
+            if (strcmp(token, "HEIGHT") == 0) img->height = atoi(value);
+            if (strcmp(token, "DEPTH") == 0) channels = atoi(value);
+            if (strcmp(token, "MAXVAL") == 0) maxval = atoi(value);
+            // TUPLTYPE follows from DEPTH here
+        }
+    } else {
+        goto fail;
+    }
+    if (img->width <= 0 || img->height <= 0 || channels < 1 || channels > 4 || maxval != 255) goto fail;
+
+    // Gray, gray with alpha, RGB or RGBA; alpha is ignored as canvasToBin() ignores it
+    size_t count = (size_t)img->width * img->height;
+    uint8_t *raw = malloc(count * channels);
+    img->format = channels <= 2 ? BIN_PIXELS_GRAY : BIN_PIXELS_RGBA;
+    img->pixels = malloc(count * (img->format == BIN_PIXELS_RGBA ? 4 : 1));
+    if (raw == NULL || img->pixels == NULL || fread(raw, channels, count, f) != count) {
+        free(raw);
+        free(img->pixels);
+        goto fail;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *src = raw + i * channels;
+        if (img->format == BIN_PIXELS_GRAY) {
+            img->pixels[i] = src[0];
+        } else {
+            memcpy(img->pixels + i * 4, src, 3);
+            img->pixels[i * 4 + 3] = 0xFF;
+        }
+    }
+    free(raw);
+    fclose(f);
+    return 0;
+
+fail:
+    if (f) fclose(f);
+    return -1;
+}
+
+static int write_preview(const char *path, const uint8_t *payload, int width, int height)
+{
+    pbm_image_t preview;
+    int bytes_per_col = (height + 7) / 8;
+
+    if (pbm_alloc(&preview, width, height) != 0) return -1;
+    for (int x = 0; x < width; x++) {
+        for (int y = 0; y < height; y++) {
+            pbm_set(&preview, x, y, payload[x * bytes_per_col + y / 8] & (0x80 >> (y % 8)));
+        }
+    }
+    int result = pbm_write(path, &preview);
+    pbm_free(&preview);
+    return result;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s IMAGE -o OUT.bin [--level N] [--dither NAME] [--kernel NAME] [--pbm PREVIEW.pbm]\n"
+            "       %s IMAGE... -o OUTDIR [--jobs N] [--pbm PREVIEWDIR] [...]\n"
+            "dither: none, floyd-steinberg, atkinson, bayer\n",
+            prog, prog);
+    exit(2);
+}
+
+typedef struct {
+    const char **inputs;
+    int count;
+    const char *output;         // File for one image, directory for a batch
+    const char *preview;
+    bool batch;
+    int level;
+    bin_dither_t dither;
+    atomic_int next;            // Index of the next image a worker takes
+    atomic_int failed;
+    atomic_llong pixels;
+} batch_t;
+
+// Output path of an input: the path itself for one image, DIR/BASENAME.EXT in a batch
+static void output_path(const batch_t *b, const char *dir, const char *input, const char *ext, char *path,
+                        size_t len)
+{
+    if (!b->batch) {
+        snprintf(path, len, "%s", dir);
+        return;
+    }
+    char name[256];
+    snprintf(name, sizeof(name), "%s", input);
+    char *base = basename(name);
+    char *dot = strrchr(base, '.');
+    if (dot && dot != base) *dot = '\0';
+    snprintf(path, len, "%s/%s%s", dir, base, ext);
+}
+
+/**
+ * @brief Reads, encodes and writes one image; messages name the input so a batch stays readable.
+ */
+static int encode_file(batch_t *b, const char *input)
+{
+    char path[512];
+    image_t img = { 0 };
+
+    if (read_image(input, &img) != 0) {
+        fprintf(stderr, "cannot read %s, expected 8-bit PGM, PPM or PAM\n", input);
+        return -1;
+    }
+    size_t len = bin_encoded_size(img.width, img.height);
+    uint8_t *payload = malloc(len);
+    bin_image_t src = { img.pixels, img.width, img.height, img.width * (img.format == BIN_PIXELS_RGBA ? 4 : 1),
+                        img.format };
+    int result = -1;
+    if (payload == NULL || bin_encode_dithered(&src, b->dither, b->level, payload) != 0) goto done;
+
+    output_path(b, b->output, input, ".bin", path, sizeof(path));
+    FILE *f = fopen(path, "wb");
+    if (f == NULL || fwrite(payload, 1, len, f) != len) {
+        fprintf(stderr, "cannot write %s\n", path);
+        if (f) fclose(f);
+        goto done;
+    }
+    fclose(f);
+    if (b->preview) {
+        char preview[512];
+        output_path(b, b->preview, input, ".pbm", preview, sizeof(preview));
+        if (write_preview(preview, payload, img.width, img.height) != 0) {
+            fprintf(stderr, "cannot write %s\n", preview);
+            goto done;
+        }
+    }
+    if (!b->batch) printf("%s: %dx%d region, %zu bytes (%s)\n", path, img.width, img.height, len, bin_kernel_name());
+    atomic_fetch_add(&b->pixels, (long long)img.width * img.height);
+    result = 0;
+
+done:
+    free(payload);
+    free(img.pixels);
+    return result;
+}
+
+static void *worker(void *arg)
+{
+    batch_t *b = arg;
+    int i;
+
+    while ((i = atomic_fetch_add(&b->next, 1)) < b->count) {
+        if (encode_file(b, b->inputs[i]) != 0) atomic_fetch_add(&b->failed, 1);
+    }
+    return NULL;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    const char *dither = "none";
+    int level = 0, jobs = 4;
+    batch_t b = { 0 };
+
+    b.inputs = calloc(argc, sizeof(*b.inputs));
+    if (b.inputs == NULL) return 1;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (arg[0] != '-') {
+            b.inputs[b.count++] = arg;
+            continue;
+        }
+        const char *val = i + 1 < argc ? argv[++i] : NULL;
+        if (val == NULL) usage(argv[0]);
+        if (strcmp(arg, "-o") == 0) {
+            b.output = val;
+        } else if (strcmp(arg, "--level") == 0) {
+            level = atoi(val);
+            if (level < 1 || level > 255) usage(argv[0]);
+        } else if (strcmp(arg, "--dither") == 0) {
+            dither = val;
+        } else if (strcmp(arg, "--jobs") == 0) {
+            jobs = atoi(val);
+        } else if (strcmp(arg, "--kernel") == 0) {
+            if (bin_kernel_select(val) != 0) {
+                fprintf(stderr, "kernel %s is not available on this CPU\n", val);
+                return 2;
+            }
+        } else if (strcmp(arg, "--pbm") == 0) {
+            b.preview = val;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (b.count == 0 || b.output == NULL || jobs < 1 || jobs > MAX_JOBS) usage(argv[0]);
+    if (bin_dither_parse(dither, &b.dither) != 0) usage(argv[0]);
+    b.level = level ? level : b.dither == BIN_DITHER_NONE ? BIN_DEFAULT_LEVEL : BIN_DITHER_LEVEL;
+    b.batch = b.count > 1;
+    if (!b.batch) return encode_file(&b, b.inputs[0]) == 0 ? 0 : 1;
+
+    pthread_t threads[MAX_JOBS];
+    double start = now_s();
+    if (jobs > b.count) jobs = b.count;
+    for (int i = 0; i < jobs; i++) {
+        if (pthread_create(&threads[i], NULL, worker, &b) != 0) jobs = i;
+    }
+    if (jobs == 0) worker(&b);
+    for (int i = 0; i < jobs; i++) pthread_join(threads[i], NULL);
+    double elapsed = now_s() - start;
+
+    int failed = atomic_load(&b.failed);
+    printf("%d images, %.1f Mpixels in %.3f s, %.0f images/s (%s, %s, %d jobs)%s\n", b.count - failed,
+           atomic_load(&b.pixels) / 1e6, elapsed, (b.count - failed) / elapsed, dither, bin_kernel_name(), jobs,
+           failed ? ", some failed" : "");
+    free(b.inputs);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,571 @@
+/*
+ * Runs a fleet of virtual tags against an MQTT broker, for load-testing the
+ * server and broker with more tags than there are boards.
+ *
+ *   fleet_sim [--broker mqtt://host:port] [--tags N] [--duration S] [--spawn-rate N]
+ *             [--base-mac HEX] [--group PREFIX] [--sleep-s S] [--awake-ms MS] [--spi-ms MS]
+ *             [--csv FILE] [--snapshot DIR] [-v]
+ *
+ * Every tag is a child process running the firmware on its own MAC-derived
+ * topics (esl/<mac>/...): the MQTT data path of esl_mqtt.c, the router,
+ * reassembly, acks, the region cache, and esl_ui with its commit task, which
+ * drives epd_display.c into the panel model. SPI bytes cost --spi-ms per
+ * framebuffer push and BUSY follows the model's timing, so a refresh holds
+ * the framebuffer lock as long as on the board. With --sleep-s the tag
+ * disconnects after --awake-ms without activity and resumes its persistent
+ * session after the sleep period, so the broker queues QoS 1 updates meanwhile.
+ *
+ * At the end every tag reports its receive-to-commit latency, from the first
+ * chunk of an update to the end of the commit that puts it on glass.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "epd_display.h"
+#include "epd_graphics.h"
+#include "esl/esl_ack.h"
+#include "esl/esl_cache.h"
+#include "esl/esl_inflight.h"
+#include "esl/esl_layout.h"
+#include "esl/esl_mqtt.h"
+#include "esl/esl_router.h"
+#include "esl/esl_stats.h"
+#include "esl/esl_time.h"
+#include "esl/esl_ui.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host_log.h"
+#include "host_panel.h"
+#include "latency_hist.h"
+#include "mqtt_lite.h"
+#include "pbm.h"
+#include "sdkconfig.h"
+
+#define MQTT_BUFFER_SIZE    1024    // esp-mqtt default, payloads arrive in chunks of this size
+#define MQTT_KEEPALIVE_S    120     // esp-mqtt default
+#define CONNECT_TIMEOUT_MS  5000
+#define RECONNECT_DELAY_MS  1000
+#define POLL_MAX_MS         1000
+#define DRAIN_TIMEOUT_MS    30000   // Longest wait for the last batch to reach glass at the end
+#define RECEIVED_MAX        256     // Region updates waiting for their commit whose latency is tracked
+#define SLOWEST_SHOWN       5
+
+#if CONFIG_ESL_MQTT_PERSISTENT_SESSION
+#define CLEAN_SESSION       false
+#else
+#define CLEAN_SESSION       true
+#endif
+
+static const char *TAG_FLEET = "FLEET";
+
+typedef struct {
+    char host[128];
+    int port;
+    int tags;
+    int duration_s;
+    int spawn_rate;             // Tags started per second
+    uint64_t base_mac;
+    const char *group;          // Group prefix every tag is a member of, NULL for none
+    int sleep_s;                // 0 stays connected
+    int awake_ms;
+    int spi_ms;                 // Framebuffer push before the refresh
+    const char *csv_path;
+    const char *snapshot_dir;
+} fleet_options_t;
+
+// Sent by every tag to the parent when it stops, in one write below PIPE_BUF so writes never interleave
+typedef struct {
+    uint32_t index;
+    uint32_t messages;          // Messages received in full and dispatched
+    uint32_t dropped;           // Messages dropped by the reassembly pool
+    uint32_t updates;           // Region payloads drawn or found unchanged
+    uint32_t commits;
+    uint32_t refreshes;         // Commits that refreshed the panel
+    uint32_t connects;
+    uint32_t connect_failures;
+    uint64_t bytes;             // Payload bytes received
+    latency_hist_t latency;     // Receive-to-commit, per region update
+} tag_result_t;
+
+_Static_assert(sizeof(tag_result_t) <= 4096, "tag result must fit in PIPE_BUF");
+
+static fleet_options_t opt = {
+    .host = "localhost",
+    .port = 1883,
+    .tags = 100,
+    .duration_s = 60,
+    .spawn_rate = 100,
+    .base_mac = 0x0200000000ull,
+    .awake_ms = 3000,
+    .spi_ms = 850,
+};
+
+static volatile sig_atomic_t stop_requested;
+
+// The built-in layout of esl_layout.c, which needs cJSON and is not built on the host
+static const esl_layout_t layout = {
+    .version = 1,
+    .region_count = 2,
+    .regions = {
+        { "price",       PRICE_X, PRICE_Y, PRICE_W, PRICE_H, 0 },
+        { "description", DESC_X,  DESC_Y,  DESC_W,  DESC_H,  0 },
+    },
+};
+
+// State of the one tag a child process runs
+static struct esp_mqtt_client client;
+static uint8_t framebuffer[EPD_BUF_SIZE];
+static tag_result_t result;
+static int64_t last_activity_us;
+static int64_t dispatch_received_us;    // First chunk of the message being dispatched
+static bool dispatch_scheduled;         // It waits for an activation time
+
+// First chunk times of the updates handed to esl_ui and not committed yet, oldest first.
+// The MQTT thread adds, the commit task takes a batch at a time.
+static pthread_mutex_t received_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t received_us[RECEIVED_MAX];
+static uint32_t received_head;
+static uint32_t received_count;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void sleep_us(int64_t us)
+{
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR && !stop_requested) {
+    }
+}
+
+const esl_layout_t *esl_layout_get(void)
+{
+    return &layout;
+}
+
+// Called by esl_mqtt_handle_data() for every message received in full
+void esl_stats_note_receive(int64_t first_chunk_us, int len)
+{
+    dispatch_received_us = first_chunk_us;
+    result.messages++;
+    result.bytes += len;
+}
+
+/**
+ * @brief Runs esl_ui_region_handler() and queues the receive time if the update joined a batch.
+ *
+ * The time is queued before the handler so a commit in between cannot miss it,
+ * and taken back if the handler rejected the payload. Updates with an activation
+ * time go live with their frame rather than a batch and are not tracked.
+ */
+static void region_handler(const uint8_t *data, int len, void *arg)
+{
+    esl_ui_stats_t before, after;
+    bool tracked = false;
+
+    esl_ui_get_stats(&before);
+    pthread_mutex_lock(&received_lock);
+    if (!dispatch_scheduled && received_count < RECEIVED_MAX) {
+        received_us[(received_head + received_count++) % RECEIVED_MAX] = dispatch_received_us;
+        tracked = true;
+    }
+    pthread_mutex_unlock(&received_lock);
+
+    esl_ui_region_handler(data, len, arg);
+
+    esl_ui_get_stats(&after);
+    if (tracked && after.updates == before.updates) {
+        // Nothing the commit task takes was queued after it, as only this thread adds
+        pthread_mutex_lock(&received_lock);
+        if (received_count) received_count--;
+        pthread_mutex_unlock(&received_lock);
+    }
+}
+
+// Called from the esl_ui commit task once the batch is on glass
+static void on_commit(bool refreshed, uint32_t batch)
+{
+    int64_t now = esp_timer_get_time();
+
+    pthread_mutex_lock(&received_lock);
+    for (uint32_t i = 0; i < batch && received_count; i++, received_count--) {
+        latency_hist_add(&result.latency, (uint64_t)(now - received_us[received_head]));
+        received_head = (received_head + 1) % RECEIVED_MAX;
+    }
+    pthread_mutex_unlock(&received_lock);
+    ESP_LOGI(TAG_FLEET, "Committed %lu update(s)%s", (unsigned long)batch, refreshed ? "" : ", unchanged");
+}
+
+/**
+ * @brief Hands one PUBLISH to esl_mqtt_handle_data() in the chunks esp-mqtt would deliver.
+ */
+static void on_publish(void *ctx, const char *topic, int topic_len, const uint8_t *data, int len, int msg_id)
+{
+    (void)ctx;
+    last_activity_us = esp_timer_get_time();
+
+    esl_ack_header_t hdr = { 0 };
+    esl_ack_parse(data, len, &hdr);
+    dispatch_scheduled = hdr.activate_at != 0 && (time_t)hdr.activate_at > time(NULL);
+
+    // The first chunk shares the receive buffer with the fixed header and topic
+    esp_mqtt_event_t event = {
+        .client = &client,
+        .msg_id = msg_id,
+        .topic = topic,
+        .topic_len = topic_len,
+        .total_data_len = len,
+    };
+    int chunk = MQTT_BUFFER_SIZE - (2 + 2 + topic_len + 2);
+    do {
+        event.data = (const char *)data + event.current_data_offset;
+        event.data_len = len - event.current_data_offset < chunk ? len - event.current_data_offset : chunk;
+        esl_mqtt_handle_data(&event);
+        event.current_data_offset += event.data_len;
+        event.topic = NULL;
+        event.topic_len = 0;
+        chunk = MQTT_BUFFER_SIZE;
+    } while (event.current_data_offset < len);
+}
+
+static bool tag_connect(const char *client_id)
+{
+    int session = mqtt_lite_connect(&client, opt.host, opt.port, client_id, CLEAN_SESSION, MQTT_KEEPALIVE_S,
+                                    CONNECT_TIMEOUT_MS);
+    if (session < 0) {
+        result.connect_failures++;
+        return false;
+    }
+    ESP_LOGI(TAG_FLEET, "Connected, session %s", session ? "resumed" : "new");
+    esl_router_subscribe(&client, CONFIG_ESL_MQTT_SUBSCRIBE_QOS);
+    result.connects++;
+    last_activity_us = esp_timer_get_time();
+    return true;
+}
+
+// Sleeping drops messages half received, as on the board
+static void tag_disconnect(void)
+{
+    mqtt_lite_disconnect(&client);
+    esl_inflight_reclaim(true);
+}
+
+// Nothing is half received, waiting for its commit or staged for later
+static bool tag_idle(void)
+{
+    esl_inflight_stats_t stats;
+    esl_inflight_get_stats(&stats);
+    return stats.in_use == 0 && esl_ui_idle();
+}
+
+// Writes what the panel model shows, as the last refresh left it
+static void write_snapshot(const char *mac_str)
+{
+    static uint8_t glass[EPD_BUF_SIZE];
+    char path[512];
+    pbm_image_t img;
+
+    memcpy(glass, host_panel_get()->glass, EPD_BUF_SIZE);
+    epd_set_buffer(glass, EPD_WIDTH, EPD_HEIGHT, EPD_ROTATE_0, WHITE);
+    if (pbm_alloc(&img, epd_fb.width, epd_fb.height) != 0) return;
+    for (int y = 0; y < epd_fb.height; y++) {
+        for (int x = 0; x < epd_fb.width; x++) {
+            pbm_set(&img, x, y, epd_get_pixel(x, y) == BLACK);
+        }
+    }
+    snprintf(path, sizeof(path), "%s/%s.pbm", opt.snapshot_dir, mac_str);
+    if (pbm_write(path, &img) != 0) {
+        ESP_LOGW(TAG_FLEET, "Cannot write %s", path);
+    }
+    pbm_free(&img);
+}
+
+/**
+ * @brief Runs one virtual tag until the deadline, then reports to the parent over result_fd.
+ */
+static void run_tag(int index, int result_fd, int64_t end_us)
+{
+    char mac_str[16], prefix[32], ack_topic[48], client_id[24], log_prefix[24];
+
+    snprintf(mac_str, sizeof(mac_str), "%012llx", (unsigned long long)(opt.base_mac + index));
+    snprintf(prefix, sizeof(prefix), "esl/%s", mac_str);
+    snprintf(ack_topic, sizeof(ack_topic), "%s/ack", prefix);
+    snprintf(client_id, sizeof(client_id), "esl-%s", mac_str);
+    snprintf(log_prefix, sizeof(log_prefix), "%s ", mac_str);
+    host_log_prefix = log_prefix;
+    result.index = index;
+
+    // Both planes go out on every refresh
+    host_panel_init(&mock_panel_default_timing, (uint32_t)(opt.spi_ms * 1000000ull / (2 * EPD_BUF_SIZE)));
+
+    // Same order as app_main(), with the panel resumed showing a white frame
+    esl_cache_init();
+    esl_router_init(prefix);
+    if (opt.group) esl_router_set_groups(&opt.group, 1);
+    for (int i = 0; i < layout.region_count; i++) {
+        esl_router_register_shared(layout.regions[i].name, region_handler, (void *)(intptr_t)i);
+    }
+    epd_set_buffer(framebuffer, EPD_WIDTH, EPD_HEIGHT, EPD_ROTATE_0, WHITE);
+    epd_clear_buffer(WHITE);
+    if (esl_ui_init(on_commit) != ESP_OK) _exit(1);
+    epd_spi_init();
+    epd_gpio_init();
+    epd_set_old_image(framebuffer);
+    esl_ui_set_ready();
+    esl_time_init(esl_ui_schedule_rearm);
+    if (esl_inflight_init() != ESP_OK) _exit(1);
+    mqtt_lite_init(&client, on_publish, NULL);
+    esl_ack_init(&client, ack_topic);
+
+    int64_t wake_us = 0;    // Reconnect or wake time while disconnected
+    while (!stop_requested) {
+        int64_t now = esp_timer_get_time();
+        if (now >= end_us) break;
+
+        if (client.fd < 0) {
+            if (now < wake_us) {
+                sleep_us((wake_us < end_us ? wake_us : end_us) - now);
+                continue;
+            }
+            if (!tag_connect(client_id)) {
+                wake_us = esp_timer_get_time() + RECONNECT_DELAY_MS * 1000LL;
+                continue;
+            }
+        }
+
+        // Commits run on the esl_ui task, so only the end of the awake window or the run is due here
+        int64_t deadline = end_us;
+        if (opt.sleep_s) {
+            int64_t idle = last_activity_us + opt.awake_ms * 1000LL;
+            if (idle < deadline) deadline = idle;
+        }
+        int64_t timeout_ms = (deadline - now + 999) / 1000;
+        if (timeout_ms < 1) timeout_ms = 1;
+        if (timeout_ms > POLL_MAX_MS) timeout_ms = POLL_MAX_MS;
+
+        if (mqtt_lite_poll(&client, (int)timeout_ms) < 0) {
+            ESP_LOGW(TAG_FLEET, "Disconnected");
+            tag_disconnect();
+            wake_us = esp_timer_get_time() + RECONNECT_DELAY_MS * 1000LL;
+            continue;
+        }
+
+        // As esl_sleep.c, never while an update waits for its refresh
+        now = esp_timer_get_time();
+        if (opt.sleep_s && now >= last_activity_us + opt.awake_ms * 1000LL && tag_idle()) {
+            ESP_LOGI(TAG_FLEET, "Sleeping for %d s", opt.sleep_s);
+            tag_disconnect();
+            wake_us = now + opt.sleep_s * 1000000LL;
+        }
+    }
+
+    // Whatever is drawn still goes on glass, so its latency is not lost
+    int64_t drain_end = esp_timer_get_time() + DRAIN_TIMEOUT_MS * 1000LL;
+    while (!esl_ui_idle() && esp_timer_get_time() < drain_end) {
+        sleep_us(10000);
+    }
+    mqtt_lite_free(&client);
+
+    esl_ui_stats_t ui;
+    esl_inflight_stats_t inflight;
+    esl_ui_get_stats(&ui);
+    esl_inflight_get_stats(&inflight);
+    result.updates = ui.updates;
+    result.commits = ui.commits;
+    result.refreshes = ui.refreshes;
+    result.dropped = inflight.exhausted + inflight.oversized;
+    pthread_mutex_lock(&received_lock);
+    tag_result_t report = result;
+    pthread_mutex_unlock(&received_lock);
+
+    if (opt.snapshot_dir) write_snapshot(mac_str);
+    if (write(result_fd, &report, sizeof(report)) != (ssize_t)sizeof(report)) _exit(1);
+    _exit(0);
+}
+
+static int compare_p99(const void *a, const void *b)
+{
+    uint64_t pa = latency_hist_percentile(&((const tag_result_t *)a)->latency, 99);
+    uint64_t pb = latency_hist_percentile(&((const tag_result_t *)b)->latency, 99);
+    return pa < pb ? 1 : pa > pb ? -1 : 0;
+}
+
+static int write_csv(const char *path, const tag_result_t *results, int count)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) return -1;
+
+    fprintf(f, "mac,messages,bytes,updates,commits,refreshes,dropped,connects,connect_failures,"
+               "p50_ms,p99_ms,max_ms\n");
+    for (int i = 0; i < count; i++) {
+        const tag_result_t *r = &results[i];
+        fprintf(f, "%012llx,%u,%llu,%u,%u,%u,%u,%u,%u,%.1f,%.1f,%.1f\n",
+                (unsigned long long)(opt.base_mac + r->index), r->messages, (unsigned long long)r->bytes,
+                r->updates, r->commits, r->refreshes, r->dropped, r->connects, r->connect_failures,
+                latency_hist_percentile(&r->latency, 50) / 1000.0, latency_hist_percentile(&r->latency, 99) / 1000.0,
+                r->latency.max_us / 1000.0);
+    }
+    return fclose(f);
+}
+
+static void report(tag_result_t *results, int count, int spawned, double elapsed_s)
+{
+    tag_result_t total = { 0 };
+    latency_hist_t *lat = &total.latency;
+
+    for (int i = 0; i < count; i++) {
+        total.messages += results[i].messages;
+        total.dropped += results[i].dropped;
+        total.updates += results[i].updates;
+        total.commits += results[i].commits;
+        total.refreshes += results[i].refreshes;
+        total.connects += results[i].connects;
+        total.connect_failures += results[i].connect_failures;
+        total.bytes += results[i].bytes;
+        latency_hist_merge(lat, &results[i].latency);
+    }
+
+    printf("tags          %d reported, %d started\n", count, spawned);
+    printf("elapsed       %.1f s\n", elapsed_s);
+    printf("messages      %u (%.1f/s), %u dropped\n", total.messages, total.messages / elapsed_s, total.dropped);
+    printf("payload       %.1f KB (%.1f KB/s)\n", total.bytes / 1024.0, total.bytes / 1024.0 / elapsed_s);
+    printf("updates       %u in %u commits (%.1f/s), %u refreshes\n", total.updates, total.commits,
+           total.commits / elapsed_s, total.refreshes);
+    printf("connects      %u, %u failed\n", total.connects, total.connect_failures);
+    if (lat->count == 0) return;
+
+    printf("receive-to-commit latency over %llu updates (ms)\n", (unsigned long long)lat->count);
+    printf("  mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n", latency_hist_mean(lat) / 1000.0,
+           latency_hist_percentile(lat, 50) / 1000.0, latency_hist_percentile(lat, 90) / 1000.0,
+           latency_hist_percentile(lat, 99) / 1000.0, lat->max_us / 1000.0);
+
+    qsort(results, count, sizeof(results[0]), compare_p99);
+    printf("slowest tags by p99 (ms)\n");
+    for (int i = 0; i < count && i < SLOWEST_SHOWN && results[i].latency.count; i++) {
+        printf("  %012llx  p99 %.1f  max %.1f  updates %u\n", (unsigned long long)(opt.base_mac + results[i].index),
+               latency_hist_percentile(&results[i].latency, 99) / 1000.0, results[i].latency.max_us / 1000.0,
+               results[i].updates);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--broker mqtt://host:port] [--tags N] [--duration S] [--spawn-rate N]\n"
+            "          [--base-mac HEX] [--group PREFIX] [--sleep-s S] [--awake-ms MS] [--spi-ms MS]\n"
+            "          [--csv FILE] [--snapshot DIR] [-v]\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "-v") == 0) {
+            host_log_level++;
+            continue;
+        }
+        if (val == NULL) usage(argv[0]);
+        i++;
+        if (strcmp(arg, "--broker") == 0) {
+            if (mqtt_lite_parse_broker(val, opt.host, sizeof(opt.host), &opt.port) != 0) usage(argv[0]);
+        } else if (strcmp(arg, "--tags") == 0) {
+            opt.tags = atoi(val);
+        } else if (strcmp(arg, "--duration") == 0) {
+            opt.duration_s = atoi(val);
+        } else if (strcmp(arg, "--spawn-rate") == 0) {
+            opt.spawn_rate = atoi(val);
+        } else if (strcmp(arg, "--base-mac") == 0) {
+            opt.base_mac = strtoull(val, NULL, 16);
+        } else if (strcmp(arg, "--group") == 0) {
+            opt.group = val;
+        } else if (strcmp(arg, "--sleep-s") == 0) {
+            opt.sleep_s = atoi(val);
+        } else if (strcmp(arg, "--awake-ms") == 0) {
+            opt.awake_ms = atoi(val);
+        } else if (strcmp(arg, "--spi-ms") == 0) {
+            opt.spi_ms = atoi(val);
+        } else if (strcmp(arg, "--csv") == 0) {
+            opt.csv_path = val;
+        } else if (strcmp(arg, "--snapshot") == 0) {
+            opt.snapshot_dir = val;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (opt.tags <= 0 || opt.duration_s <= 0 || opt.spawn_rate <= 0 || opt.sleep_s < 0 || opt.awake_ms < 0 ||
+        opt.spi_ms < 0) {
+        usage(argv[0]);
+    }
+    if (opt.snapshot_dir && mkdir(opt.snapshot_dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "cannot create %s\n", opt.snapshot_dir);
+        return 2;
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return 2;
+    }
+
+    // Children report on SIGINT rather than die, the parent keeps collecting
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int64_t start_us = esp_timer_get_time();
+    int spawned = 0;
+    for (; spawned < opt.tags && !stop_requested; spawned++) {
+        // Tags boot spread out at the spawn rate, every one runs for the full duration
+        int64_t due = start_us + spawned * 1000000LL / opt.spawn_rate;
+        int64_t now = esp_timer_get_time();
+        if (due > now) sleep_us(due - now);
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "fork failed after %d tags: %s\n", spawned, strerror(errno));
+            break;
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            run_tag(spawned, fds[1], esp_timer_get_time() + opt.duration_s * 1000000LL);
+        }
+    }
+    close(fds[1]);
+    fprintf(stderr, "%d tags started, running for %d s\n", spawned, opt.duration_s);
+
+    tag_result_t *results = calloc(spawned ? spawned : 1, sizeof(tag_result_t));
+    if (results == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+    int count = 0;
+    while (count < spawned) {
+        ssize_t n = read(fds[0], &results[count], sizeof(tag_result_t));
+        if (n < 0 && errno == EINTR) continue;
+        if (n != (ssize_t)sizeof(tag_result_t)) break;
+        count++;
+    }
+    while (wait(NULL) > 0 || errno == EINTR) {
+    }
+    double elapsed_s = (esp_timer_get_time() - start_us) / 1e6;
+
+    if (opt.csv_path && write_csv(opt.csv_path, results, count) != 0) {
+        fprintf(stderr, "cannot write %s\n", opt.csv_path);
+    }
+    report(results, count, spawned, elapsed_s);
+    free(results);
+    return count == spawned ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+/*
+ * Renders a draw script through the firmware's graphics and region decoding
+ * code, writes the result as PBM and optionally compares it with a golden image.
+ *
+ *   esl_render <script> -o <out.pbm> [--golden <expected.pbm> [--diff <diff.pbm>] [--update]]
+ *
+ * Script lines, coordinates in the logical (rotated) view, paths relative to the script:
+ *
+ *   rotation <0|90|180|270>            First command, clears the buffer to white
+ *   fill <white|black>
+ *   pixel <x> <y> <color>
+ *   clear <x> <y> <w> <h> <color>
+ *   char <x> <y> <size> <color> <c>
+ *   string <x> <y> <size> <color> <text...>
+ *   image <x> <y> <w> <h> <color> <file>
+ *   bin <x> <y> <w> <h> <file>
+ *   circle <x> <y> <r> <color> <fill|outline>
+ *   region <x> <y> <w> <h> <font> @<file>   Recorded region payload, as published on MQTT
+ *   region <x> <y> <w> <h> <font> <text...> Text payload given inline
+ *
+ * Exit status: 0 rendered (and matching), 1 differs from the golden image, 2 usage or script error.
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "epd_display.h"
+#include "epd_graphics.h"
+#include "esl/esl_draw.h"
+#include "pbm.h"
+
+#define LINE_MAX_LEN    512
+#define PAYLOAD_MAX_LEN (EPD_BUF_SIZE)
+
+static uint8_t framebuffer[EPD_BUF_SIZE];
+static char script_dir[256];
+static const char *script_path;
+static int line_no;
+
+static void fail(const char *msg, const char *arg)
+{
+    fprintf(stderr, "%s:%d: %s%s%s\n", script_path, line_no, msg, arg ? ": " : "", arg ? arg : "");
+    exit(2);
+}
+
+static int parse_int(const char *tok)
+{
+    char *end;
+    if (tok == NULL) fail("missing argument", NULL);
+    long v = strtol(tok, &end, 0);
+    if (*end != '\0') fail("not a number", tok);
+    return (int)v;
+}
+
+static uint8_t parse_color(const char *tok)
+{
+    if (tok && strcmp(tok, "white") == 0) return WHITE;
+    if (tok && strcmp(tok, "black") == 0) return BLACK;
+    fail("expected white or black", tok);
+    return WHITE;
+}
+
+// Loads a file relative to the script into buf, returns its length
+static int load_file(const char *name, uint8_t *buf, int max)
+{
+    char path[512];
+
+    if (name == NULL) fail("missing file name", NULL);
+    snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : script_dir, name);
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) fail("cannot open", path);
+    int len = (int)fread(buf, 1, max, f);
+    fclose(f);
+    return len;
+}
+
+// Rest of the line after skipping n whitespace-separated fields
+static const char *rest_after(const char *line, int n)
+{
+    const char *p = line;
+    for (int i = 0; i < n; i++) {
+        while (isspace((unsigned char)*p)) p++;
+        while (*p && !isspace((unsigned char)*p)) p++;
+    }
+    while (isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+static void run_line(char *line, bool *started)
+{
+    static uint8_t payload[PAYLOAD_MAX_LEN];
+    char copy[LINE_MAX_LEN];
+    char *args[8] = { 0 };
+
+    line[strcspn(line, "\r\n")] = '\0';
+    strcpy(copy, line);
+
+    char *cmd = strtok(copy, " \t");
+    if (cmd == NULL || cmd[0] == '#') return;
+    for (int i = 0; i < 8; i++) args[i] = strtok(NULL, " \t");
+
+    if (strcmp(cmd, "rotation") == 0) {
+        if (*started) fail("rotation must be the first command", NULL);
+        int rot = parse_int(args[0]);
+        if (rot != 0 && rot != 90 && rot != 180 && rot != 270) fail("bad rotation", args[0]);
+        epd_set_buffer(framebuffer, EPD_WIDTH, EPD_HEIGHT, (epd_rotation_t)rot, WHITE);
+        epd_clear_buffer(WHITE);
+        *started = true;
+        return;
+    }
+    if (!*started) fail("script must start with rotation", NULL);
+
+    if (strcmp(cmd, "fill") == 0) {
+        epd_clear_buffer(parse_color(args[0]));
+    } else if (strcmp(cmd, "pixel") == 0) {
+        epd_draw_pixel(parse_int(args[0]), parse_int(args[1]), parse_color(args[2]));
+    } else if (strcmp(cmd, "clear") == 0) {
+        epd_clear_buffer_region(parse_int(args[0]), parse_int(args[1]), parse_int(args[2]),
+                                parse_int(args[3]), parse_color(args[4]));
+    } else if (strcmp(cmd, "char") == 0) {
+        if (args[4] == NULL) fail("missing character", NULL);
+        epd_draw_char(parse_int(args[0]), parse_int(args[1]), args[4][0], parse_int(args[2]),
+                      parse_color(args[3]));
+    } else if (strcmp(cmd, "string") == 0) {
+        epd_draw_string(parse_int(args[0]), parse_int(args[1]), rest_after(line, 5), parse_int(args[2]),
+                        parse_color(args[3]));
+    } else if (strcmp(cmd, "image") == 0) {
+        int w = parse_int(args[2]), h = parse_int(args[3]);
+        if (load_file(args[5], payload, sizeof(payload)) < w * ((h + 7) / 8)) fail("image too short", args[5]);
+        epd_draw_image(parse_int(args[0]), parse_int(args[1]), w, h, payload, parse_color(args[4]));
+    } else if (strcmp(cmd, "bin") == 0) {
+        int w = parse_int(args[2]), h = parse_int(args[3]);
+        if (load_file(args[4], payload, sizeof(payload)) < w * ((h + 7) / 8)) fail("bitmap too short", args[4]);
+        epd_draw_bin_image(payload, parse_int(args[0]), parse_int(args[1]), w, h);
+    } else if (strcmp(cmd, "circle") == 0) {
+        if (args[4] == NULL || (strcmp(args[4], "fill") != 0 && strcmp(args[4], "outline") != 0)) {
+            fail("expected fill or outline", args[4]);
+        }
+        epd_draw_circle(parse_int(args[0]), parse_int(args[1]), parse_int(args[2]), parse_color(args[3]),
+                        strcmp(args[4], "fill") == 0);
+    } else if (strcmp(cmd, "region") == 0) {
+        esl_region_desc_t desc = {
+            .name = "script",
+            .x = parse_int(args[0]),
+            .y = parse_int(args[1]),
+            .w = parse_int(args[2]),
+            .h = parse_int(args[3]),
+            .font = parse_int(args[4]),
+        };
+        const char *text = rest_after(line, 6);
+        int len;
+        if (text[0] == '@') {
+            len = load_file(text + 1, payload, sizeof(payload));
+        } else {
+            len = (int)strlen(text);
+            memcpy(payload, text, len);
+        }
+        // Same check as the region handler, which rejects such payloads
+        if (desc.font == 0 && len != desc.w * ((desc.h + 7) / 8)) fail("payload size does not match region", text);
+        esl_draw_region(&desc, payload, len);
+    } else {
+        fail("unknown command", cmd);
+    }
+}
+
+// Copies the logical view of the framebuffer, as seen on the tag
+static void snapshot(pbm_image_t *img)
+{
+    if (pbm_alloc(img, epd_fb.width, epd_fb.height) != 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+    for (int y = 0; y < epd_fb.height; y++) {
+        for (int x = 0; x < epd_fb.width; x++) {
+            pbm_set(img, x, y, epd_get_pixel(x, y) == BLACK);
+        }
+    }
+}
+
+// Returns the number of differing pixels and writes a diff image if a path is given
+static long compare(const pbm_image_t *actual, const pbm_image_t *golden, const char *diff_path)
+{
+    pbm_image_t diff;
+    int x0 = actual->width, y0 = actual->height, x1 = -1, y1 = -1;
+    long count = 0;
+
+    if (actual->width != golden->width || actual->height != golden->height) {
+        fprintf(stderr, "size %dx%d, golden is %dx%d\n", actual->width, actual->height,
+                golden->width, golden->height);
+        return -1;
+    }
+
+    if (diff_path && pbm_alloc(&diff, actual->width, actual->height) != 0) diff_path = NULL;
+    for (int y = 0; y < actual->height; y++) {
+        for (int x = 0; x < actual->width; x++) {
+            if (pbm_get(actual, x, y) == pbm_get(golden, x, y)) continue;
+            count++;
+            if (x < x0) x0 = x;
+            if (y < y0) y0 = y;
+            if (x > x1) x1 = x;
+            if (y > y1) y1 = y;
+            if (diff_path) pbm_set(&diff, x, y, 1);
+        }
+    }
+
+    if (count > 0) {
+        fprintf(stderr, "%ld pixels differ in (%d,%d)-(%d,%d)\n", count, x0, y0, x1, y1);
+    }
+    if (diff_path) {
+        if (count > 0) pbm_write(diff_path, &diff);
+        pbm_free(&diff);
+    }
+    return count;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s <script> -o <out.pbm> [--golden <expected.pbm> [--diff <diff.pbm>] [--update]]\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *out_path = NULL, *golden_path = NULL, *diff_path = NULL;
+    bool update = false;
+    char line[LINE_MAX_LEN];
+    bool started = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            golden_path = argv[++i];
+        } else if (strcmp(argv[i], "--diff") == 0 && i + 1 < argc) {
+            diff_path = argv[++i];
+        } else if (strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else if (argv[i][0] != '-' && script_path == NULL) {
+            script_path = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (script_path == NULL || out_path == NULL || (update && golden_path == NULL)) usage(argv[0]);
+
+    const char *slash = strrchr(script_path, '/');
+    if (slash) snprintf(script_dir, sizeof(script_dir), "%.*s/", (int)(slash - script_path), script_path);
+
+    FILE *f = fopen(script_path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s\n", script_path);
+        return 2;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        run_line(line, &started);
+    }
+    fclose(f);
+    if (!started) fail("empty script", NULL);
+
+    pbm_image_t actual;
+    snapshot(&actual);
+    if (pbm_write(out_path, &actual) != 0) {
+        fprintf(stderr, "cannot write %s\n", out_path);
+        return 2;
+    }
+
+    int status = 0;
+    if (update) {
+        if (pbm_write(golden_path, &actual) != 0) {
+            fprintf(stderr, "cannot write %s\n", golden_path);
+            status = 2;
+        }
+    } else if (golden_path) {
+        pbm_image_t golden;
+        if (pbm_read(golden_path, &golden) != 0) {
+            fprintf(stderr, "cannot read golden image %s, create it with --update\n", golden_path);
+            status = 2;
+        } else {
+            if (compare(&actual, &golden, diff_path) != 0) status = 1;
+            pbm_free(&golden);
+        }
+    }
+
+    pbm_free(&actual);
+    return status;
+}
@@ -0,0 +1,562 @@
+/*
+ * Publishes region updates to many tags at a set rate over persistent
+ * connections, for capacity planning of the broker and server.
+ *
+ *   esl_loadgen [--broker mqtt://host:port] [--tags N] [--base-mac HEX] [--rate N] [--duration S]
+ *               [--connections N] [--region NAME:WxH]... [--payload NAME=FILE]... [--variants N]
+ *               [--acks] [--drain-s S] [--ramp STEP] [--step-s S] [--json] [-v]
+ *
+ * Updates go to esl/<base mac + n>/<region> with the sequence header of the
+ * web page, tags and regions in turn, at QoS 1. Payloads are rendered through
+ * the firmware's graphics code, a price or a name and number in the largest
+ * font that fits, cycling through --variants versions so consecutive updates
+ * differ; --payload publishes a recorded file instead. The default regions
+ * are those of the built-in layout.
+ *
+ * Publish-to-PUBACK latency measures the broker. With --acks, the tags'
+ * acknowledgements on esl/+/ack are matched by sequence number as well, and
+ * publish-to-ack latency covers the whole path up to the commit on the tag.
+ *
+ * --ramp raises the rate by STEP every --step-s seconds and stops at the
+ * first step the broker cannot sustain: fewer than 90% of the target
+ * publishes went out, or the PUBACK p99 grew tenfold over the first step.
+ */
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "epd_display.h"
+#include "epd_graphics.h"
+#include "esl/esl_ack.h"
+#include "esl/esl_ui.h"
+#include "esp_timer.h"
+#include "host_log.h"
+#include "latency_hist.h"
+#include "mqtt_lite.h"
+#include "region_payload.h"
+
+#define MAX_CONNECTIONS     64
+#define MAX_REGIONS         8
+#define MAX_VARIANTS        64
+#define CONNECT_TIMEOUT_MS  5000
+#define KEEPALIVE_S         60
+#define SEQ_RING            (1 << 20)   // Publishes awaiting a tag ack, indexed by sequence number
+#define MAX_LAG_US          100000      // Publishes further behind schedule than this are skipped, not bursted
+#define SATURATION_RATE     0.9         // Share of the target rate a step must reach
+#define SATURATION_P99      10          // PUBACK p99 growth over the first step that counts as saturated
+
+typedef struct {
+    char name[REGION_NAME_LEN];
+    int w;
+    int h;
+    int variant_count;
+    uint8_t *variants[MAX_VARIANTS];    // ESL_ACK_HEADER_LEN bytes left free in front of each
+    int len;                            // Payload length without the header
+} region_t;
+
+typedef struct {
+    struct esp_mqtt_client client;
+    int64_t *sent_us;                   // Publish time by packet ID, 0 once acknowledged
+} connection_t;
+
+typedef struct {
+    uint32_t seq;
+    int64_t sent_us;
+} seq_slot_t;
+
+typedef struct {
+    uint64_t published;
+    uint64_t publish_errors;
+    uint64_t skipped;                   // Behind schedule, not sent
+    uint64_t bytes;
+    uint64_t pubacks;
+    uint64_t acks;
+    uint64_t ack_results[ESL_ACK_SCHEDULED + 1];
+    latency_hist_t puback;
+    latency_hist_t ack;
+} load_stats_t;
+
+static const char *result_names[] = {
+    [ESL_ACK_APPLIED]   = "applied",
+    [ESL_ACK_UNCHANGED] = "unchanged",
+    [ESL_ACK_ACCEPTED]  = "accepted",
+    [ESL_ACK_REJECTED]  = "rejected",
+    [ESL_ACK_DROPPED]   = "dropped",
+    [ESL_ACK_SCHEDULED] = "scheduled",
+};
+
+static char host[128] = "localhost";
+static int port = 1883;
+static int tag_count = 100;
+static uint64_t base_mac = 0x0200000000ull;
+static double rate = 100;
+static int duration_s = 30;
+static int connection_count = 4;
+static int variant_count = 16;
+static bool want_acks;
+static int drain_s = 15;
+static double ramp;
+static int step_s = 10;
+static bool json;
+
+static region_t regions[MAX_REGIONS];
+static int region_count;
+static connection_t connections[MAX_CONNECTIONS];
+static struct esp_mqtt_client ack_client;
+static seq_slot_t *seq_ring;
+static uint32_t next_seq = 1;
+static load_stats_t total;
+static load_stats_t step;
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void on_puback(void *ctx, int msg_id)
+{
+    connection_t *conn = ctx;
+    int64_t sent = conn->sent_us[msg_id];
+    if (sent == 0) return;
+    conn->sent_us[msg_id] = 0;
+
+    uint64_t us = (uint64_t)(esp_timer_get_time() - sent);
+    latency_hist_add(&total.puback, us);
+    latency_hist_add(&step.puback, us);
+    total.pubacks++;
+    step.pubacks++;
+}
+
+// Acks are the firmware's fixed JSON, {"seq":N,"result":"...",...}
+static void on_ack(void *ctx, const char *topic, int topic_len, const uint8_t *data, int len, int msg_id)
+{
+    char text[128];
+    unsigned long seq;
+    char result[16];
+    (void)ctx; (void)topic; (void)topic_len; (void)msg_id;
+
+    snprintf(text, sizeof(text), "%.*s", len, (const char *)data);
+    if (sscanf(text, "{\"seq\":%lu,\"result\":\"%15[a-z]\"", &seq, result) != 2) return;
+
+    seq_slot_t *slot = &seq_ring[seq % SEQ_RING];
+    if (slot->seq != (uint32_t)seq || slot->sent_us == 0) return;
+    uint64_t us = (uint64_t)(esp_timer_get_time() - slot->sent_us);
+    slot->sent_us = 0;
+
+    latency_hist_add(&total.ack, us);
+    latency_hist_add(&step.ack, us);
+    total.acks++;
+    step.acks++;
+    for (int i = 0; i <= ESL_ACK_SCHEDULED; i++) {
+        if (strcmp(result, result_names[i]) == 0) {
+            total.ack_results[i]++;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Renders one variant of a region into the column-major payload epd_draw_bin_image() reads.
+ */
+static void render_variant(const region_t *region, int variant, uint8_t *out)
+{
+    static uint8_t scratch[EPD_BUF_SIZE];
+    char text[32];
+
+    if (strcmp(region->name, "price") == 0) {
+        snprintf(text, sizeof(text), "$%d.%02d", 1 + variant % 99, (variant * 37) % 100);
+    } else {
+        snprintf(text, sizeof(text), "%.12s %d", region->name, variant);
+    }
+
+    epd_set_buffer(scratch, EPD_WIDTH, EPD_HEIGHT, EPD_ROTATE_0, WHITE);
+    epd_clear_buffer(WHITE);
+    int size = region_fit_font((int)strlen(text), region->w, region->h);
+    if (size) {
+        int len = (int)strlen(text);
+        epd_draw_string((region->w - len * size / 2) / 2, (region->h - size) / 2, text, size, BLACK);
+    }
+
+    region_pack(region->w, region->h, out);
+}
+
+static region_t *find_region(const char *name)
+{
+    for (int i = 0; i < region_count; i++) {
+        if (strcmp(regions[i].name, name) == 0) return &regions[i];
+    }
+    return NULL;
+}
+
+static int add_region(const char *name, int w, int h)
+{
+    int len = region_payload_len(name, w, h);
+    if (region_count == MAX_REGIONS || len < 0) return -1;
+
+    region_t *region = &regions[region_count++];
+    snprintf(region->name, sizeof(region->name), "%s", name);
+    region->w = w;
+    region->h = h;
+    region->len = len;
+    return 0;
+}
+
+static int load_payload(const char *spec)
+{
+    char name[REGION_NAME_LEN];
+    const char *eq = strchr(spec, '=');
+    if (eq == NULL || eq - spec >= REGION_NAME_LEN) return -1;
+    snprintf(name, sizeof(name), "%.*s", (int)(eq - spec), spec);
+
+    region_t *region = find_region(name);
+    if (region == NULL || region->variant_count) return -1;
+
+    uint8_t *buf = malloc(ESL_ACK_HEADER_LEN + region->len + 1);
+    FILE *f = fopen(eq + 1, "rb");
+    if (buf == NULL || f == NULL) {
+        free(buf);
+        if (f) fclose(f);
+        return -1;
+    }
+    int len = (int)fread(buf + ESL_ACK_HEADER_LEN, 1, region->len + 1, f);
+    fclose(f);
+    if (len != region->len) {
+        fprintf(stderr, "%s is %d bytes, %s needs %d\n", eq + 1, len, name, region->len);
+        free(buf);
+        return -1;
+    }
+    region->variants[0] = buf;
+    region->variant_count = 1;
+    return 0;
+}
+
+static int connect_client(esp_mqtt_client_handle_t client, const char *role, int index)
+{
+    char client_id[48];
+    snprintf(client_id, sizeof(client_id), "esl-loadgen-%d-%s%d", (int)getpid(), role, index);
+    return mqtt_lite_connect(client, host, port, client_id, true, KEEPALIVE_S, CONNECT_TIMEOUT_MS) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Publishes the next update: tags in turn, each tag's regions in turn.
+ */
+static void publish_next(uint64_t n)
+{
+    char topic[64];
+    const region_t *region = &regions[n / tag_count % region_count];
+    uint64_t tag = n % tag_count;
+    connection_t *conn = &connections[tag % connection_count];
+
+    // Every tag sees the variants in order, so each update changes the region
+    uint8_t *payload = region->variants[(n / tag_count / region_count) % region->variant_count];
+    uint32_t seq = next_seq++;
+    uint8_t header[ESL_ACK_HEADER_LEN] = { 0xE5, 0x51, 1, 0, seq, seq >> 8, seq >> 16, seq >> 24 };
+    memcpy(payload, header, sizeof(header));
+
+    snprintf(topic, sizeof(topic), "esl/%012llx/%s", (unsigned long long)(base_mac + tag), region->name);
+    int64_t now = esp_timer_get_time();
+    int msg_id = esp_mqtt_client_publish(&conn->client, topic, (const char *)payload,
+                                         ESL_ACK_HEADER_LEN + region->len, 1, 0);
+    if (msg_id < 0) {
+        total.publish_errors++;
+        step.publish_errors++;
+        return;
+    }
+
+    conn->sent_us[msg_id] = now;
+    seq_ring[seq % SEQ_RING] = (seq_slot_t){ seq, now };
+    total.published++;
+    step.published++;
+    total.bytes += ESL_ACK_HEADER_LEN + region->len;
+    step.bytes += ESL_ACK_HEADER_LEN + region->len;
+}
+
+// Handles whatever the broker sent on any connection, waiting up to timeout_ms for the first packet
+static int poll_all(int timeout_ms)
+{
+    struct pollfd pfds[MAX_CONNECTIONS + 1];
+    esp_mqtt_client_handle_t clients[MAX_CONNECTIONS + 1];
+    int n = 0;
+
+    for (int i = 0; i < connection_count; i++) clients[n++] = &connections[i].client;
+    if (want_acks) clients[n++] = &ack_client;
+    for (int i = 0; i < n; i++) pfds[i] = (struct pollfd){ .fd = clients[i]->fd, .events = POLLIN };
+
+    if (poll(pfds, n, timeout_ms) < 0 && errno != EINTR) return -1;
+    for (int i = 0; i < n; i++) {
+        if (!pfds[i].revents) continue;
+        if (mqtt_lite_poll(clients[i], 0) < 0) {
+            fprintf(stderr, "broker closed connection %d\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void print_step(int index, double target, double elapsed_s)
+{
+    double achieved = step.published / elapsed_s;
+    if (json) {
+        printf("{\"step\":%d,\"target_rate\":%.1f,\"rate\":%.1f,\"kb_per_s\":%.1f,\"skipped\":%llu,"
+               "\"puback_p50_ms\":%.2f,\"puback_p99_ms\":%.2f,\"acks\":%llu,\"ack_p50_ms\":%.1f,\"ack_p99_ms\":%.1f}\n",
+               index, target, achieved, step.bytes / 1024.0 / elapsed_s, (unsigned long long)step.skipped,
+               latency_hist_percentile(&step.puback, 50) / 1000.0, latency_hist_percentile(&step.puback, 99) / 1000.0,
+               (unsigned long long)step.acks, latency_hist_percentile(&step.ack, 50) / 1000.0,
+               latency_hist_percentile(&step.ack, 99) / 1000.0);
+        return;
+    }
+    if (index == 0) {
+        printf("%5s %9s %9s %9s %9s %12s %12s", "step", "target/s", "sent/s", "KB/s", "skipped", "puback p50",
+               "puback p99");
+        printf(want_acks ? " %12s %12s\n" : "\n", "ack p50", "ack p99");
+    }
+    printf("%5d %9.1f %9.1f %9.1f %9llu %12.2f %12.2f", index, target, achieved, step.bytes / 1024.0 / elapsed_s,
+           (unsigned long long)step.skipped, latency_hist_percentile(&step.puback, 50) / 1000.0,
+           latency_hist_percentile(&step.puback, 99) / 1000.0);
+    if (want_acks) {
+        printf(" %12.1f %12.1f", latency_hist_percentile(&step.ack, 50) / 1000.0,
+               latency_hist_percentile(&step.ack, 99) / 1000.0);
+    }
+    printf("\n");
+}
+
+static void print_latency(const char *name, const latency_hist_t *hist)
+{
+    if (hist->count == 0) {
+        printf("%-16s none\n", name);
+        return;
+    }
+    printf("%-16s mean %.2f  p50 %.2f  p99 %.2f  p999 %.2f  max %.2f ms\n", name, latency_hist_mean(hist) / 1000.0,
+           latency_hist_percentile(hist, 50) / 1000.0, latency_hist_percentile(hist, 99) / 1000.0,
+           latency_hist_percentile(hist, 99.9) / 1000.0, hist->max_us / 1000.0);
+}
+
+static void print_summary(double elapsed_s, double saturated_at, double last_good)
+{
+    uint64_t unacked = total.published - total.acks;
+
+    if (json) {
+        printf("{\"published\":%llu,\"rate\":%.1f,\"errors\":%llu,\"skipped\":%llu,"
+               "\"puback_p50_ms\":%.2f,\"puback_p99_ms\":%.2f,\"puback_p999_ms\":%.2f",
+               (unsigned long long)total.published, total.published / elapsed_s,
+               (unsigned long long)total.publish_errors, (unsigned long long)total.skipped,
+               latency_hist_percentile(&total.puback, 50) / 1000.0, latency_hist_percentile(&total.puback, 99) / 1000.0,
+               latency_hist_percentile(&total.puback, 99.9) / 1000.0);
+        if (want_acks) {
+            printf(",\"acks\":%llu,\"unacked\":%llu,\"ack_p50_ms\":%.1f,\"ack_p99_ms\":%.1f,\"ack_p999_ms\":%.1f",
+                   (unsigned long long)total.acks, (unsigned long long)unacked,
+                   latency_hist_percentile(&total.ack, 50) / 1000.0, latency_hist_percentile(&total.ack, 99) / 1000.0,
+                   latency_hist_percentile(&total.ack, 99.9) / 1000.0);
+        }
+        if (ramp > 0) printf(",\"saturated_rate\":%.1f,\"sustained_rate\":%.1f", saturated_at, last_good);
+        printf("}\n");
+        return;
+    }
+
+    printf("published        %llu (%.1f/s), %.1f KB/s, %llu errors, %llu skipped behind schedule\n",
+           (unsigned long long)total.published, total.published / elapsed_s, total.bytes / 1024.0 / elapsed_s,
+           (unsigned long long)total.publish_errors, (unsigned long long)total.skipped);
+    print_latency("publish-puback", &total.puback);
+    if (want_acks) {
+        printf("acks             %llu, %llu missing:", (unsigned long long)total.acks, (unsigned long long)unacked);
+        for (int i = 0; i <= ESL_ACK_SCHEDULED; i++) {
+            if (total.ack_results[i]) printf(" %s %llu", result_names[i], (unsigned long long)total.ack_results[i]);
+        }
+        printf("\n");
+        print_latency("publish-ack", &total.ack);
+    }
+    if (ramp > 0) {
+        if (saturated_at > 0) {
+            printf("saturation       at %.1f/s target, last sustained %.1f/s\n", saturated_at, last_good);
+        } else {
+            printf("saturation       not reached, sustained %.1f/s\n", last_good);
+        }
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--broker mqtt://host:port] [--tags N] [--base-mac HEX] [--rate N] [--duration S]\n"
+            "          [--connections N] [--region NAME:WxH]... [--payload NAME=FILE]... [--variants N]\n"
+            "          [--acks] [--drain-s S] [--ramp STEP] [--step-s S] [--json] [-v]\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *payload_specs[MAX_REGIONS];
+    int payload_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "-v") == 0) {
+            host_log_level++;
+            continue;
+        } else if (strcmp(arg, "--acks") == 0) {
+            want_acks = true;
+            continue;
+        } else if (strcmp(arg, "--json") == 0) {
+            json = true;
+            continue;
+        }
+
+        const char *val = i + 1 < argc ? argv[++i] : NULL;
+        if (val == NULL) usage(argv[0]);
+        if (strcmp(arg, "--broker") == 0) {
+            if (mqtt_lite_parse_broker(val, host, sizeof(host), &port) != 0) usage(argv[0]);
+        } else if (strcmp(arg, "--tags") == 0) {
+            tag_count = atoi(val);
+        } else if (strcmp(arg, "--base-mac") == 0) {
+            base_mac = strtoull(val, NULL, 16);
+        } else if (strcmp(arg, "--rate") == 0) {
+            rate = atof(val);
+        } else if (strcmp(arg, "--duration") == 0) {
+            duration_s = atoi(val);
+        } else if (strcmp(arg, "--connections") == 0) {
+            connection_count = atoi(val);
+        } else if (strcmp(arg, "--region") == 0) {
+            char name[REGION_NAME_LEN];
+            int w, h;
+            if (sscanf(val, "%15[^:]:%dx%d", name, &w, &h) != 3 || add_region(name, w, h) != 0) usage(argv[0]);
+        } else if (strcmp(arg, "--payload") == 0) {
+            if (payload_count == MAX_REGIONS) usage(argv[0]);
+            payload_specs[payload_count++] = val;
+        } else if (strcmp(arg, "--variants") == 0) {
+            variant_count = atoi(val);
+        } else if (strcmp(arg, "--drain-s") == 0) {
+            drain_s = atoi(val);
+        } else if (strcmp(arg, "--ramp") == 0) {
+            ramp = atof(val);
+        } else if (strcmp(arg, "--step-s") == 0) {
+            step_s = atoi(val);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (tag_count <= 0 || rate <= 0 || duration_s <= 0 || connection_count <= 0 ||
+        connection_count > MAX_CONNECTIONS || variant_count <= 0 || variant_count > MAX_VARIANTS ||
+        drain_s < 0 || ramp < 0 || step_s <= 0) {
+        usage(argv[0]);
+    }
+
+    // The built-in layout unless regions are given
+    if (region_count == 0) {
+        add_region("price", PRICE_W, PRICE_H);
+        add_region("description", DESC_W, DESC_H);
+    }
+    for (int i = 0; i < payload_count; i++) {
+        if (load_payload(payload_specs[i]) != 0) {
+            fprintf(stderr, "cannot load payload %s\n", payload_specs[i]);
+            return 2;
+        }
+    }
+    for (int i = 0; i < region_count; i++) {
+        region_t *region = &regions[i];
+        if (region->variant_count) continue;
+        for (int v = 0; v < variant_count; v++) {
+            region->variants[v] = malloc(ESL_ACK_HEADER_LEN + region->len);
+            if (region->variants[v] == NULL) return 2;
+            render_variant(region, v, region->variants[v] + ESL_ACK_HEADER_LEN);
+        }
+        region->variant_count = variant_count;
+    }
+
+    seq_ring = calloc(SEQ_RING, sizeof(seq_slot_t));
+    if (seq_ring == NULL) return 2;
+
+    if (want_acks) {
+        mqtt_lite_init(&ack_client, on_ack, NULL);
+        if (connect_client(&ack_client, "ack", 0) != 0) return 1;
+        esp_mqtt_client_subscribe(&ack_client, "esl/+/ack", 1);
+    }
+    for (int i = 0; i < connection_count; i++) {
+        connection_t *conn = &connections[i];
+        mqtt_lite_init(&conn->client, NULL, conn);
+        conn->client.on_puback = on_puback;
+        conn->sent_us = calloc(65536, sizeof(int64_t));
+        if (conn->sent_us == NULL || connect_client(&conn->client, "pub", i) != 0) return 1;
+    }
+
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + duration_s * 1000000LL;
+    int64_t step_start_us = start_us;
+    int64_t step_len_us = ramp > 0 ? step_s * 1000000LL : end_us - start_us;
+    double next_us = start_us;       // Fractional, so the average rate is exact
+    double target = rate, baseline_p99 = 0, saturated_at = 0, last_good = 0;
+    int step_index = 0;
+    uint64_t n = 0;
+
+    while (!stop_requested) {
+        int64_t now = esp_timer_get_time();
+
+        if (now >= step_start_us + step_len_us || now >= end_us) {
+            double elapsed_s = (now - step_start_us) / 1e6;
+            print_step(step_index, target, elapsed_s);
+            fflush(stdout);
+
+            uint64_t p99 = latency_hist_percentile(&step.puback, 99);
+            if (step_index == 0) baseline_p99 = p99;
+            bool saturated = step.published < SATURATION_RATE * target * elapsed_s ||
+                             (step_index > 0 && p99 > SATURATION_P99 * baseline_p99);
+            if (ramp > 0 && saturated) {
+                saturated_at = target;
+                break;
+            }
+            last_good = step.published / elapsed_s;
+            if (now >= end_us) break;
+
+            memset(&step, 0, sizeof(step));
+            step_index++;
+            step_start_us = now;
+            target += ramp;
+        }
+
+        if (now >= next_us) {
+            if (now - next_us > MAX_LAG_US) {
+                uint64_t behind = (uint64_t)((now - next_us) * target / 1e6);
+                total.skipped += behind;
+                step.skipped += behind;
+                next_us = now;
+            }
+            publish_next(n++);
+            next_us += 1e6 / target;
+
+            // Behind schedule this path runs back to back, so read PUBACKs and acks as we go
+            if (poll_all(0) != 0) break;
+            continue;
+        }
+
+        int wait_ms = (int)((next_us - now) / 1000);
+        if (poll_all(wait_ms) != 0) break;
+    }
+
+    double elapsed_s = (esp_timer_get_time() - start_us) / 1e6;
+
+    // Tags ack after their coalescing window and refresh, so keep listening for a while
+    int64_t drain_end_us = esp_timer_get_time() + (want_acks ? drain_s : 1) * 1000000LL;
+    while (esp_timer_get_time() < drain_end_us) {
+        bool done = total.pubacks == total.published && (!want_acks || total.acks == total.published);
+        if (done || poll_all(100) != 0) break;
+    }
+
+    print_summary(elapsed_s, saturated_at, last_good);
+
+    for (int i = 0; i < connection_count; i++) {
+        mqtt_lite_free(&connections[i].client);
+        free(connections[i].sent_us);
+    }
+    if (want_acks) mqtt_lite_free(&ack_client);
+    return 0;
+}
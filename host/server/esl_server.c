@@ -0,0 +1,812 @@
+/*
+ * Renders tag regions from product data and publishes them to the tags, the
+ * native counterpart of the web page's html2canvas and canvasToBin path.
+ *
+ *   esl_server [--broker mqtt://host:port] [--input FILE] [--layout FILE] [--workers N]
+ *              [--window N] [--write DIR] [--dry-run] [--repeat N] [-v]
+ *
+ * Input is one product per line, tab separated, as the editor's fields:
+ *
+ *   <tag id> TAB <price> TAB <line 1> TAB <line 2> TAB <line 3>
+ *
+ * Blank lines and lines starting with # are skipped, **text** is bold. The
+ * input is stdin unless --input is given; a FIFO is reopened at end of file,
+ * so a back end can write batches into it for as long as the server runs.
+ *
+ * A pool of workers renders the regions of the layout through the firmware's
+ * graphics code, each worker into its own framebuffer, and packs them into
+ * the column-major 1-bpp payload epd_draw_bin_image() reads. One publisher
+ * thread owns the MQTT connection: updates go to esl/<tag id>/<region> at
+ * QoS 1 with the sequence header of the web page, at most --window of them
+ * unacknowledged by the broker, and those are sent again after a reconnect.
+ *
+ * --write puts the payloads into DIR/<tag id>-<region>.bin instead of
+ * publishing, --dry-run only renders. --repeat replays the input N times,
+ * for measuring the render rate.
+ */
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "epd_display.h"
+#include "epd_graphics.h"
+#include "esl/esl_ack.h"
+#include "esl/esl_ui.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host_log.h"
+#include "latency_hist.h"
+#include "mqtt_lite.h"
+#include "region_payload.h"
+
+#define MAX_WORKERS         64
+#define MAX_REGIONS         8
+#define TAG_ID_LEN          32
+#define LINE_COUNT          3
+#define LINE_LEN            64      // The editor allows 20 characters plus the ** markers
+#define TOPIC_LEN           (4 + TAG_ID_LEN + REGION_NAME_LEN)  // esl/<tag id>/<region>
+#define QUEUE_DEPTH         1024    // Products waiting for a worker, and payloads for the publisher
+#define CONNECT_TIMEOUT_MS  5000
+#define KEEPALIVE_S         60
+#define RECONNECT_MAX_S     30
+#define DRAIN_MS            10000   // Longest wait for the broker to acknowledge the last publishes at exit
+#define LINE_PITCH          30      // Description line height of the editor's stylesheet
+#define PRICE_FONT          48
+#define PRICE_DECIMAL_FONT  24
+
+typedef enum {
+    REGION_PRICE,
+    REGION_DESCRIPTION,
+} region_kind_t;
+
+typedef struct {
+    char name[REGION_NAME_LEN];
+    region_kind_t kind;
+    int w;
+    int h;
+    int len;                        // Payload length without the header
+} region_t;
+
+typedef struct {
+    char tag_id[TAG_ID_LEN];
+    char price[16];
+    char lines[LINE_COUNT][LINE_LEN];
+} product_t;
+
+typedef struct message {
+    struct message *next;           // Next unacknowledged message, in publish order
+    int msg_id;                     // Packet ID of the latest send
+    char topic[TOPIC_LEN];
+    int len;                        // Header and payload
+    uint8_t data[];                 // ESL_ACK_HEADER_LEN bytes of header, set by the publisher, then the payload
+} message_t;
+
+// Bounded FIFO of pointers between threads
+typedef struct {
+    void **items;
+    int capacity;
+    int head;
+    int count;
+    bool closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} queue_t;
+
+typedef struct {
+    pthread_t thread;
+    latency_hist_t render;          // Per product, merged at exit
+} worker_t;
+
+static const char *TAG_SERVER = "SERVER";
+
+static char host[128] = "localhost";
+static int port = 1883;
+static const char *input_path = "-";
+static const char *write_dir;
+static bool dry_run;
+static int worker_count;
+static int window = 256;
+static int repeat = 1;
+
+static region_t regions[MAX_REGIONS];
+static int region_count;
+static queue_t jobs;
+static queue_t outbox;
+static worker_t workers[MAX_WORKERS];
+static volatile sig_atomic_t stop_requested;
+
+// Publisher state, owned by the publisher thread
+static struct esp_mqtt_client client;
+static message_t *unacked_head;     // Sent and not acknowledged by the broker yet, oldest first
+static message_t *unacked_tail;
+static int inflight_count;
+static uint32_t next_seq;
+
+static atomic_ullong products_read;
+static atomic_ullong products_rejected;
+static atomic_ullong regions_rendered;
+static atomic_ullong regions_written;
+static uint64_t published;
+static uint64_t pubacks;
+static uint64_t publish_bytes;
+static uint64_t reconnects;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static int queue_init(queue_t *queue, int capacity)
+{
+    queue->items = calloc(capacity, sizeof(void *));
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = false;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    return queue->items ? 0 : -1;
+}
+
+// Blocks while the queue is full, so a slow stage holds back the one before it
+static int queue_push(queue_t *queue, void *item)
+{
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity && !queue->closed) pthread_cond_wait(&queue->not_full, &queue->lock);
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+/**
+ * @brief Takes the oldest item, waiting up to timeout_ms for one (-1 waits for ever).
+ *
+ * @return 1 with an item, 0 on timeout, -1 once the queue is closed and empty
+ */
+static int queue_pop(queue_t *queue, void **item, int timeout_ms)
+{
+    struct timespec deadline;
+    int result = 1;
+
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&queue->not_empty, &queue->lock);
+        } else if (pthread_cond_timedwait(&queue->not_empty, &queue->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (queue->count > 0) {
+        *item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    } else {
+        result = queue->closed ? -1 : 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return result;
+}
+
+// Consumers drain what is queued, producers are turned away
+static void queue_close(queue_t *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Visible length of editor text, without the ** bold markers
+static int text_length(const char *text)
+{
+    int len = 0;
+    for (const char *p = text; *p; p++) {
+        if (p[0] == '*' && p[1] == '*') {
+            p++;
+        } else {
+            len++;
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief Draws editor text, striking the characters between ** markers twice, one pixel apart, for bold.
+ */
+static void draw_rich_text(int x, int y, const char *text, int size, int w)
+{
+    bool bold = false;
+    int advance = size / 2;
+
+    for (const char *p = text; *p; p++) {
+        if (p[0] == '*' && p[1] == '*') {
+            bold = !bold;
+            p++;
+            continue;
+        }
+        if (x + advance > w) break;
+        epd_draw_char(x, y, (uint8_t)*p, size, BLACK);
+        if (bold) epd_draw_char(x + 1, y, (uint8_t)*p, size, BLACK);
+        x += advance;
+    }
+}
+
+/**
+ * @brief Draws the price as the editor shows it: dollars large, cents in the small font at the top right.
+ *
+ * Falls back to the whole price in one font when that does not fit, and to the
+ * text as given when it is not a number.
+ */
+static void render_price(const region_t *region, const char *price)
+{
+    char whole[24], cents[4], text[32];
+    char *end;
+    double value = strtod(price, &end);
+
+    if (end == price || *end != '\0' || !isfinite(value) || value < 0 || value >= 1e9) {
+        snprintf(text, sizeof(text), "%s", price);
+    } else {
+        long long total = llround(value * 100);
+        snprintf(whole, sizeof(whole), "$%lld", total / 100);
+        snprintf(cents, sizeof(cents), "%02lld", total % 100);
+
+        int whole_w = (int)strlen(whole) * PRICE_FONT / 2;
+        int width = whole_w + 2 * PRICE_DECIMAL_FONT / 2;
+        if (width <= region->w && PRICE_FONT <= region->h) {
+            int x = (region->w - width) / 2;
+            int y = (region->h - PRICE_FONT) / 2;
+            epd_draw_string(x, y, whole, PRICE_FONT, BLACK);
+            epd_draw_string(x + whole_w, y, cents, PRICE_DECIMAL_FONT, BLACK);
+            return;
+        }
+        snprintf(text, sizeof(text), "%s.%s", whole, cents);
+    }
+
+    int len = (int)strlen(text);
+    int size = region_fit_font(len, region->w, region->h);
+    if (size) epd_draw_string((region->w - len * size / 2) / 2, (region->h - size) / 2, text, size, BLACK);
+}
+
+/**
+ * @brief Draws the three description lines left aligned at the editor's line pitch, each in the largest font that fits.
+ */
+static void render_description(const region_t *region, const product_t *product)
+{
+    int pitch = region->h >= LINE_COUNT * LINE_PITCH ? LINE_PITCH : region->h / LINE_COUNT;
+    int top = (region->h - LINE_COUNT * pitch) / 2;
+
+    for (int i = 0; i < LINE_COUNT; i++) {
+        const char *line = product->lines[i];
+        if (line[0] == '\0') continue;
+        // Bold strikes one pixel to the right of the last glyph
+        int size = region_fit_font(text_length(line), region->w - 1, pitch);
+        if (size == 0) size = 8;
+        draw_rich_text(0, top + i * pitch + (pitch - size) / 2, line, size, region->w);
+    }
+}
+
+static void write_payload(const product_t *product, const region_t *region, const message_t *msg)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s-%s.bin", write_dir, product->tag_id, region->name);
+    FILE *f = fopen(path, "wb");
+    if (f == NULL || fwrite(msg->data + ESL_ACK_HEADER_LEN, 1, region->len, f) != (size_t)region->len) {
+        ESP_LOGW(TAG_SERVER, "Cannot write %s", path);
+    } else {
+        atomic_fetch_add(&regions_written, 1);
+    }
+    if (f) fclose(f);
+}
+
+/**
+ * @brief Worker thread: renders every region of each product and hands the payloads to the publisher.
+ */
+static void *worker_main(void *arg)
+{
+    static _Thread_local uint8_t framebuffer[EPD_BUF_SIZE];
+    worker_t *worker = arg;
+    void *item;
+
+    // epd_fb is per thread in this build, so every worker draws into its own buffer
+    epd_set_buffer(framebuffer, EPD_WIDTH, EPD_HEIGHT, EPD_ROTATE_0, WHITE);
+
+    while (queue_pop(&jobs, &item, -1) > 0) {
+        product_t *product = item;
+        message_t *rendered[MAX_REGIONS];
+        int rendered_count = 0;
+        int64_t start = esp_timer_get_time();
+
+        for (int i = 0; i < region_count; i++) {
+            const region_t *region = &regions[i];
+            message_t *msg = malloc(sizeof(message_t) + ESL_ACK_HEADER_LEN + region->len);
+            if (msg == NULL) {
+                ESP_LOGE(TAG_SERVER, "Out of memory rendering %s", product->tag_id);
+                break;
+            }
+            int n = snprintf(msg->topic, sizeof(msg->topic), "esl/%s/%s", product->tag_id, region->name);
+            if (n < 0 || n >= (int)sizeof(msg->topic)) {
+                ESP_LOGW(TAG_SERVER, "Topic for %s/%s is too long, skipping it", product->tag_id, region->name);
+                free(msg);
+                continue;
+            }
+
+            epd_clear_buffer_region(0, 0, region->w, region->h, WHITE);
+            if (region->kind == REGION_PRICE) {
+                render_price(region, product->price);
+            } else {
+                render_description(region, product);
+            }
+            region_pack(region->w, region->h, msg->data + ESL_ACK_HEADER_LEN);
+            atomic_fetch_add(&regions_rendered, 1);
+
+            msg->len = ESL_ACK_HEADER_LEN + region->len;
+            if (write_dir) write_payload(product, region, msg);
+            rendered[rendered_count++] = msg;
+        }
+
+        // Stopped before the push, which blocks while the publisher is behind
+        latency_hist_add(&worker->render, (uint64_t)(esp_timer_get_time() - start));
+
+        for (int i = 0; i < rendered_count; i++) {
+            message_t *msg = rendered[i];
+            if (write_dir || dry_run || queue_push(&outbox, msg) != 0) free(msg);
+        }
+        free(product);
+    }
+    return NULL;
+}
+
+// The broker acknowledges in publish order, so the match is nearly always the oldest message
+static void on_puback(void *ctx, int msg_id)
+{
+    (void)ctx;
+    message_t *prev = NULL;
+    message_t *msg = unacked_head;
+    while (msg && msg->msg_id != msg_id) {
+        prev = msg;
+        msg = msg->next;
+    }
+    if (msg == NULL) return;
+
+    if (prev) {
+        prev->next = msg->next;
+    } else {
+        unacked_head = msg->next;
+    }
+    if (unacked_tail == msg) unacked_tail = prev;
+    inflight_count--;
+    pubacks++;
+    free(msg);
+}
+
+// Numbers an update once, so a copy sent again after a reconnect carries the same sequence
+static void stamp_sequence(message_t *msg)
+{
+    uint32_t seq = next_seq++;
+    uint8_t header[ESL_ACK_HEADER_LEN] = { 0xE5, 0x51, 1, 0, seq, seq >> 8, seq >> 16, seq >> 24 };
+    memcpy(msg->data, header, sizeof(header));
+}
+
+static int publish_message(message_t *msg)
+{
+    int msg_id = esp_mqtt_client_publish(&client, msg->topic, (const char *)msg->data, msg->len, 1, 0);
+    if (msg_id < 0) return -1;
+    msg->msg_id = msg_id;
+    msg->next = NULL;
+    if (unacked_tail) {
+        unacked_tail->next = msg;
+    } else {
+        unacked_head = msg;
+    }
+    unacked_tail = msg;
+    inflight_count++;
+    published++;
+    publish_bytes += msg->len;
+    return 0;
+}
+
+/**
+ * @brief Connects, retrying with backoff, then sends again whatever the broker had not acknowledged.
+ */
+static int connect_broker(void)
+{
+    char client_id[48];
+    int backoff_s = 1;
+
+    snprintf(client_id, sizeof(client_id), "esl-server-%d", (int)getpid());
+    while (!stop_requested) {
+        if (mqtt_lite_connect(&client, host, port, client_id, true, KEEPALIVE_S, CONNECT_TIMEOUT_MS) >= 0) break;
+        ESP_LOGW(TAG_SERVER, "Broker %s:%d unreachable, retrying in %d s", host, port, backoff_s);
+        sleep(backoff_s);
+        backoff_s = backoff_s * 2 > RECONNECT_MAX_S ? RECONNECT_MAX_S : backoff_s * 2;
+    }
+    if (stop_requested) return -1;
+    ESP_LOGI(TAG_SERVER, "Connected to %s:%d", host, port);
+
+    // The clean session dropped whatever the broker held, so send everything unacknowledged
+    // again, in publish order, each with a packet ID of this connection
+    message_t *pending = unacked_head;
+    int count = inflight_count;
+    unacked_head = unacked_tail = NULL;
+    inflight_count = 0;
+
+    while (pending) {
+        message_t *msg = pending;
+        pending = msg->next;
+        if (publish_message(msg) != 0) {
+            // Keep the rest behind what went out, for the next connection
+            msg->next = pending;
+            if (unacked_tail) {
+                unacked_tail->next = msg;
+            } else {
+                unacked_head = msg;
+            }
+            for (unacked_tail = msg; unacked_tail->next; unacked_tail = unacked_tail->next) {
+                inflight_count++;
+            }
+            inflight_count++;
+            return -1;
+        }
+    }
+    if (count) ESP_LOGI(TAG_SERVER, "Sent %d unacknowledged update(s) again", count);
+    return 0;
+}
+
+static int reconnect_broker(void)
+{
+    ESP_LOGW(TAG_SERVER, "Connection lost, %d update(s) unacknowledged", inflight_count);
+    mqtt_lite_disconnect(&client);
+    reconnects++;
+    while (!stop_requested) {
+        if (connect_broker() == 0) return 0;
+        mqtt_lite_disconnect(&client);
+    }
+    return -1;
+}
+
+/**
+ * @brief Publisher thread: the only user of the MQTT connection.
+ */
+static void *publisher_main(void *arg)
+{
+    void *item;
+    (void)arg;
+
+    if (connect_broker() != 0) {
+        queue_close(&outbox);
+        return NULL;
+    }
+
+    for (;;) {
+        if (mqtt_lite_poll(&client, 0) < 0 && reconnect_broker() != 0) break;
+        if (inflight_count >= window) {
+            // Window full: wait for the broker instead of queueing on the socket
+            if (mqtt_lite_poll(&client, 100) < 0 && reconnect_broker() != 0) break;
+            continue;
+        }
+
+        int result = queue_pop(&outbox, &item, 1000);
+        if (result < 0) break;
+        if (result == 0) continue;
+        message_t *msg = item;
+        stamp_sequence(msg);
+        while (publish_message(msg) != 0) {
+            if (reconnect_broker() != 0) {
+                free(msg);
+                goto out;
+            }
+        }
+    }
+
+    int64_t deadline = esp_timer_get_time() + DRAIN_MS * 1000LL;
+    while (inflight_count > 0 && !stop_requested && esp_timer_get_time() < deadline) {
+        if (mqtt_lite_poll(&client, 100) < 0) break;
+    }
+out:
+    if (inflight_count) ESP_LOGW(TAG_SERVER, "%d update(s) not acknowledged by the broker", inflight_count);
+    mqtt_lite_disconnect(&client);
+    // Workers stop handing over payloads once nobody publishes them
+    queue_close(&outbox);
+    return NULL;
+}
+
+// Topic levels cannot hold MQTT wildcards or separators
+static bool valid_tag_id(const char *id)
+{
+    return id[0] != '\0' && strlen(id) < TAG_ID_LEN && strpbrk(id, "/+#") == NULL;
+}
+
+/**
+ * @brief Splits a tab-separated input line into a product.
+ *
+ * @return The product, or NULL for a blank or comment line, or one that is malformed
+ */
+static product_t *parse_product(char *line)
+{
+    char *fields[2 + LINE_COUNT] = { 0 };
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#') return NULL;
+    for (char *p = line; n < 2 + LINE_COUNT; n++) {
+        fields[n] = p;
+        p = strchr(p, '\t');
+        if (p == NULL) {
+            n++;
+            break;
+        }
+        *p++ = '\0';
+    }
+
+    if (!valid_tag_id(fields[0])) {
+        ESP_LOGW(TAG_SERVER, "Ignoring product with tag id '%s'", fields[0]);
+        atomic_fetch_add(&products_rejected, 1);
+        return NULL;
+    }
+    product_t *product = calloc(1, sizeof(*product));
+    if (product == NULL) return NULL;
+    snprintf(product->tag_id, sizeof(product->tag_id), "%s", fields[0]);
+    snprintf(product->price, sizeof(product->price), "%s", fields[1] ? fields[1] : "");
+    for (int i = 0; i < LINE_COUNT; i++) {
+        snprintf(product->lines[i], LINE_LEN, "%s", fields[2 + i] ? fields[2 + i] : "");
+    }
+    return product;
+}
+
+static int submit(product_t *product)
+{
+    atomic_fetch_add(&products_read, 1);
+    if (queue_push(&jobs, product) != 0) {
+        free(product);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Feeds the input to the workers, reopening a FIFO at end of file until asked to stop.
+ */
+static void read_input(void)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    struct stat st;
+    bool fifo = strcmp(input_path, "-") != 0 && stat(input_path, &st) == 0 && S_ISFIFO(st.st_mode);
+    char **saved = NULL;        // Input lines kept for --repeat
+    size_t saved_count = 0;
+
+    do {
+        FILE *f = strcmp(input_path, "-") == 0 ? stdin : fopen(input_path, "r");
+        if (f == NULL) {
+            // Opening a FIFO waits for a writer, a stop interrupts it
+            if (errno != EINTR) ESP_LOGE(TAG_SERVER, "Cannot open %s: %s", input_path, strerror(errno));
+            break;
+        }
+        unsigned long long before = atomic_load(&products_read);
+        while (!stop_requested && getline(&line, &cap, f) >= 0) {
+            if (repeat > 1) {
+                char **grown = realloc(saved, (saved_count + 1) * sizeof(char *));
+                if (grown == NULL || (grown[saved_count] = strdup(line)) == NULL) break;
+                saved = grown;
+                saved_count++;
+            }
+            product_t *product = parse_product(line);
+            if (product && submit(product) != 0) break;
+        }
+        if (f != stdin) fclose(f);
+        if (fifo) ESP_LOGI(TAG_SERVER, "Batch of %llu product(s) queued", atomic_load(&products_read) - before);
+    } while (fifo && !stop_requested);
+
+    for (int r = 1; r < repeat && !stop_requested; r++) {
+        for (size_t i = 0; i < saved_count && !stop_requested; i++) {
+            snprintf(line, cap, "%s", saved[i]);
+            product_t *product = parse_product(line);
+            if (product && submit(product) != 0) break;
+        }
+    }
+
+    for (size_t i = 0; i < saved_count; i++) free(saved[i]);
+    free(saved);
+    free(line);
+}
+
+static int add_region(const char *name, int w, int h)
+{
+    region_kind_t kind;
+    if (strcmp(name, "price") == 0) {
+        kind = REGION_PRICE;
+    } else if (strcmp(name, "description") == 0) {
+        kind = REGION_DESCRIPTION;
+    } else {
+        ESP_LOGW(TAG_SERVER, "No product field for region %s, skipping it", name);
+        return 0;
+    }
+    int len = region_payload_len(name, w, h);
+    if (region_count == MAX_REGIONS || len < 0) return -1;
+
+    region_t *region = &regions[region_count++];
+    snprintf(region->name, sizeof(region->name), "%s", name);
+    region->kind = kind;
+    region->w = w;
+    region->h = h;
+    region->len = len;
+    return 0;
+}
+
+/**
+ * @brief Reads the regions of a layout file of the web page, { "name": ..., "x": ..., "y": ..., "w": ..., "h": ... } each.
+ */
+static int load_layout(const char *path)
+{
+    char text[8192];
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return -1;
+    size_t len = fread(text, 1, sizeof(text) - 1, f);
+    fclose(f);
+    text[len] = '\0';
+
+    for (const char *p = strstr(text, "\"name\""); p; p = strstr(p + 1, "\"name\"")) {
+        char name[REGION_NAME_LEN];
+        int x, y, w, h;
+        if (sscanf(p, "\"name\" : \"%15[^\"]\" , \"x\" : %d , \"y\" : %d , \"w\" : %d , \"h\" : %d", name, &x, &y,
+                   &w, &h) != 5 || add_region(name, w, h) != 0) {
+            return -1;
+        }
+    }
+    return region_count ? 0 : -1;
+}
+
+static void print_summary(double elapsed_s)
+{
+    latency_hist_t render = { 0 };
+    for (int i = 0; i < worker_count; i++) latency_hist_merge(&render, &workers[i].render);
+    unsigned long long products = atomic_load(&products_read);
+
+    printf("rendered         %llu product(s), %llu region(s) in %.2f s with %d worker(s): %.1f products/s\n",
+           products, (unsigned long long)atomic_load(&regions_rendered), elapsed_s, worker_count,
+           products / elapsed_s);
+    if (render.count) {
+        printf("render           mean %.3f  p50 %.3f  p99 %.3f  max %.3f ms per product\n",
+               latency_hist_mean(&render) / 1000.0, latency_hist_percentile(&render, 50) / 1000.0,
+               latency_hist_percentile(&render, 99) / 1000.0, render.max_us / 1000.0);
+    }
+    if (atomic_load(&products_rejected)) {
+        printf("rejected         %llu line(s)\n", (unsigned long long)atomic_load(&products_rejected));
+    }
+    if (write_dir) printf("written          %llu file(s) to %s\n", (unsigned long long)atomic_load(&regions_written),
+                          write_dir);
+    if (!write_dir && !dry_run) {
+        printf("published        %llu update(s), %.1f KB, %llu acknowledged, %llu reconnect(s)\n",
+               (unsigned long long)published, publish_bytes / 1024.0, (unsigned long long)pubacks,
+               (unsigned long long)reconnects);
+    }
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [--broker mqtt://host:port] [--input FILE] [--layout FILE] [--workers N]\n"
+            "          [--window N] [--write DIR] [--dry-run] [--repeat N] [-v]\n",
+            prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *layout_path = NULL;
+    pthread_t publisher;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "-v") == 0) {
+            host_log_level++;
+            continue;
+        } else if (strcmp(arg, "--dry-run") == 0) {
+            dry_run = true;
+            continue;
+        }
+
+        const char *val = i + 1 < argc ? argv[++i] : NULL;
+        if (val == NULL) usage(argv[0]);
+        if (strcmp(arg, "--broker") == 0) {
+            if (mqtt_lite_parse_broker(val, host, sizeof(host), &port) != 0) usage(argv[0]);
+        } else if (strcmp(arg, "--input") == 0) {
+            input_path = val;
+        } else if (strcmp(arg, "--layout") == 0) {
+            layout_path = val;
+        } else if (strcmp(arg, "--workers") == 0) {
+            worker_count = atoi(val);
+        } else if (strcmp(arg, "--window") == 0) {
+            window = atoi(val);
+        } else if (strcmp(arg, "--write") == 0) {
+            write_dir = val;
+        } else if (strcmp(arg, "--repeat") == 0) {
+            repeat = atoi(val);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (worker_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cpus < 1 ? 1 : cpus > MAX_WORKERS ? MAX_WORKERS : (int)cpus;
+    }
+    if (worker_count < 0 || worker_count > MAX_WORKERS || window <= 0 || window > 4096 || repeat <= 0) {
+        usage(argv[0]);
+    }
+
+    // The built-in layout unless a layout file is given
+    if (layout_path) {
+        if (load_layout(layout_path) != 0) {
+            fprintf(stderr, "cannot load layout %s\n", layout_path);
+            return 2;
+        }
+    } else {
+        add_region("price", PRICE_W, PRICE_H);
+        add_region("description", DESC_W, DESC_H);
+    }
+
+    // Without SA_RESTART, so a signal interrupts a read from an idle FIFO
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (queue_init(&jobs, QUEUE_DEPTH) != 0 || queue_init(&outbox, QUEUE_DEPTH) != 0) return 2;
+    bool publishing = !write_dir && !dry_run;
+    if (publishing) {
+        // Sequence numbers continue across restarts, as the web page's do
+        next_seq = (uint32_t)time(NULL);
+        mqtt_lite_init(&client, NULL, NULL);
+        client.on_puback = on_puback;
+        if (pthread_create(&publisher, NULL, publisher_main, NULL) != 0) return 2;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < worker_count; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) return 2;
+    }
+
+    read_input();
+
+    queue_close(&jobs);
+    for (int i = 0; i < worker_count; i++) pthread_join(workers[i].thread, NULL);
+    double elapsed_s = (esp_timer_get_time() - start_us) / 1e6;
+    queue_close(&outbox);
+    if (publishing) {
+        pthread_join(publisher, NULL);
+        // Rendered, but not handed to the broker before a stop
+        void *item;
+        while (queue_pop(&outbox, &item, 0) > 0) free(item);
+        mqtt_lite_free(&client);
+    }
+
+    print_summary(elapsed_s);
+    return 0;
+}
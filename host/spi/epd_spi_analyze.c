@@ -0,0 +1,322 @@
+/*
+ * Summarizes a panel SPI trace recorded with CONFIG_ESL_SPI_TRACE and
+ * optionally replays it against the host panel model.
+ *
+ *   epd_spi_analyze [trace.txt|-] [--replay <prefix>] [--clock <hz>]
+ *
+ * The trace is the text the tag prints on the console or publishes on
+ * esl/<mac>/trace/spi. Lines that are not trace records, such as other log
+ * output, are skipped. --replay feeds the recorded commands and captured data
+ * to the model, writes <prefix>-<n>.pbm for every refresh and compares the
+ * recorded time with the time at full wire speed.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "epd_display.h"
+#include "epd_graphics.h"
+#include "mock_panel.h"
+#include "pbm.h"
+
+#define LINE_MAX_LEN    (EPD_BUF_SIZE * 2 + 256)
+
+typedef struct {
+    char kind;              // C, D, B or R
+    int64_t start_us;
+    uint32_t duration_us;
+    uint32_t spi_us;
+    uint32_t len;
+    uint8_t cmd;            // Command byte, or the command a data run or BUSY wait follows
+    uint8_t *data;          // Captured bytes of a data run, NULL if not captured
+} record_t;
+
+typedef struct {
+    uint32_t count;
+    uint64_t bytes;         // Command byte plus its data
+    uint64_t spi_us;
+    uint64_t elapsed_us;
+    uint32_t busy_count;
+    uint64_t busy_us;
+    uint32_t busy_max_us;
+} cmd_stats_t;
+
+static record_t *records;
+static size_t record_count;
+static uint32_t clock_hz = 2000000;
+static unsigned long trace_total;
+
+static double wire_us(uint64_t bytes)
+{
+    return bytes * 8 * 1e6 / clock_hz;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void parse_line(char *line)
+{
+    char kind, dc;
+    long long start;
+    unsigned long duration, spi, len;
+    unsigned cmd;
+    int consumed;
+
+    if (strncmp(line, "# epd_spi_trace", 15) == 0) {
+        char *p = strstr(line, "clock_hz=");
+        if (p) clock_hz = strtoul(p + 9, NULL, 10);
+        p = strstr(line, "total=");
+        if (p) trace_total = strtoul(p + 6, NULL, 10);
+        return;
+    }
+
+    if (sscanf(line, "%c,%lld,%lu,%lu,%lu,%c,%x%n", &kind, &start, &duration, &spi, &len, &dc, &cmd,
+               &consumed) != 7 || strchr("CDBR", kind) == NULL) {
+        return;
+    }
+
+    records = realloc(records, (record_count + 1) * sizeof(record_t));
+    if (records == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+    record_t *rec = &records[record_count++];
+    *rec = (record_t){ kind, start, duration, spi, len, (uint8_t)cmd, NULL };
+
+    const char *hex = line + consumed;
+    if (kind == 'D' && hex[0] == ',') {
+        hex++;
+        rec->data = malloc(len);
+        for (uint32_t i = 0; rec->data && i < len; i++) {
+            int hi = hex_value(hex[2 * i]), lo = hi < 0 ? -1 : hex_value(hex[2 * i + 1]);
+            if (lo < 0) {
+                free(rec->data);    // Truncated line, keep the timing only
+                rec->data = NULL;
+                break;
+            }
+            rec->data[i] = (uint8_t)(hi << 4 | lo);
+        }
+    }
+}
+
+static void summarize(void)
+{
+    static cmd_stats_t cmds[256];
+    uint64_t wire_bytes = 0, spi_us = 0, elapsed_us = 0, busy_us = 0, reset_us = 0;
+    uint64_t transactions = 0, in_run_gap_us = 0, in_run_gaps = 0;
+    uint64_t gap_total = 0, gap_count = 0;
+    int64_t gap_max = 0;
+
+    int64_t first = records[0].start_us;
+    int64_t last = first;
+    for (size_t i = 0; i < record_count; i++) {
+        const record_t *rec = &records[i];
+        int64_t end = rec->start_us + rec->duration_us;
+        if (end > last) last = end;
+
+        // Idle time between consecutive SPI records, e.g. the loop around each byte of the previous run
+        if (i > 0 && strchr("CD", rec->kind) && strchr("CD", records[i - 1].kind)) {
+            int64_t gap = rec->start_us - (records[i - 1].start_us + records[i - 1].duration_us);
+            if (gap < 0) gap = 0;
+            gap_total += gap;
+            gap_count++;
+            if (gap > gap_max) gap_max = gap;
+        }
+
+        cmd_stats_t *c = &cmds[rec->cmd];
+        switch (rec->kind) {
+            case 'C':
+                c->count++;
+                /* fall through */
+            case 'D':
+                c->bytes += rec->len;
+                c->spi_us += rec->spi_us;
+                c->elapsed_us += rec->duration_us;
+                wire_bytes += rec->len;
+                spi_us += rec->spi_us;
+                elapsed_us += rec->duration_us;
+                transactions += rec->len;
+                if (rec->len > 1) {
+                    in_run_gap_us += rec->duration_us - rec->spi_us;
+                    in_run_gaps += rec->len - 1;
+                }
+                break;
+            case 'B':
+                c->busy_count++;
+                c->busy_us += rec->duration_us;
+                if (rec->duration_us > c->busy_max_us) c->busy_max_us = rec->duration_us;
+                busy_us += rec->duration_us;
+                break;
+            case 'R':
+                reset_us += rec->duration_us;
+                break;
+        }
+    }
+
+    double span_us = (double)(last - first);
+    printf("%zu records", record_count);
+    if (trace_total > record_count) printf(" (%lu older ones overwritten on the tag)", trace_total - record_count);
+    printf(", %.1f ms traced, SPI clock %.2f MHz\n\n", span_us / 1000, clock_hz / 1e6);
+
+    printf("%-6s %-6s %7s %9s %10s %10s %10s %6s %8s %10s %10s\n", "cmd", "name", "count", "bytes", "wire ms",
+           "spi ms", "elapsed ms", "util", "busy", "busy ms", "busy max");
+    for (int cmd = 0; cmd < 256; cmd++) {
+        const cmd_stats_t *c = &cmds[cmd];
+        if (c->count == 0 && c->busy_count == 0) continue;
+        printf("0x%02x   %-6s %7u %9llu %10.2f %10.2f %10.2f %5.1f%% %8u %10.1f %10.1f\n", cmd,
+               mock_panel_command_name(cmd), c->count, (unsigned long long)c->bytes, wire_us(c->bytes) / 1000,
+               c->spi_us / 1000.0, c->elapsed_us / 1000.0,
+               c->elapsed_us ? 100.0 * wire_us(c->bytes) / c->elapsed_us : 0.0, c->busy_count,
+               c->busy_us / 1000.0, c->busy_max_us / 1000.0);
+    }
+
+    printf("\nTransactions: %llu, %.1f us each inside spi_device_transmit (%.1f us on the wire)\n",
+           (unsigned long long)transactions, transactions ? (double)spi_us / transactions : 0.0,
+           wire_us(1));
+    printf("Gaps between transactions of a data run: %.1f us mean\n",
+           in_run_gaps ? (double)in_run_gap_us / in_run_gaps : 0.0);
+    printf("Gaps between SPI records: %.1f us mean, %lld us max\n",
+           gap_count ? (double)gap_total / gap_count : 0.0, (long long)gap_max);
+    printf("Wire utilization while sending: %.1f%% (%.1f ms of %.1f ms)\n",
+           elapsed_us ? 100.0 * wire_us(wire_bytes) / elapsed_us : 0.0, wire_us(wire_bytes) / 1000,
+           elapsed_us / 1000.0);
+
+    printf("\nTime traced:\n");
+    printf("  %-28s %10.1f ms\n", "on the wire", wire_us(wire_bytes) / 1000);
+    printf("  %-28s %10.1f ms\n", "SPI driver overhead", (spi_us - wire_us(wire_bytes)) / 1000);
+    printf("  %-28s %10.1f ms\n", "between bytes of a run", (elapsed_us - spi_us) / 1000.0);
+    printf("  %-28s %10.1f ms\n", "BUSY", busy_us / 1000.0);
+    printf("  %-28s %10.1f ms\n", "reset", reset_us / 1000.0);
+    printf("  %-28s %10.1f ms\n", "other",
+           (span_us - elapsed_us - busy_us - reset_us) / 1000.0);
+}
+
+// Writes the glass as seen on the tag, in the firmware's rotation
+static void write_glass(const mock_panel_t *panel, const char *prefix, uint32_t index)
+{
+    static uint8_t buffer[EPD_BUF_SIZE];
+    char path[512];
+    pbm_image_t img;
+
+    memcpy(buffer, panel->glass, EPD_BUF_SIZE);
+    epd_set_buffer(buffer, EPD_WIDTH, EPD_HEIGHT, EPD_ROTATE_0, WHITE);
+    if (pbm_alloc(&img, epd_fb.width, epd_fb.height) != 0) return;
+    for (int y = 0; y < epd_fb.height; y++) {
+        for (int x = 0; x < epd_fb.width; x++) {
+            pbm_set(&img, x, y, epd_get_pixel(x, y) == BLACK);
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s-%u.pbm", prefix, index);
+    if (pbm_write(path, &img) != 0) {
+        fprintf(stderr, "cannot write %s\n", path);
+    } else {
+        printf("  refresh %u -> %s\n", index, path);
+    }
+    pbm_free(&img);
+}
+
+static void replay(const char *prefix)
+{
+    static mock_panel_t panel;
+    uint64_t missing = 0;
+    double recorded_us = 0, modeled_us = 0, busy_recorded_us = 0, busy_modeled_us = 0;
+    uint32_t pending_busy_us = 0;
+
+    mock_panel_init(&panel, NULL);
+    printf("\nReplay against the panel model (nominal BUSY times, full wire speed):\n");
+
+    for (size_t i = 0; i < record_count; i++) {
+        const record_t *rec = &records[i];
+        switch (rec->kind) {
+            case 'R':
+                mock_panel_reset(&panel);
+                recorded_us += rec->duration_us;
+                modeled_us += rec->duration_us;     // Fixed RST pulse timing
+                break;
+            case 'C': {
+                uint32_t refreshes = panel.refreshes;
+                pending_busy_us = mock_panel_command(&panel, rec->cmd);
+                recorded_us += rec->duration_us;
+                modeled_us += wire_us(1);
+                if (panel.refreshes != refreshes) write_glass(&panel, prefix, panel.refreshes);
+                break;
+            }
+            case 'D':
+                if (rec->data) {
+                    mock_panel_data(&panel, rec->data, rec->len);
+                } else {
+                    missing += rec->len;
+                }
+                recorded_us += rec->duration_us;
+                modeled_us += wire_us(rec->len);
+                break;
+            case 'B':
+                recorded_us += rec->duration_us;
+                modeled_us += pending_busy_us;
+                busy_recorded_us += rec->duration_us;
+                busy_modeled_us += pending_busy_us;
+                pending_busy_us = 0;
+                break;
+        }
+    }
+
+    if (missing) {
+        printf("  %llu data bytes were not captured, raise CONFIG_ESL_SPI_TRACE_DATA_SIZE to render them\n",
+               (unsigned long long)missing);
+    }
+    if (panel.errors) printf("  %u protocol error(s), last: %s\n", panel.errors, panel.last_error);
+    printf("  %u refresh(es), BUSY recorded %.1f ms, model %.1f ms\n", panel.refreshes, busy_recorded_us / 1000,
+           busy_modeled_us / 1000);
+    printf("  Recorded %.1f ms, at wire speed with model BUSY %.1f ms\n", recorded_us / 1000, modeled_us / 1000);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL, *replay_prefix = NULL;
+    unsigned long clock_override = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_prefix = argv[++i];
+        } else if (strcmp(argv[i], "--clock") == 0 && i + 1 < argc) {
+            clock_override = strtoul(argv[++i], NULL, 10);
+        } else if (path == NULL && (argv[i][0] != '-' || strcmp(argv[i], "-") == 0)) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [trace.txt|-] [--replay <prefix>] [--clock <hz>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    FILE *f = path == NULL || strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+        return 2;
+    }
+
+    char *line = malloc(LINE_MAX_LEN);
+    while (line && fgets(line, LINE_MAX_LEN, f)) {
+        parse_line(line);
+    }
+    free(line);
+    if (f != stdin) fclose(f);
+
+    if (clock_override) clock_hz = clock_override;
+    if (record_count == 0) {
+        fprintf(stderr, "no trace records found\n");
+        return 1;
+    }
+
+    summarize();
+    if (replay_prefix) replay(replay_prefix);
+
+    for (size_t i = 0; i < record_count; i++) free(records[i].data);
+    free(records);
+    return 0;
+}
@@ -3,6 +3,11 @@
 #include "driver/spi_master.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "esl/esl_trace.h"
+#include "epd_spi_trace.h"
+#include <string.h>
+
+#define EPD_SPI_CLOCK_HZ    (2 * 1000 * 1000)
 
 static const char *TAG_EPD = "EPD";
 
@@ -21,7 +26,7 @@ void epd_spi_init(void) {
     };
 
     spi_device_interface_config_t devcfg = {
-        .clock_speed_hz = 2 * 1000 * 1000,  // 2 MHz
+        .clock_speed_hz = EPD_SPI_CLOCK_HZ,  // 2 MHz
         .mode = 0,  // SPI mode 0
         .spics_io_num = PIN_EPD_CS,
         .queue_size = 1,
@@ -43,53 +48,266 @@ void epd_gpio_init(void) {
     gpio_set_direction(LCD_GND_CTRL, GPIO_MODE_OUTPUT);
 }
 
-void epd_write_reg(uint8_t command) {
-    gpio_set_level(PIN_EPD_DC, 0);  // Command mode
-    spi_transaction_t t = {
-        .length = 8,
-        .tx_buffer = &command,
+#if CONFIG_ESL_SPI_TRACE
+
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#define SPI_TRACE_RING_SIZE CONFIG_ESL_SPI_TRACE_RING_SIZE
+#define SPI_TRACE_DATA_SIZE CONFIG_ESL_SPI_TRACE_DATA_SIZE
+
+static const char spi_kind_codes[] = { [EPD_SPI_CMD] = 'C', [EPD_SPI_DATA] = 'D', [EPD_SPI_BUSY] = 'B', [EPD_SPI_RESET] = 'R' };
+
+static epd_spi_trace_record_t spi_ring[SPI_TRACE_RING_SIZE];
+static uint32_t spi_ring_head;          // Total records ever written, the slot is head % size
+static volatile uint32_t spi_data_head; // Total data bytes ever sent, the capture slot is pos % size
+static uint8_t spi_last_cmd;
+static portMUX_TYPE spi_ring_lock = portMUX_INITIALIZER_UNLOCKED;
+#if SPI_TRACE_DATA_SIZE > 0
+static uint8_t *spi_data;
+static bool spi_data_alloc_tried;
+#endif
+
+static epd_spi_trace_record_t *spi_trace_next(void)
+{
+    return &spi_ring[spi_ring_head++ % SPI_TRACE_RING_SIZE];
+}
+
+// Records one byte on the wire, extending the data run in progress
+static void spi_trace_write(uint8_t byte, int dc, int64_t start_us, int64_t end_us)
+{
+#if SPI_TRACE_DATA_SIZE > 0
+    if (!spi_data_alloc_tried) {
+        spi_data_alloc_tried = true;
+        spi_data = heap_caps_malloc(SPI_TRACE_DATA_SIZE, MALLOC_CAP_SPIRAM);
+        if (spi_data == NULL) spi_data = malloc(SPI_TRACE_DATA_SIZE);
+        if (spi_data == NULL) ESP_LOGW(TAG_EPD, "No memory for SPI data capture");
+    }
+#endif
+
+    portENTER_CRITICAL(&spi_ring_lock);
+    epd_spi_trace_record_t *last = spi_ring_head ? &spi_ring[(spi_ring_head - 1) % SPI_TRACE_RING_SIZE] : NULL;
+    if (dc && last && last->kind == EPD_SPI_DATA) {
+        last->duration_us = (uint32_t)(end_us - last->start_us);
+        last->spi_us += (uint32_t)(end_us - start_us);
+        last->len++;
+    } else {
+        *spi_trace_next() = (epd_spi_trace_record_t){
+            .start_us = start_us,
+            .duration_us = (uint32_t)(end_us - start_us),
+            .spi_us = (uint32_t)(end_us - start_us),
+            .len = 1,
+            .data_pos = spi_data_head,
+            .kind = dc ? EPD_SPI_DATA : EPD_SPI_CMD,
+            .value = dc ? spi_last_cmd : byte,
+        };
+        if (!dc) spi_last_cmd = byte;
+    }
+    if (dc) {
+#if SPI_TRACE_DATA_SIZE > 0
+        if (spi_data) spi_data[spi_data_head % SPI_TRACE_DATA_SIZE] = byte;
+#endif
+        spi_data_head++;
+    }
+    portEXIT_CRITICAL(&spi_ring_lock);
+}
+
+// Records a BUSY wait or reset, tagged with the last command sent
+static void spi_trace_event(epd_spi_kind_t kind, int64_t start_us, int64_t end_us)
+{
+    portENTER_CRITICAL(&spi_ring_lock);
+    *spi_trace_next() = (epd_spi_trace_record_t){
+        .start_us = start_us,
+        .duration_us = (uint32_t)(end_us - start_us),
+        .kind = kind,
+        .value = spi_last_cmd,
     };
-    esp_err_t ret = spi_device_transmit(epd_spi, &t);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG_EPD, "SPI Transmission failed with error: %s", esp_err_to_name(ret));
+    portEXIT_CRITICAL(&spi_ring_lock);
+}
+
+static uint32_t spi_trace_snapshot(epd_spi_trace_record_t *out, uint32_t *total)
+{
+    uint32_t count;
+
+    portENTER_CRITICAL(&spi_ring_lock);
+    *total = spi_ring_head;
+    count = spi_ring_head < SPI_TRACE_RING_SIZE ? spi_ring_head : SPI_TRACE_RING_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = spi_ring[(spi_ring_head - count + i) % SPI_TRACE_RING_SIZE];
     }
+    portEXIT_CRITICAL(&spi_ring_lock);
+    return count;
 }
 
-void epd_write_data8(uint8_t data) {
-    gpio_set_level(PIN_EPD_DC, 1);  // Data mode
+/**
+ * @brief Upper bound of the epd_spi_trace_format() output for a full ring and data capture.
+ */
+size_t epd_spi_trace_format_size(void)
+{
+    return 96 + SPI_TRACE_RING_SIZE * 64 + SPI_TRACE_DATA_SIZE * 2;
+}
+
+/**
+ * @brief Formats the SPI trace, oldest record first.
+ *
+ * A "# epd_spi_trace" header with the SPI clock is followed by one
+ * "kind,start_us,duration_us,spi_us,len,dc,command" line per record, kind being
+ * C (command), D (data run), B (BUSY wait) or R (reset). Data runs still held in
+ * the capture buffer carry their bytes in hex as an eighth field.
+ *
+ * @param buf Output buffer, epd_spi_trace_format_size() bytes always fit
+ * @param len Buffer size, records that do not fit are left out
+ *
+ * @return Number of characters written, excluding the terminator
+ */
+int epd_spi_trace_format(char *buf, size_t len)
+{
+    uint32_t total;
+    size_t used = 0;
+
+    if (len == 0) return 0;
+    buf[0] = '\0';
+
+    // Allocated per call like the output buffer, since the boot dump and MQTT requests can overlap
+    epd_spi_trace_record_t *records = heap_caps_malloc(SPI_TRACE_RING_SIZE * sizeof(*records), MALLOC_CAP_SPIRAM);
+    if (records == NULL) records = malloc(SPI_TRACE_RING_SIZE * sizeof(*records));
+    if (records == NULL) {
+        ESP_LOGW(TAG_EPD, "No memory for SPI trace snapshot");
+        return 0;
+    }
+    uint32_t count = spi_trace_snapshot(records, &total);
+
+    int n = snprintf(buf, len, "# epd_spi_trace v1 clock_hz=%d records=%lu total=%lu\n", EPD_SPI_CLOCK_HZ,
+                     (unsigned long)count, (unsigned long)total);
+    if (n < 0 || (size_t)n >= len) {
+        buf[0] = '\0';
+        free(records);
+        return 0;
+    }
+    used = n;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const epd_spi_trace_record_t *rec = &records[i];
+        bool wire = rec->kind == EPD_SPI_CMD || rec->kind == EPD_SPI_DATA;
+        n = snprintf(buf + used, len - used, "%c,%lld,%lu,%lu,%lu,%c,%02x", spi_kind_codes[rec->kind],
+                     rec->start_us, (unsigned long)rec->duration_us, (unsigned long)rec->spi_us,
+                     (unsigned long)rec->len, wire ? '0' + (rec->kind == EPD_SPI_DATA) : '-', rec->value);
+        if (n < 0 || (size_t)n + 1 >= len - used) break;
+        size_t line_start = used;
+        used += n;
+
+#if SPI_TRACE_DATA_SIZE > 0
+        if (rec->kind == EPD_SPI_DATA && spi_data && spi_data_head - rec->data_pos <= SPI_TRACE_DATA_SIZE &&
+            used + 1 + rec->len * 2 + 1 < len) {
+            static const char hex[] = "0123456789abcdef";
+            buf[used++] = ',';
+            for (uint32_t b = 0; b < rec->len; b++) {
+                uint8_t byte = spi_data[(rec->data_pos + b) % SPI_TRACE_DATA_SIZE];
+                buf[used++] = hex[byte >> 4];
+                buf[used++] = hex[byte & 0x0F];
+            }
+            // An update in flight may have overwritten the start of the run while it was copied
+            if (spi_data_head - rec->data_pos > SPI_TRACE_DATA_SIZE) {
+                used = line_start + n;
+            }
+        }
+#else
+        (void)line_start;
+#endif
+        buf[used++] = '\n';
+    }
+    buf[used] = '\0';
+    free(records);
+    return (int)used;
+}
+
+/**
+ * @brief Prints the SPI trace to the console in the epd_spi_trace_format() format, for the host analyzer.
+ */
+void epd_spi_trace_dump(void)
+{
+    size_t size = epd_spi_trace_format_size();
+    char *buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (buf == NULL) buf = malloc(size);
+    if (buf == NULL) {
+        ESP_LOGW(TAG_EPD, "No memory for SPI trace dump");
+        return;
+    }
+
+    int n = epd_spi_trace_format(buf, size);
+    fwrite(buf, 1, n, stdout);
+    fflush(stdout);
+    free(buf);
+}
+
+#endif // CONFIG_ESL_SPI_TRACE
+
+// Sends one byte with DC low for a command or high for data
+static void epd_spi_write(uint8_t byte, int dc) {
+    gpio_set_level(PIN_EPD_DC, dc);
     spi_transaction_t t = {
         .length = 8,
-        .tx_buffer = &data,
+        .tx_buffer = &byte,
     };
+#if CONFIG_ESL_SPI_TRACE
+    int64_t start_us = esp_timer_get_time();
+#endif
     esp_err_t ret = spi_device_transmit(epd_spi, &t);
+#if CONFIG_ESL_SPI_TRACE
+    spi_trace_write(byte, dc, start_us, esp_timer_get_time());
+#endif
     if (ret != ESP_OK) {
         ESP_LOGE(TAG_EPD, "SPI Transmission failed with error: %s", esp_err_to_name(ret));
     }
 }
 
+void epd_write_reg(uint8_t command) {
+    epd_spi_write(command, 0);  // Command mode
+}
+
+void epd_write_data8(uint8_t data) {
+    epd_spi_write(data, 1);  // Data mode
+}
+
 void epd_wait_busy(void) {
+#if CONFIG_ESL_SPI_TRACE
+    int64_t start_us = esp_timer_get_time();
+#endif
     while (gpio_get_level(PIN_EPD_BUSY) == 0) {  // UC8253 is active-low
         vTaskDelay(pdMS_TO_TICKS(50));
     }
+#if CONFIG_ESL_SPI_TRACE
+    spi_trace_event(EPD_SPI_BUSY, start_us, esp_timer_get_time());
+#endif
 }
 
 void epd_reset(void) {
     ESP_LOGI(TAG_EPD, "Resetting UC8253 ePaper...");
+#if CONFIG_ESL_SPI_TRACE
+    int64_t start_us = esp_timer_get_time();
+#endif
 
     gpio_set_level(PIN_EPD_RST, 0);
     vTaskDelay(pdMS_TO_TICKS(20));
 
     gpio_set_level(PIN_EPD_RST, 1);
     vTaskDelay(pdMS_TO_TICKS(20));
+#if CONFIG_ESL_SPI_TRACE
+    spi_trace_event(EPD_SPI_RESET, start_us, esp_timer_get_time());
+#endif
 
     epd_wait_busy();
 }
 
 void epd_update(void) {
+    ESL_TRACE_BEGIN(refresh);
     epd_write_reg(0x04);
     epd_wait_busy();
     epd_write_reg(0x12);
     epd_wait_busy();
+    ESL_TRACE_END(refresh, ESL_SPAN_REFRESH_BUSY);
 }
 
 void epd_init(void) {
@@ -198,6 +416,7 @@ void epd_display(const uint8_t *image) {
     const uint16_t height = EPD_HEIGHT;
 
     // Step 1: Write OLD image buffer
+    ESL_TRACE_BEGIN(push_old);
     epd_write_reg(0x10);
     for (uint16_t y = 0; y < height; y++) {
         for (uint16_t x = 0; x < width_bytes; x++) {
@@ -206,7 +425,10 @@ void epd_display(const uint8_t *image) {
         }
     }
 
+    ESL_TRACE_END(push_old, ESL_SPAN_SPI_PUSH_OLD);
+
     // Step 2: Write NEW image buffer
+    ESL_TRACE_BEGIN(push_new);
     epd_write_reg(0x13);
     for (uint16_t y = 0; y < height; y++) {
         for (uint16_t x = 0; x < width_bytes; x++) {
@@ -216,5 +438,21 @@ void epd_display(const uint8_t *image) {
             oldImage[index] = val; // Save for next refresh
         }
     }
+    ESL_TRACE_END(push_new, ESL_SPAN_SPI_PUSH_NEW);
 }
 
+
+
+/*******************************************************************
+ * Function Description: Sets the OLD image plane without touching the panel.
+ *   Use when the content on glass is known, e.g. restored after deep
+ *   sleep, so the next partial refresh uses the right previous frame.
+ * 
+ * Parameters:
+ *   *image - Pointer to the image currently shown on the panel
+ * 
+ * Returns: None
+ *******************************************************************/
+void epd_set_old_image(const uint8_t *image) {
+    memcpy(oldImage, image, sizeof(oldImage));
+}
\ No newline at end of file
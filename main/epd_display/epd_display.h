@@ -33,5 +33,6 @@ void epd_test(void);
 void epd_deep_sleep(void);
 void epd_enable_power(void);
 void epd_display(const uint8_t *image);
+void epd_set_old_image(const uint8_t *image);
 
 #endif // _EDP_DISPLAY_H
\ No newline at end of file
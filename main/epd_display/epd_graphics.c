@@ -3,7 +3,7 @@
 #include "epd_graphics.h"
 #include "epd_font.h"
 
-epd_framebuffer_t epd_fb;
+EPD_FB_STORAGE epd_framebuffer_t epd_fb;
 
 /**
  * @brief Initializes the global framebuffer for the e-paper display.
@@ -71,6 +71,32 @@ void epd_clear_buffer_region(int x, int y, int w, int h, uint8_t color) {
     }
 }
 
+// Maps logical coordinates to the physical framebuffer, false if outside it
+static inline bool map_pixel(uint16_t x, uint16_t y, uint16_t *X, uint16_t *Y) {
+    switch (epd_fb.rotation) {
+        case EPD_ROTATE_0:
+            *X = y;
+            *Y = x;
+            break;
+        case EPD_ROTATE_90:
+            *X = x;
+            *Y = epd_fb.height_memory - y - 1;
+            break;
+        case EPD_ROTATE_180:
+            *X = epd_fb.width_memory - y - 1;
+            *Y = epd_fb.height_memory - x - 1;
+            break;
+        case EPD_ROTATE_270:
+            *X = epd_fb.width_memory - x - 1;
+            *Y = y;
+            break;
+        default:
+            return false; // Invalid rotation
+    }
+
+    return *X < epd_fb.width_memory && *Y < epd_fb.height_memory;
+}
+
 /**
  * @brief Draws a single pixel in the framebuffer at the specified coordinates.
  *
@@ -88,30 +114,8 @@ void epd_clear_buffer_region(int x, int y, int w, int h, uint8_t color) {
 void epd_draw_pixel(uint16_t x, uint16_t y, uint8_t color) {
     uint16_t X, Y;
 
-    // Apply rotation
-    switch (epd_fb.rotation) {
-        case EPD_ROTATE_0:
-            X = y;
-            Y = x;
-            break;
-        case EPD_ROTATE_90:
-            X = x;
-            Y = epd_fb.height_memory - y - 1;
-            break;
-        case EPD_ROTATE_180:
-            X = epd_fb.width_memory - y - 1;
-            Y = epd_fb.height_memory - x - 1;
-            break;
-        case EPD_ROTATE_270:
-            X = epd_fb.width_memory - x - 1;
-            Y = y;
-            break;
-        default:
-            return; // Invalid rotation
-    }
-
-    // Bounds check
-    if (X >= epd_fb.width_memory || Y >= epd_fb.height_memory) return;
+    // Apply rotation and bounds check
+    if (!map_pixel(x, y, &X, &Y)) return;
 
     // Calculate byte index in framebuffer
     uint32_t byte_index = Y * epd_fb.width_bytes + (X / 8);
@@ -124,6 +128,23 @@ void epd_draw_pixel(uint16_t x, uint16_t y, uint8_t color) {
     }    
 }
 
+/**
+ * @brief Reads back a pixel of the framebuffer.
+ *
+ * @param x X coordinate, with the same rotation as epd_draw_pixel()
+ * @param y Y coordinate
+ *
+ * @return WHITE or BLACK, the background color outside the buffer
+ */
+uint8_t epd_get_pixel(uint16_t x, uint16_t y) {
+    uint16_t X, Y;
+
+    if (!map_pixel(x, y, &X, &Y)) return epd_fb.background_color;
+
+    uint8_t bit_mask = 0x80 >> (X % 8);
+    return epd_fb.buffer[Y * epd_fb.width_bytes + (X / 8)] & bit_mask ? WHITE : BLACK;
+}
+
 /**
  * @brief Displays a single character on the e-paper display.
  *
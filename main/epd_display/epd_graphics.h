@@ -24,12 +24,21 @@ typedef struct {
     uint8_t background_color;  // Optional: used for clear/fill
 } epd_framebuffer_t;
 
-extern epd_framebuffer_t epd_fb;
+// Host tools that draw from several threads build with EPD_FB_PER_THREAD, giving
+// each thread its own draw target; the firmware draws from one task
+#ifdef EPD_FB_PER_THREAD
+#define EPD_FB_STORAGE _Thread_local
+#else
+#define EPD_FB_STORAGE
+#endif
+
+extern EPD_FB_STORAGE epd_framebuffer_t epd_fb;
 
 void epd_set_buffer(uint8_t *buffer, uint16_t width, uint16_t height, epd_rotation_t rotation, uint8_t background_color);
 void epd_clear_buffer(uint8_t color);
 void epd_clear_buffer_region(int x, int y, int w, int h, uint8_t color);
 void epd_draw_pixel(uint16_t x, uint16_t y, uint8_t color);
+uint8_t epd_get_pixel(uint16_t x, uint16_t y);
 void epd_draw_char(uint16_t x, uint16_t y, uint16_t chr, uint16_t size, uint16_t color);
 void epd_draw_string(uint16_t x, uint16_t y, const char *str, uint16_t size, uint16_t color);
 void epd_draw_image(uint16_t x0, uint16_t y0, uint16_t width, uint16_t height, const uint8_t *bmp, uint8_t color);
@@ -0,0 +1,39 @@
+#ifndef _EPD_SPI_TRACE_H
+#define _EPD_SPI_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+typedef enum {
+    EPD_SPI_CMD = 0,        // One command byte, DC low
+    EPD_SPI_DATA,           // Run of data bytes after a command, DC high
+    EPD_SPI_BUSY,           // Waiting for BUSY to release
+    EPD_SPI_RESET,          // RST pulse
+} epd_spi_kind_t;
+
+typedef struct {
+    int64_t start_us;       // esp_timer time of the first transaction
+    uint32_t duration_us;   // First transaction start to last transaction end
+    uint32_t spi_us;        // Time spent inside spi_device_transmit()
+    uint32_t len;           // Bytes sent, 0 for BUSY and RESET
+    uint32_t data_pos;      // Position of the first byte in the data capture stream
+    uint8_t kind;           // epd_spi_kind_t
+    uint8_t value;          // Command byte, or the command a data run belongs to
+} epd_spi_trace_record_t;
+
+#if CONFIG_ESL_SPI_TRACE
+
+void epd_spi_trace_dump(void);
+int epd_spi_trace_format(char *buf, size_t len);
+size_t epd_spi_trace_format_size(void);
+
+#else
+
+#define epd_spi_trace_dump()            ((void)0)
+#define epd_spi_trace_format(buf, len)  (0)
+#define epd_spi_trace_format_size()     ((size_t)0)
+
+#endif // CONFIG_ESL_SPI_TRACE
+
+#endif // _EPD_SPI_TRACE_H
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <string.h>
+#include "esl_ack.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#define ACK_MAGIC0      0xE5
+#define ACK_MAGIC1      0x51
+#define ACK_VERSION     1
+#define ACK_VERSION_V2  2
+
+static const char *TAG_ACK = "ACK";
+
+static const char *result_names[] = {
+    [ESL_ACK_APPLIED]   = "applied",
+    [ESL_ACK_UNCHANGED] = "unchanged",
+    [ESL_ACK_ACCEPTED]  = "accepted",
+    [ESL_ACK_REJECTED]  = "rejected",
+    [ESL_ACK_DROPPED]   = "dropped",
+    [ESL_ACK_SCHEDULED] = "scheduled",
+};
+
+static esp_mqtt_client_handle_t mqtt_client;
+static const char *ack_topic;
+
+// Updates drawn into the framebuffer, acknowledged once their batch is committed
+static esl_ack_pending_t pending[ESL_ACK_PENDING_MAX];
+static int pending_count;
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Message being dispatched, only touched from the MQTT task
+static bool current_has_seq;
+static bool current_noted;
+static uint32_t current_seq;
+
+/**
+ * @brief Sets the client and the esl/<mac>/ack topic acknowledgements are published on.
+ *
+ * @param topic Full ack topic, must outlive the module
+ */
+esp_err_t esl_ack_init(esp_mqtt_client_handle_t client, const char *topic)
+{
+    mqtt_client = client;
+    ack_topic = topic;
+    return ESP_OK;
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+ * @brief Checks a payload for a sequence header.
+ *
+ * @param data Payload, or at least its first chunk
+ * @param len  Bytes available at data
+ * @param hdr  Sequence number and activation time, set when a header is present
+ *
+ * @return Header length to skip, 0 if the payload has no header
+ */
+int esl_ack_parse(const uint8_t *data, int len, esl_ack_header_t *hdr)
+{
+    if (len < ESL_ACK_HEADER_LEN || data[0] != ACK_MAGIC0 || data[1] != ACK_MAGIC1) {
+        return 0;
+    }
+
+    if (data[2] == ACK_VERSION) {
+        hdr->seq = read_le32(data + 4);
+        hdr->activate_at = 0;
+        return ESL_ACK_HEADER_LEN;
+    }
+    if (data[2] == ACK_VERSION_V2 && len >= ESL_ACK_HEADER_V2_LEN) {
+        hdr->seq = read_le32(data + 4);
+        hdr->activate_at = read_le32(data + 8);
+        return ESL_ACK_HEADER_V2_LEN;
+    }
+    return 0;
+}
+
+/**
+ * @brief Publishes one acknowledgement as JSON.
+ *
+ * Queued in the MQTT outbox at QoS 1, so it is delivered after a reconnect too.
+ */
+void esl_ack_send(uint32_t seq, esl_ack_result_t result, uint32_t hash, uint32_t refresh_ms)
+{
+    char json[96];
+
+    if (mqtt_client == NULL) return;
+
+    int n = snprintf(json, sizeof(json), "{\"seq\":%lu,\"result\":\"%s\",\"hash\":\"%08lx\",\"refresh_ms\":%lu}",
+                     (unsigned long)seq, result_names[result], (unsigned long)hash, (unsigned long)refresh_ms);
+    if (esp_mqtt_client_enqueue(mqtt_client, ack_topic, json, n, 1, 0, true) < 0) {
+        ESP_LOGW(TAG_ACK, "Could not queue ack for seq %lu", (unsigned long)seq);
+    }
+}
+
+/**
+ * @brief Starts dispatching a message, so handlers can report its outcome with esl_ack_note() or esl_ack_stage().
+ */
+void esl_ack_begin(bool has_seq, uint32_t seq)
+{
+    current_has_seq = has_seq;
+    current_seq = seq;
+    current_noted = false;
+}
+
+/**
+ * @brief Acknowledges the message being dispatched right away.
+ *
+ * @param result Outcome
+ * @param hash   Hash of the payload, 0 if not computed
+ */
+void esl_ack_note(esl_ack_result_t result, uint32_t hash)
+{
+    if (!current_has_seq || current_noted) return;
+    current_noted = true;
+
+    esl_ack_send(current_seq, result, hash, 0);
+}
+
+/**
+ * @brief Holds the acknowledgement of a drawn update until its batch is committed.
+ *
+ * Call with the framebuffer lock held, so the update cannot slip into a
+ * commit that is already past the panel.
+ *
+ * @param result ESL_ACK_APPLIED if the update was drawn, ESL_ACK_UNCHANGED if it matched
+ * @param hash   Hash of the payload
+ */
+void esl_ack_stage(esl_ack_result_t result, uint32_t hash)
+{
+    if (!current_has_seq || current_noted) return;
+    current_noted = true;
+
+    portENTER_CRITICAL(&pending_lock);
+    bool queued = pending_count < ESL_ACK_PENDING_MAX;
+    if (queued) {
+        pending[pending_count++] = (esl_ack_pending_t){ current_seq, hash, result };
+    }
+    portEXIT_CRITICAL(&pending_lock);
+
+    // Too many updates in one batch, report this one as staged rather than lose the ack
+    if (!queued) {
+        esl_ack_send(current_seq, ESL_ACK_ACCEPTED, hash, 0);
+    }
+}
+
+/**
+ * @brief Finishes dispatching, acknowledging handlers that did not report an outcome as accepted.
+ */
+void esl_ack_end(void)
+{
+    if (current_has_seq && !current_noted) {
+        esl_ack_send(current_seq, ESL_ACK_ACCEPTED, 0, 0);
+    }
+    current_has_seq = false;
+}
+
+/**
+ * @brief Takes the acknowledgements staged so far as the batch being committed.
+ *
+ * Call with the framebuffer lock held, then send the batch with esl_ack_commit()
+ * once the lock is released: publishing takes the MQTT client lock, which the
+ * MQTT task holds while it waits for the framebuffer.
+ */
+void esl_ack_take(esl_ack_batch_t *batch)
+{
+    portENTER_CRITICAL(&pending_lock);
+    batch->count = pending_count;
+    memcpy(batch->acks, pending, pending_count * sizeof(esl_ack_pending_t));
+    pending_count = 0;
+    portEXIT_CRITICAL(&pending_lock);
+}
+
+/**
+ * @brief Acknowledges every update of a batch taken with esl_ack_take().
+ *
+ * @param batch      Acknowledgements of the committed batch
+ * @param refreshed  Whether the panel was refreshed, otherwise drawn updates are reported unchanged
+ * @param refresh_ms SPI push plus refresh time, 0 when not refreshed
+ */
+void esl_ack_commit(const esl_ack_batch_t *batch, bool refreshed, uint32_t refresh_ms)
+{
+    for (int i = 0; i < batch->count; i++) {
+        const esl_ack_pending_t *ack = &batch->acks[i];
+        esl_ack_result_t result = refreshed ? ack->result : ESL_ACK_UNCHANGED;
+        esl_ack_send(ack->seq, result, ack->hash, refreshed ? refresh_ms : 0);
+    }
+}
+
+/**
+ * @brief Waits for the broker to take the queued acknowledgements, e.g. before a restart.
+ *
+ * Must not be called from the MQTT task, which sends the outbox and handles the PUBACKs.
+ *
+ * @param timeout_ms Longest wait
+ *
+ * @return true if the outbox was emptied
+ */
+bool esl_ack_flush(int timeout_ms)
+{
+    if (mqtt_client == NULL) return true;
+
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    int outbox;
+    while ((outbox = esp_mqtt_client_get_outbox_size(mqtt_client)) > 0) {
+        if (esp_timer_get_time() > deadline) {
+            ESP_LOGW(TAG_ACK, "Giving up with %d bytes unacknowledged in the outbox", outbox);
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    return true;
+}
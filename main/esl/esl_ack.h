@@ -0,0 +1,54 @@
+#ifndef _ESL_ACK_H
+#define _ESL_ACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+// Optional header in front of any payload, all fields little-endian:
+//   0xE5 0x51 <version=1> <reserved=0> <seq: uint32>
+//   0xE5 0x51 <version=2> <reserved=0> <seq: uint32> <activate_at: uint32 Unix time>
+// Payloads without it are handled as before and never acknowledged.
+#define ESL_ACK_HEADER_LEN      8
+#define ESL_ACK_HEADER_V2_LEN   12
+#define ESL_ACK_PENDING_MAX     32
+
+typedef enum {
+    ESL_ACK_APPLIED = 0,    // On glass after the commit
+    ESL_ACK_UNCHANGED,      // Identical to the current content, nothing redrawn
+    ESL_ACK_ACCEPTED,       // Handled, not tied to a refresh (layout, boost, ...)
+    ESL_ACK_REJECTED,       // Malformed for its topic, will never apply
+    ESL_ACK_DROPPED,        // Not received in full (no free slot, too large)
+    ESL_ACK_SCHEDULED,      // Staged in the pending frame until its activation time
+} esl_ack_result_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t activate_at;   // Unix time to go live, 0 for now
+} esl_ack_header_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t hash;
+    uint8_t result;
+} esl_ack_pending_t;
+
+// Acknowledgements of one committed batch, sent once the panel is done with it
+typedef struct {
+    int count;
+    esl_ack_pending_t acks[ESL_ACK_PENDING_MAX];
+} esl_ack_batch_t;
+
+esp_err_t esl_ack_init(esp_mqtt_client_handle_t client, const char *topic);
+int esl_ack_parse(const uint8_t *data, int len, esl_ack_header_t *hdr);
+void esl_ack_begin(bool has_seq, uint32_t seq);
+void esl_ack_note(esl_ack_result_t result, uint32_t hash);
+void esl_ack_stage(esl_ack_result_t result, uint32_t hash);
+void esl_ack_end(void);
+void esl_ack_take(esl_ack_batch_t *batch);
+void esl_ack_commit(const esl_ack_batch_t *batch, bool refreshed, uint32_t refresh_ms);
+bool esl_ack_flush(int timeout_ms);
+void esl_ack_send(uint32_t seq, esl_ack_result_t result, uint32_t hash, uint32_t refresh_ms);
+
+#endif // _ESL_ACK_H
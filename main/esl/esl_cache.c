@@ -0,0 +1,152 @@
+#include <string.h>
+#include "esl_cache.h"
+#include "nvs.h"
+#include "esp_log.h"
+
+#define ESL_CACHE_NVS_NAMESPACE "esl"
+#define ESL_CACHE_NVS_KEY       "region_hash"
+
+static const char *TAG_CACHE = "CACHE";
+
+typedef struct {
+    uint32_t hash[ESL_LAYOUT_MAX_REGIONS];
+    uint32_t valid_mask;
+} esl_cache_t;
+
+// Hashes of what is currently on glass, and of what is drawn in fb but not yet refreshed
+static esl_cache_t committed;
+static esl_cache_t staged;
+static esl_cache_t pushing;     // Staged hashes of the frame being pushed to the panel
+
+/**
+ * @brief Computes a 32-bit FNV-1a hash over a region payload.
+ *
+ * @param data Pointer to the payload bytes
+ * @param len  Payload length in bytes
+ *
+ * @return 32-bit content hash
+ */
+uint32_t esl_cache_hash(const uint8_t *data, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Loads the committed region hashes from NVS.
+ *
+ * Must be called after `nvs_flash_init()`. A missing or malformed entry leaves
+ * the cache empty, so the next update of every region is drawn.
+ */
+void esl_cache_init(void)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(committed);
+
+    memset(&committed, 0, sizeof(committed));
+
+    if (nvs_open(ESL_CACHE_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        ESP_LOGI(TAG_CACHE, "No cached region hashes");
+        staged = committed;
+        pushing = committed;
+        return;
+    }
+
+    if (nvs_get_blob(nvs, ESL_CACHE_NVS_KEY, &committed, &len) != ESP_OK || len != sizeof(committed)) {
+        memset(&committed, 0, sizeof(committed));
+    }
+    nvs_close(nvs);
+
+    staged = committed;
+    pushing = committed;
+    ESP_LOGI(TAG_CACHE, "Loaded region hashes (valid mask 0x%02lx)", (unsigned long)committed.valid_mask);
+}
+
+/**
+ * @brief Checks whether a region payload is already in the framebuffer.
+ *
+ * Outside of a pending update this is also what is on glass.
+ *
+ * @param region Index of the region in the active layout
+ * @param hash   Hash of the incoming payload, from `esl_cache_hash()`
+ *
+ * @return true if the drawn content of the region has the same hash
+ */
+bool esl_cache_matches(int region, uint32_t hash)
+{
+    if (region < 0 || region >= ESL_LAYOUT_MAX_REGIONS) return false;
+
+    return (staged.valid_mask & (1u << region)) && staged.hash[region] == hash;
+}
+
+/**
+ * @brief Checks whether the framebuffer differs from what is on glass.
+ *
+ * An update that was later reverted within the same commit is not dirty.
+ */
+bool esl_cache_dirty(void)
+{
+    return memcmp(&committed, &staged, sizeof(committed)) != 0;
+}
+
+/**
+ * @brief Records the hash of a payload that has been drawn into the framebuffer.
+ *
+ * The hash only becomes authoritative once `esl_cache_commit()` is called
+ * after the panel refresh that pushed it.
+ */
+void esl_cache_set(int region, uint32_t hash)
+{
+    if (region < 0 || region >= ESL_LAYOUT_MAX_REGIONS) return;
+
+    staged.hash[region] = hash;
+    staged.valid_mask |= 1u << region;
+}
+
+/**
+ * @brief Takes the staged hashes as those of the frame about to be pushed.
+ *
+ * Call with the framebuffer lock held, as the frame is copied for the refresh.
+ * Updates drawn during the refresh stay staged for the next commit.
+ */
+void esl_cache_snapshot(void)
+{
+    pushing = staged;
+}
+
+/**
+ * @brief Marks the hashes taken by `esl_cache_snapshot()` as on glass and persists them to NVS.
+ */
+void esl_cache_commit(void)
+{
+    nvs_handle_t nvs;
+
+    if (memcmp(&committed, &pushing, sizeof(committed)) == 0) return;
+    committed = pushing;
+
+    if (nvs_open(ESL_CACHE_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG_CACHE, "Failed to open NVS, hashes kept in RAM only");
+        return;
+    }
+
+    if (nvs_set_blob(nvs, ESL_CACHE_NVS_KEY, &committed, sizeof(committed)) != ESP_OK ||
+        nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGW(TAG_CACHE, "Failed to persist region hashes");
+    }
+    nvs_close(nvs);
+}
+
+/**
+ * @brief Forgets every region hash, e.g. after the panel has been redrawn from scratch.
+ */
+void esl_cache_invalidate(void)
+{
+    memset(&staged, 0, sizeof(staged));
+    esl_cache_snapshot();
+    esl_cache_commit();
+}
@@ -0,0 +1,18 @@
+#ifndef _ESL_CACHE_H
+#define _ESL_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esl_layout.h"
+
+uint32_t esl_cache_hash(const uint8_t *data, size_t len);
+void esl_cache_init(void);
+bool esl_cache_matches(int region, uint32_t hash);
+bool esl_cache_dirty(void);
+void esl_cache_set(int region, uint32_t hash);
+void esl_cache_snapshot(void);
+void esl_cache_commit(void);
+void esl_cache_invalidate(void);
+
+#endif // _ESL_CACHE_H
@@ -0,0 +1,44 @@
+#include <string.h>
+#include "esl_draw.h"
+#include "epd_display/epd_graphics.h"
+
+/**
+ * @brief Decodes a region payload into the framebuffer.
+ *
+ * Only depends on epd_graphics, so the host tools render payloads exactly as the tag does.
+ *
+ * @param desc Region the payload is for
+ * @param data Column-major 1-bpp bitmap for bitmap regions, text for text regions
+ * @param len  Payload length, must be w * ceil(h / 8) bytes for bitmap regions
+ */
+void esl_draw_region(const esl_region_desc_t *desc, const uint8_t *data, int len)
+{
+    char text[ESL_DRAW_TEXT_MAX_LEN + 1];
+
+    if (desc->font == 0) {
+        epd_draw_bin_image(data, desc->x, desc->y, desc->w, desc->h);
+        return;
+    }
+
+    // Characters advance by half the font size, so clip to what fits the region width
+    int advance = desc->font / 2;
+    if (advance > 0 && len > desc->w / advance) len = desc->w / advance;
+    if (len > ESL_DRAW_TEXT_MAX_LEN) len = ESL_DRAW_TEXT_MAX_LEN;
+    memcpy(text, data, len);
+    text[len] = '\0';
+
+    epd_clear_buffer_region(desc->x, desc->y, desc->w, desc->h, WHITE);
+    epd_draw_string(desc->x, desc->y, text, desc->font, BLACK);
+}
+
+/**
+ * @brief Decodes a region payload into another buffer with the live framebuffer's geometry.
+ */
+void esl_draw_region_into(uint8_t *buffer, const esl_region_desc_t *desc, const uint8_t *data, int len)
+{
+    uint8_t *live = epd_fb.buffer;
+
+    epd_fb.buffer = buffer;
+    esl_draw_region(desc, data, len);
+    epd_fb.buffer = live;
+}
@@ -0,0 +1,12 @@
+#ifndef _ESL_DRAW_H
+#define _ESL_DRAW_H
+
+#include <stdint.h>
+#include "esl_layout.h"
+
+#define ESL_DRAW_TEXT_MAX_LEN   64
+
+void esl_draw_region(const esl_region_desc_t *desc, const uint8_t *data, int len);
+void esl_draw_region_into(uint8_t *buffer, const esl_region_desc_t *desc, const uint8_t *data, int len);
+
+#endif // _ESL_DRAW_H
@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+#include "esl_fbstore.h"
+#include "esl_cache.h"
+#include "nvs.h"
+#include "esp_system.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#define FBSTORE_MAGIC       0x45534C46  // "ESLF"
+#define FBSTORE_NVS_NAMESPACE "esl"
+#define FBSTORE_NVS_KEY     "fb"
+#define FBSTORE_RTC_SIZE    CONFIG_ESL_FB_RTC_BUDGET
+
+static const char *TAG_FBSTORE = "FBSTORE";
+
+typedef struct {
+    uint32_t magic;
+    uint32_t hash;          // esl_cache_hash() of the uncompressed framebuffer
+    uint16_t raw_len;
+    uint16_t packed_len;
+} fbstore_header_t;
+
+// Survives deep sleep but not a power cycle or brownout
+static RTC_DATA_ATTR fbstore_header_t rtc_header;
+static RTC_DATA_ATTR uint8_t rtc_packed[FBSTORE_RTC_SIZE];
+
+static uint32_t glass_hash;
+
+/*
+ * PackBits: a control byte n in 0..127 is followed by n + 1 literal bytes,
+ * n in -127..-1 by one byte repeated 1 - n times. Label content is mostly
+ * long white runs, so a typical framebuffer packs to a few hundred bytes.
+ */
+static size_t packbits_encode(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < len) {
+        size_t run = 1;
+        while (in + run < len && run < 128 && src[in + run] == src[in]) run++;
+
+        if (run >= 3) {
+            if (out + 2 > cap) return 0;
+            dst[out++] = (uint8_t)(int8_t)(1 - (int)run);
+            dst[out++] = src[in];
+            in += run;
+            continue;
+        }
+
+        // Literal until the next run of at least three identical bytes
+        size_t lit = 1;
+        while (in + lit < len && lit < 128 &&
+               !(in + lit + 2 < len && src[in + lit] == src[in + lit + 1] &&
+                 src[in + lit] == src[in + lit + 2])) {
+            lit++;
+        }
+        if (out + 1 + lit > cap) return 0;
+        dst[out++] = (uint8_t)(lit - 1);
+        memcpy(&dst[out], &src[in], lit);
+        out += lit;
+        in += lit;
+    }
+    return out;
+}
+
+static bool packbits_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < len) {
+        int8_t n = (int8_t)src[in++];
+        if (n >= 0) {
+            size_t lit = (size_t)n + 1;
+            if (in + lit > len || out + lit > cap) return false;
+            memcpy(&dst[out], &src[in], lit);
+            in += lit;
+            out += lit;
+        } else if (n != -128) {
+            size_t run = 1 - (int)n;
+            if (in >= len || out + run > cap) return false;
+            memset(&dst[out], src[in++], run);
+            out += run;
+        }
+    }
+    return out == cap;
+}
+
+static bool unpack(const fbstore_header_t *hdr, const uint8_t *packed, uint8_t *fb, size_t len)
+{
+    if (hdr->magic != FBSTORE_MAGIC || hdr->raw_len != len) return false;
+    if (!packbits_decode(packed, hdr->packed_len, fb, len)) return false;
+
+    return esl_cache_hash(fb, len) == hdr->hash;
+}
+
+/**
+ * @brief Records the framebuffer that was just committed to glass.
+ *
+ * A PackBits copy is kept in RTC slow memory when it fits in
+ * CONFIG_ESL_FB_RTC_BUDGET bytes, and with CONFIG_ESL_FB_PERSIST_NVS it is
+ * also written to NVS so it survives power loss. Saving an unchanged
+ * framebuffer does not touch flash.
+ *
+ * @param fb  Framebuffer as sent to the panel
+ * @param len Framebuffer size in bytes
+ */
+void esl_fbstore_save(const uint8_t *fb, size_t len)
+{
+    uint32_t hash = esl_cache_hash(fb, len);
+    size_t cap = len + len / 128 + 2;
+    fbstore_header_t hdr = { FBSTORE_MAGIC, hash, (uint16_t)len, 0 };
+
+    if (hash == glass_hash) return;
+    glass_hash = hash;
+
+    uint8_t *packed = malloc(cap);
+    if (!packed) {
+        ESP_LOGW(TAG_FBSTORE, "No memory to pack framebuffer");
+        rtc_header.magic = 0;
+        return;
+    }
+
+    hdr.packed_len = (uint16_t)packbits_encode(fb, len, packed, cap);
+
+    if (hdr.packed_len > 0 && hdr.packed_len <= FBSTORE_RTC_SIZE) {
+        memcpy(rtc_packed, packed, hdr.packed_len);
+        rtc_header = hdr;
+    } else {
+        rtc_header.magic = 0;
+    }
+
+#if CONFIG_ESL_FB_PERSIST_NVS
+    nvs_handle_t nvs;
+    if (hdr.packed_len > 0 && nvs_open(FBSTORE_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        if (nvs_set_blob(nvs, FBSTORE_NVS_KEY "_hdr", &hdr, sizeof(hdr)) != ESP_OK ||
+            nvs_set_blob(nvs, FBSTORE_NVS_KEY, packed, hdr.packed_len) != ESP_OK ||
+            nvs_commit(nvs) != ESP_OK) {
+            ESP_LOGW(TAG_FBSTORE, "Failed to persist framebuffer");
+        }
+        nvs_close(nvs);
+    }
+#endif
+
+    ESP_LOGI(TAG_FBSTORE, "Saved framebuffer %08lx (%u -> %u bytes)",
+             (unsigned long)hash, (unsigned)len, hdr.packed_len);
+    free(packed);
+}
+
+/**
+ * @brief Restores the framebuffer that is on glass.
+ *
+ * After a deep sleep wake the RTC copy is used, otherwise (or if it is
+ * invalid) the NVS copy. The restored content is verified against its hash.
+ *
+ * @param fb  Framebuffer to fill
+ * @param len Framebuffer size in bytes
+ *
+ * @return true if fb now holds exactly what is on glass
+ */
+bool esl_fbstore_restore(uint8_t *fb, size_t len)
+{
+    if (esp_reset_reason() == ESP_RST_DEEPSLEEP && unpack(&rtc_header, rtc_packed, fb, len)) {
+        glass_hash = rtc_header.hash;
+        ESP_LOGI(TAG_FBSTORE, "Restored framebuffer %08lx from RTC", (unsigned long)glass_hash);
+        return true;
+    }
+    rtc_header.magic = 0;
+
+#if CONFIG_ESL_FB_PERSIST_NVS
+    nvs_handle_t nvs;
+    fbstore_header_t hdr;
+    size_t hdr_len = sizeof(hdr);
+    bool restored = false;
+
+    if (nvs_open(FBSTORE_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) return false;
+
+    if (nvs_get_blob(nvs, FBSTORE_NVS_KEY "_hdr", &hdr, &hdr_len) == ESP_OK && hdr_len == sizeof(hdr)) {
+        size_t packed_len = hdr.packed_len;
+        uint8_t *packed = malloc(packed_len);
+        if (packed && nvs_get_blob(nvs, FBSTORE_NVS_KEY, packed, &packed_len) == ESP_OK &&
+            packed_len == hdr.packed_len) {
+            restored = unpack(&hdr, packed, fb, len);
+        }
+        free(packed);
+    }
+    nvs_close(nvs);
+
+    if (restored) {
+        glass_hash = hdr.hash;
+        ESP_LOGI(TAG_FBSTORE, "Restored framebuffer %08lx from NVS", (unsigned long)glass_hash);
+    }
+    return restored;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Hash of the framebuffer last saved or restored, 0 if unknown.
+ */
+uint32_t esl_fbstore_hash(void)
+{
+    return glass_hash;
+}
+
+/**
+ * @brief Drops both stored copies, so the next boot redraws the panel from scratch.
+ */
+void esl_fbstore_forget(void)
+{
+    rtc_header.magic = 0;
+    glass_hash = 0;
+
+#if CONFIG_ESL_FB_PERSIST_NVS
+    nvs_handle_t nvs;
+    if (nvs_open(FBSTORE_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        nvs_erase_key(nvs, FBSTORE_NVS_KEY "_hdr");
+        nvs_erase_key(nvs, FBSTORE_NVS_KEY);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+#endif
+}
@@ -0,0 +1,13 @@
+#ifndef _ESL_FBSTORE_H
+#define _ESL_FBSTORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+void esl_fbstore_save(const uint8_t *fb, size_t len);
+bool esl_fbstore_restore(uint8_t *fb, size_t len);
+uint32_t esl_fbstore_hash(void);
+void esl_fbstore_forget(void);
+
+#endif // _ESL_FBSTORE_H
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include "esl_groups.h"
+#include "esl_ack.h"
+#include "cJSON.h"
+#include "nvs.h"
+#include "esp_log.h"
+
+#define ESL_GROUPS_NVS_NAMESPACE "esl"
+#define ESL_GROUPS_NVS_KEY       "groups"
+
+static const char *TAG_GROUPS = "GROUPS";
+
+static esl_groups_t active;
+
+static void apply(const esl_groups_t *groups)
+{
+    const char *prefixes[ESL_ROUTER_MAX_GROUPS];
+
+    for (int i = 0; i < groups->count; i++) {
+        prefixes[i] = groups->prefixes[i];
+    }
+    esl_router_set_groups(prefixes, groups->count);
+}
+
+// IDs become topic levels, so wildcards and separators are not allowed
+static bool id_valid(const char *id)
+{
+    size_t len = strlen(id);
+    if (len == 0 || len >= ESL_GROUP_ID_LEN) return false;
+
+    for (size_t i = 0; i < len; i++) {
+        char c = id[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+              c == '-' || c == '_' || c == '.')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool add_ids(const cJSON *array, const char *kind, esl_groups_t *out)
+{
+    const cJSON *item;
+
+    if (array == NULL) return true;
+    if (!cJSON_IsArray(array)) return false;
+
+    cJSON_ArrayForEach(item, array) {
+        if (!cJSON_IsString(item) || !id_valid(item->valuestring)) {
+            ESP_LOGW(TAG_GROUPS, "Invalid %s ID", kind);
+            return false;
+        }
+        if (out->count >= ESL_ROUTER_MAX_GROUPS) {
+            ESP_LOGW(TAG_GROUPS, "More than %d groups", ESL_ROUTER_MAX_GROUPS);
+            return false;
+        }
+        snprintf(out->prefixes[out->count++], ESL_ROUTER_TOPIC_LEN, "esl/%s/%s", kind, item->valuestring);
+    }
+    return true;
+}
+
+/**
+ * @brief Loads the group assignment stored in NVS and hands it to the router.
+ *
+ * Call after the routes are registered and before MQTT connects.
+ */
+void esl_groups_init(void)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(active);
+
+    memset(&active, 0, sizeof(active));
+
+    if (nvs_open(ESL_GROUPS_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        if (nvs_get_blob(nvs, ESL_GROUPS_NVS_KEY, &active, &len) != ESP_OK ||
+            len != sizeof(active) || active.count > ESL_ROUTER_MAX_GROUPS) {
+            memset(&active, 0, sizeof(active));
+        }
+        nvs_close(nvs);
+    }
+
+    ESP_LOGI(TAG_GROUPS, "%d group(s) assigned", active.count);
+    apply(&active);
+}
+
+/**
+ * @brief Parses a group assignment.
+ *
+ * Format: {"groups": ["<sku>", ...], "stores": ["<store id>", ...]}, either
+ * list may be omitted. IDs are 1-24 characters of [A-Za-z0-9._-].
+ *
+ * @param json  Assignment JSON (not null-terminated)
+ * @param len   JSON length
+ * @param out   Parsed prefixes, zeroed first so assignments can be compared with memcmp
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if the assignment is malformed
+ */
+esp_err_t esl_groups_parse(const char *json, int len, esl_groups_t *out)
+{
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+
+    memset(out, 0, sizeof(*out));
+
+    cJSON *root = cJSON_ParseWithLength(json, len);
+    if (root == NULL) {
+        ESP_LOGW(TAG_GROUPS, "Group assignment is not valid JSON");
+        return err;
+    }
+
+    if (add_ids(cJSON_GetObjectItemCaseSensitive(root, "groups"), "group", out) &&
+        add_ids(cJSON_GetObjectItemCaseSensitive(root, "stores"), "store", out)) {
+        err = ESP_OK;
+    }
+
+    cJSON_Delete(root);
+    return err;
+}
+
+/**
+ * @brief Router handler for esl/<mac>/groups.
+ *
+ * Stores a valid assignment in NVS and moves the group subscriptions over
+ * without reconnecting.
+ */
+void esl_groups_handler(const uint8_t *data, int len, void *arg)
+{
+    esl_groups_t parsed;
+    nvs_handle_t nvs;
+
+    if (esl_groups_parse((const char *)data, len, &parsed) != ESP_OK) {
+        esl_ack_note(ESL_ACK_REJECTED, 0);
+        return;
+    }
+
+    if (memcmp(&parsed, &active, sizeof(parsed)) == 0) {
+        ESP_LOGI(TAG_GROUPS, "Group assignment unchanged");
+        esl_ack_note(ESL_ACK_UNCHANGED, 0);
+        return;
+    }
+
+    esp_err_t err = nvs_open(ESL_GROUPS_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, ESL_GROUPS_NVS_KEY, &parsed, sizeof(parsed));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_GROUPS, "Failed to store group assignment: %s", esp_err_to_name(err));
+        esl_ack_note(ESL_ACK_REJECTED, 0);
+        return;
+    }
+
+    active = parsed;
+    apply(&active);
+    esl_ack_note(ESL_ACK_ACCEPTED, 0);
+}
@@ -0,0 +1,19 @@
+#ifndef _ESL_GROUPS_H
+#define _ESL_GROUPS_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esl_router.h"
+
+#define ESL_GROUP_ID_LEN    25      // Longest SKU or store ID plus terminator
+
+typedef struct {
+    uint8_t count;
+    char prefixes[ESL_ROUTER_MAX_GROUPS][ESL_ROUTER_TOPIC_LEN];    // e.g. "esl/group/<sku>"
+} esl_groups_t;
+
+void esl_groups_init(void);
+esp_err_t esl_groups_parse(const char *json, int len, esl_groups_t *groups);
+void esl_groups_handler(const uint8_t *data, int len, void *arg);
+
+#endif // _ESL_GROUPS_H
@@ -0,0 +1,177 @@
+#include <string.h>
+#include "esl_inflight.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#define INFLIGHT_SLOTS      CONFIG_ESL_INFLIGHT_SLOTS
+#define INFLIGHT_PAYLOAD    CONFIG_ESL_INFLIGHT_PAYLOAD_MAX
+#define INFLIGHT_TIMEOUT_US ((int64_t)CONFIG_ESL_INFLIGHT_TIMEOUT_MS * 1000)
+
+static const char *TAG_INFLIGHT = "INFLIGHT";
+
+static esl_inflight_msg_t slots[INFLIGHT_SLOTS];
+static uint8_t free_list[INFLIGHT_SLOTS];   // Stack of free slot indices
+static int free_count;
+static uint8_t *arena;
+static esl_inflight_stats_t stats;
+
+static void release_slot(esl_inflight_msg_t *msg)
+{
+    msg->in_use = false;
+    free_list[free_count++] = (uint8_t)(msg - slots);
+    stats.in_use--;
+}
+
+/**
+ * @brief Allocates the reassembly pool.
+ *
+ * All payload buffers come from a single arena of
+ * CONFIG_ESL_INFLIGHT_SLOTS * CONFIG_ESL_INFLIGHT_PAYLOAD_MAX bytes, placed in
+ * PSRAM when CONFIG_ESL_INFLIGHT_IN_PSRAM is enabled.
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the arena could not be allocated
+ */
+esp_err_t esl_inflight_init(void)
+{
+    size_t arena_size = (size_t)INFLIGHT_SLOTS * INFLIGHT_PAYLOAD;
+
+#if CONFIG_ESL_INFLIGHT_IN_PSRAM
+    arena = heap_caps_malloc(arena_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!arena) {
+        ESP_LOGW(TAG_INFLIGHT, "PSRAM allocation failed, using internal RAM");
+    }
+#endif
+    if (!arena) {
+        arena = heap_caps_malloc(arena_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!arena) {
+        ESP_LOGE(TAG_INFLIGHT, "Failed to allocate %u bytes for %d slots", (unsigned)arena_size, INFLIGHT_SLOTS);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    stats.slots = INFLIGHT_SLOTS;
+
+    // Push in reverse so slot 0 is handed out first
+    free_count = 0;
+    for (int i = INFLIGHT_SLOTS - 1; i >= 0; i--) {
+        memset(&slots[i], 0, sizeof(slots[i]));
+        slots[i].data = &arena[(size_t)i * INFLIGHT_PAYLOAD];
+        free_list[free_count++] = (uint8_t)i;
+    }
+
+    ESP_LOGI(TAG_INFLIGHT, "%d slots x %d bytes", INFLIGHT_SLOTS, INFLIGHT_PAYLOAD);
+    return ESP_OK;
+}
+
+/**
+ * @brief Takes a slot from the pool for a new message.
+ *
+ * If the pool is empty, slots that timed out are reclaimed first.
+ *
+ * @param msg_id    MQTT message id
+ * @param topic     Null-terminated topic of the message
+ * @param total_len Full payload length announced by the first chunk
+ *
+ * @return Slot pointer, or NULL if the message is too large or no slot is free
+ */
+esl_inflight_msg_t *esl_inflight_create(int msg_id, const char *topic, int total_len)
+{
+    if (total_len < 0 || total_len > INFLIGHT_PAYLOAD) {
+        stats.oversized++;
+        return NULL;
+    }
+
+    if (free_count == 0 && esl_inflight_reclaim(false) == 0) {
+        stats.exhausted++;
+        return NULL;
+    }
+
+    esl_inflight_msg_t *msg = &slots[free_list[--free_count]];
+    msg->in_use = true;
+    msg->msg_id = msg_id;
+    msg->total_len = total_len;
+    msg->received_len = 0;
+    msg->first_chunk_us = esp_timer_get_time();
+    msg->last_chunk_us = msg->first_chunk_us;
+    memset(msg->topic, 0, sizeof(msg->topic));
+    strncpy(msg->topic, topic, sizeof(msg->topic) - 1);
+
+    stats.in_use++;
+    if (stats.in_use > stats.high_water) {
+        stats.high_water = stats.in_use;
+    }
+    return msg;
+}
+
+esl_inflight_msg_t *esl_inflight_find(int msg_id)
+{
+    for (int i = 0; i < INFLIGHT_SLOTS; i++) {
+        if (slots[i].in_use && slots[i].msg_id == msg_id) {
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Copies a chunk into the slot at its payload offset.
+ *
+ * @return true if the chunk fits within the announced length, false otherwise
+ */
+bool esl_inflight_append(esl_inflight_msg_t *msg, int offset, const char *data, int len)
+{
+    if (offset < 0 || len < 0 || offset + len > msg->total_len) {
+        return false;
+    }
+
+    memcpy(&msg->data[offset], data, len);
+    msg->received_len += len;
+    msg->last_chunk_us = esp_timer_get_time();
+    return true;
+}
+
+void esl_inflight_finish(esl_inflight_msg_t *msg)
+{
+    if (!msg->in_use) return;
+
+    if (msg->received_len == msg->total_len) {
+        stats.completed++;
+    }
+    release_slot(msg);
+}
+
+/**
+ * @brief Returns abandoned slots to the pool.
+ *
+ * @param all If true, every partial message is dropped (e.g. after a broker
+ *            disconnect, since the remaining chunks will never arrive).
+ *            Otherwise only slots idle for longer than CONFIG_ESL_INFLIGHT_TIMEOUT_MS.
+ *
+ * @return Number of slots reclaimed
+ */
+int esl_inflight_reclaim(bool all)
+{
+    int64_t now = esp_timer_get_time();
+    int reclaimed = 0;
+
+    for (int i = 0; i < INFLIGHT_SLOTS; i++) {
+        esl_inflight_msg_t *msg = &slots[i];
+        if (!msg->in_use) continue;
+
+        if (all || now - msg->last_chunk_us > INFLIGHT_TIMEOUT_US) {
+            ESP_LOGW(TAG_INFLIGHT, "Evicting %s [msg_id=%d] at %d/%d bytes",
+                     msg->topic, msg->msg_id, msg->received_len, msg->total_len);
+            release_slot(msg);
+            stats.evicted++;
+            reclaimed++;
+        }
+    }
+    return reclaimed;
+}
+
+void esl_inflight_get_stats(esl_inflight_stats_t *out)
+{
+    *out = stats;
+}
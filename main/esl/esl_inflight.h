@@ -0,0 +1,41 @@
+#ifndef _ESL_INFLIGHT_H
+#define _ESL_INFLIGHT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#define ESL_INFLIGHT_TOPIC_LEN 64
+
+typedef struct {
+    bool in_use;
+    int msg_id;
+    int total_len;
+    int received_len;
+    int route;                      // Router ID resolved from the topic of the first chunk
+    int64_t first_chunk_us;         // esp_timer time of the chunk at offset 0
+    int64_t last_chunk_us;          // esp_timer time of the last accepted chunk
+    char topic[ESL_INFLIGHT_TOPIC_LEN];
+    uint8_t *data;                  // CONFIG_ESL_INFLIGHT_PAYLOAD_MAX bytes from the pool arena
+} esl_inflight_msg_t;
+
+typedef struct {
+    uint32_t slots;                 // Pool size
+    uint32_t in_use;                // Slots currently reassembling
+    uint32_t high_water;            // Most slots ever in use at once
+    uint32_t completed;             // Messages fully received
+    uint32_t exhausted;             // Messages dropped because no slot was free
+    uint32_t evicted;               // Slots reclaimed after CONFIG_ESL_INFLIGHT_TIMEOUT_MS
+    uint32_t oversized;             // Messages dropped for exceeding CONFIG_ESL_INFLIGHT_PAYLOAD_MAX
+} esl_inflight_stats_t;
+
+esp_err_t esl_inflight_init(void);
+esl_inflight_msg_t *esl_inflight_create(int msg_id, const char *topic, int total_len);
+esl_inflight_msg_t *esl_inflight_find(int msg_id);
+bool esl_inflight_append(esl_inflight_msg_t *msg, int offset, const char *data, int len);
+void esl_inflight_finish(esl_inflight_msg_t *msg);
+int esl_inflight_reclaim(bool all);
+void esl_inflight_get_stats(esl_inflight_stats_t *stats);
+
+#endif // _ESL_INFLIGHT_H
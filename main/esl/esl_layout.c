@@ -0,0 +1,269 @@
+#include <string.h>
+#include "esl_layout.h"
+#include "esl_ui.h"
+#include "esl_cache.h"
+#include "esl_fbstore.h"
+#include "esl_ack.h"
+#include "epd_display/epd_display.h"
+#include "cJSON.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#define ESL_LAYOUT_NVS_NAMESPACE "esl"
+#define ESL_LAYOUT_NVS_KEY       "layout"
+#define RESTART_DRAIN_TIMEOUT_MS 2000
+
+// The tag is drawn in landscape, so the logical width is the panel height
+#define LAYOUT_MAX_X EPD_HEIGHT
+#define LAYOUT_MAX_Y EPD_WIDTH
+
+static const char *TAG_LAYOUT = "LAYOUT";
+
+static const esl_layout_t default_layout = {
+    .version = 1,
+    .region_count = 2,
+    .regions = {
+        { "price",       PRICE_X, PRICE_Y, PRICE_W, PRICE_H, 0 },
+        { "description", DESC_X,  DESC_Y,  DESC_W,  DESC_H,  0 },
+    },
+};
+
+static esl_layout_t layout;
+
+static bool font_supported(int font)
+{
+    return font == 0 || font == 8 || font == 12 || font == 16 || font == 24 || font == 48;
+}
+
+// Topic levels under esl/<mac>/ the tag uses itself, so no region can take them
+static const char *reserved_names[] = { "layout", "status", "trace", "stats", "boost", "ack", "groups" };
+
+// Region names become one topic level, so MQTT separators and wildcards are refused
+static bool name_valid(const char *name)
+{
+    for (const char *c = name; *c; c++) {
+        if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') ||
+              *c == '_' || *c == '-')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Checked against the first level below esl/<mac>/, where the tag's own topics live
+static bool name_reserved(const char *name)
+{
+    for (size_t i = 0; i < sizeof(reserved_names) / sizeof(reserved_names[0]); i++) {
+        if (strcmp(name, reserved_names[i]) == 0) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Loads the layout stored in NVS, or the built-in default if none is stored.
+ *
+ * Must be called after `nvs_flash_init()` and before regions are registered with the router.
+ */
+void esl_layout_init(void)
+{
+    nvs_handle_t nvs;
+    size_t len = sizeof(layout);
+
+    layout = default_layout;
+
+    if (nvs_open(ESL_LAYOUT_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        if (nvs_get_blob(nvs, ESL_LAYOUT_NVS_KEY, &layout, &len) != ESP_OK ||
+            len != sizeof(layout) || layout.region_count > ESL_LAYOUT_MAX_REGIONS) {
+            layout = default_layout;
+        }
+        nvs_close(nvs);
+    }
+
+    ESP_LOGI(TAG_LAYOUT, "Layout version %lu, %d regions", (unsigned long)layout.version, layout.region_count);
+}
+
+const esl_layout_t *esl_layout_get(void)
+{
+    return &layout;
+}
+
+/**
+ * @brief Parses a JSON layout descriptor.
+ *
+ * Expected format:
+ * @code
+ * {"version": 2, "regions": [{"name": "price", "x": 265, "y": 90, "w": 121, "h": 58, "font": 0}, ...]}
+ * @endcode
+ * `font` is optional and defaults to 0 (bitmap region).
+ *
+ * @param json   JSON text (not necessarily null-terminated)
+ * @param len    Length of the JSON text
+ * @param out    Parsed layout, only written on success
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if the descriptor is malformed or out of bounds
+ */
+esp_err_t esl_layout_parse(const char *json, int len, esl_layout_t *out)
+{
+    esl_layout_t parsed;
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+
+    // Zeroed so layouts can be compared with memcmp
+    memset(&parsed, 0, sizeof(parsed));
+
+    cJSON *root = cJSON_ParseWithLength(json, len);
+    if (!root) {
+        ESP_LOGW(TAG_LAYOUT, "Layout is not valid JSON");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cJSON *version = cJSON_GetObjectItemCaseSensitive(root, "version");
+    cJSON *regions = cJSON_GetObjectItemCaseSensitive(root, "regions");
+    if (!cJSON_IsNumber(version) || !cJSON_IsArray(regions) ||
+        cJSON_GetArraySize(regions) == 0 || cJSON_GetArraySize(regions) > ESL_LAYOUT_MAX_REGIONS) {
+        ESP_LOGW(TAG_LAYOUT, "Layout needs a version and 1..%d regions", ESL_LAYOUT_MAX_REGIONS);
+        goto done;
+    }
+    parsed.version = (uint32_t)version->valuedouble;
+
+    cJSON *item;
+    cJSON_ArrayForEach(item, regions) {
+        esl_region_desc_t *desc = &parsed.regions[parsed.region_count];
+        cJSON *name = cJSON_GetObjectItemCaseSensitive(item, "name");
+        cJSON *x = cJSON_GetObjectItemCaseSensitive(item, "x");
+        cJSON *y = cJSON_GetObjectItemCaseSensitive(item, "y");
+        cJSON *w = cJSON_GetObjectItemCaseSensitive(item, "w");
+        cJSON *h = cJSON_GetObjectItemCaseSensitive(item, "h");
+        cJSON *font = cJSON_GetObjectItemCaseSensitive(item, "font");
+
+        if (!cJSON_IsString(name) || strlen(name->valuestring) == 0 ||
+            strlen(name->valuestring) >= ESL_LAYOUT_NAME_LEN ||
+            !cJSON_IsNumber(x) || !cJSON_IsNumber(y) || !cJSON_IsNumber(w) || !cJSON_IsNumber(h)) {
+            ESP_LOGW(TAG_LAYOUT, "Region %d is missing a name or geometry", parsed.region_count);
+            goto done;
+        }
+
+        if (!name_valid(name->valuestring)) {
+            ESP_LOGW(TAG_LAYOUT, "Region name %s may only use A-Z, a-z, 0-9, _ and -", name->valuestring);
+            goto done;
+        }
+        if (name_reserved(name->valuestring)) {
+            ESP_LOGW(TAG_LAYOUT, "Region name %s is reserved", name->valuestring);
+            goto done;
+        }
+
+        // Checked as ints, before narrowing into the descriptor
+        int rx = x->valueint;
+        int ry = y->valueint;
+        int rw = w->valueint;
+        int rh = h->valueint;
+        int rfont = cJSON_IsNumber(font) ? font->valueint : 0;
+
+        if (rx < 0 || ry < 0 || rw <= 0 || rh <= 0 || rx > LAYOUT_MAX_X || ry > LAYOUT_MAX_Y ||
+            rw > LAYOUT_MAX_X - rx || rh > LAYOUT_MAX_Y - ry) {
+            ESP_LOGW(TAG_LAYOUT, "Region %s is outside the display", name->valuestring);
+            goto done;
+        }
+        if (rfont < 0 || rfont > UINT8_MAX || !font_supported(rfont)) {
+            ESP_LOGW(TAG_LAYOUT, "Region %s uses unsupported font %d", name->valuestring, rfont);
+            goto done;
+        }
+        if (rfont > rh) {
+            ESP_LOGW(TAG_LAYOUT, "Region %s is lower than its font %d", name->valuestring, rfont);
+            goto done;
+        }
+
+        strcpy(desc->name, name->valuestring);
+        desc->x = rx;
+        desc->y = ry;
+        desc->w = rw;
+        desc->h = rh;
+        desc->font = rfont;
+        if (desc->font == 0 && desc->w * ((desc->h + 7) / 8) > CONFIG_ESL_INFLIGHT_PAYLOAD_MAX) {
+            ESP_LOGW(TAG_LAYOUT, "Region %s does not fit in a reassembly slot", desc->name);
+            goto done;
+        }
+        for (int i = 0; i < parsed.region_count; i++) {
+            if (strcmp(parsed.regions[i].name, desc->name) == 0) {
+                ESP_LOGW(TAG_LAYOUT, "Duplicate region %s", desc->name);
+                goto done;
+            }
+        }
+        parsed.region_count++;
+    }
+
+    *out = parsed;
+    err = ESP_OK;
+
+done:
+    cJSON_Delete(root);
+    return err;
+}
+
+/**
+ * @brief Persists a layout to NVS. It takes effect on the next boot.
+ */
+esp_err_t esl_layout_store(const esl_layout_t *new_layout)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(ESL_LAYOUT_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) return err;
+
+    err = nvs_set_blob(nvs, ESL_LAYOUT_NVS_KEY, new_layout, sizeof(*new_layout));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+// Restarts once the broker has the layout ack. Runs in its own task, as the MQTT
+// task has to keep going to send the outbox and read the PUBACKs.
+static void restart_task(void *arg)
+{
+    esl_ack_flush(RESTART_DRAIN_TIMEOUT_MS);
+    esp_restart();
+}
+
+/**
+ * @brief Router handler for esl/<mac>/layout.
+ *
+ * A layout that differs from the active one is stored and acknowledged, and the
+ * tag restarts once the broker has the ack (or after RESTART_DRAIN_TIMEOUT_MS),
+ * so routes, subscriptions and the splash are rebuilt for the new regions.
+ * Re-publishing the active layout (e.g. a retained message) is ignored.
+ */
+void esl_layout_handler(const uint8_t *data, int len, void *arg)
+{
+    esl_layout_t parsed;
+
+    if (esl_layout_parse((const char *)data, len, &parsed) != ESP_OK) {
+        esl_ack_note(ESL_ACK_REJECTED, 0);
+        return;
+    }
+
+    if (memcmp(&parsed, &layout, sizeof(parsed)) == 0) {
+        ESP_LOGI(TAG_LAYOUT, "Layout version %lu already active", (unsigned long)parsed.version);
+        esl_ack_note(ESL_ACK_UNCHANGED, 0);
+        return;
+    }
+
+    if (esl_layout_store(&parsed) != ESP_OK) {
+        ESP_LOGE(TAG_LAYOUT, "Failed to store layout version %lu", (unsigned long)parsed.version);
+        esl_ack_note(ESL_ACK_REJECTED, 0);
+        return;
+    }
+
+    // Region indices change meaning with the layout, and the splash must be redrawn
+    esl_cache_invalidate();
+    esl_fbstore_forget();
+
+    ESP_LOGI(TAG_LAYOUT, "Layout version %lu stored, restarting", (unsigned long)parsed.version);
+    esl_ack_note(ESL_ACK_ACCEPTED, 0);
+    if (xTaskCreate(restart_task, "esl_restart", 2048, NULL, 5, NULL) != pdPASS) {
+        esp_restart();
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef _ESL_LAYOUT_H
+#define _ESL_LAYOUT_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ESL_LAYOUT_MAX_REGIONS  8
+#define ESL_LAYOUT_NAME_LEN     16
+
+typedef struct {
+    char name[ESL_LAYOUT_NAME_LEN]; // Topic suffix the region is published on
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+    uint8_t font;                   // 0 = 1-bpp bitmap payload, otherwise text drawn at this font size
+} esl_region_desc_t;
+
+typedef struct {
+    uint32_t version;
+    uint8_t region_count;
+    esl_region_desc_t regions[ESL_LAYOUT_MAX_REGIONS];
+} esl_layout_t;
+
+void esl_layout_init(void);
+const esl_layout_t *esl_layout_get(void);
+esp_err_t esl_layout_parse(const char *json, int len, esl_layout_t *layout);
+esp_err_t esl_layout_store(const esl_layout_t *layout);
+void esl_layout_handler(const uint8_t *data, int len, void *arg);
+
+#endif // _ESL_LAYOUT_H
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include "esl_mqtt.h"
+#include "esl_inflight.h"
+#include "esl_router.h"
+#include "esl_ack.h"
+#include "esl_ui.h"
+#include "esl_stats.h"
+#include "esl_trace.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG_MQTT = "MQTT";
+
+// Tells the sender a sequenced message will never be applied
+static void send_dropped(const uint8_t *data, int len)
+{
+    esl_ack_header_t hdr;
+    if (esl_ack_parse(data, len, &hdr)) {
+        esl_ack_send(hdr.seq, ESL_ACK_DROPPED, 0, 0);
+    }
+}
+
+/**
+ * @brief Reassembles MQTT_EVENT_DATA chunks and dispatches each complete message to its route.
+ *
+ * The first chunk of a message (offset 0) carries the topic, which is resolved
+ * to a route before any payload is buffered, and drops any message left partial. Once the last chunk is in, the
+ * optional sequence header is stripped and the handler runs between
+ * esl_ack_begin() and esl_ack_end(), with its activation time set for esl_ui.
+ *
+ * @param event Event as delivered by esp-mqtt, one chunk of at most the client's buffer size
+ */
+void esl_mqtt_handle_data(const esp_mqtt_event_t *event)
+{
+    esl_inflight_msg_t *msg = NULL;
+
+    if (event->current_data_offset == 0 && event->topic_len > 0) {
+        char topic_str[ESL_INFLIGHT_TOPIC_LEN];
+        snprintf(topic_str, sizeof(topic_str), "%.*s", event->topic_len, event->topic);
+
+        // esp-mqtt delivers the chunks of one message before the next begins, so a slot still
+        // in use was cut short. Matching by msg_id alone cannot tell, it is 0 for every QoS 0 message.
+        esl_inflight_reclaim(true);
+
+        // Resolve the handler once, before any payload is buffered
+        int route = esl_router_match(event->topic, event->topic_len);
+        if (route == ESL_ROUTE_NONE) {
+            ESP_LOGW(TAG_MQTT, "No route for %s, ignoring", topic_str);
+            return;
+        }
+
+        msg = esl_inflight_create(event->msg_id, topic_str, event->total_data_len);
+        if (msg == NULL) {
+            esl_inflight_stats_t stats;
+            esl_inflight_get_stats(&stats);
+            ESP_LOGW(TAG_MQTT, "Dropping %s (%d bytes) [msg_id=%d], exhausted=%lu oversized=%lu",
+                     topic_str, event->total_data_len, event->msg_id,
+                     (unsigned long)stats.exhausted, (unsigned long)stats.oversized);
+            send_dropped((const uint8_t *)event->data, event->data_len);
+            return;
+        }
+        msg->route = route;
+        ESP_LOGI(TAG_MQTT, "📥 Start receiving %s (%d bytes) [msg_id=%d]", msg->topic, msg->total_len, msg->msg_id);
+    } else {
+        msg = esl_inflight_find(event->msg_id);
+        if (msg == NULL) {
+            ESP_LOGW(TAG_MQTT, "Unknown msg_id=%d for chunk offset=%d", event->msg_id, event->current_data_offset);
+            return;
+        }
+    }
+
+    if (!esl_inflight_append(msg, event->current_data_offset, event->data, event->data_len)) {
+        ESP_LOGW(TAG_MQTT, "Overflow in msg_id=%d, dropping message!", event->msg_id);
+        send_dropped(msg->data, msg->received_len);
+        esl_inflight_finish(msg);
+        return;
+    }
+
+    if (event->current_data_offset + event->data_len != msg->total_len) return;
+
+    ESP_LOGI(TAG_MQTT, "✅ Received full %s (%d bytes) [msg_id=%d]", msg->topic, msg->received_len, msg->msg_id);
+    esl_trace_record(ESL_SPAN_CHUNK_RECEIVE, msg->first_chunk_us, esp_timer_get_time());
+    esl_stats_note_receive(msg->first_chunk_us, msg->received_len);
+
+    // Strip the optional sequence header so handlers see the bare payload
+    esl_ack_header_t hdr = { 0 };
+    int skip = esl_ack_parse(msg->data, msg->received_len, &hdr);
+    esl_ack_begin(skip > 0, hdr.seq);
+    esl_ui_schedule_begin(hdr.activate_at);
+    esl_router_dispatch(msg->route, msg->data + skip, msg->received_len - skip);
+    esl_ui_schedule_end();
+    esl_ack_end();
+
+    esl_inflight_finish(msg);
+}
@@ -0,0 +1,8 @@
+#ifndef _ESL_MQTT_H
+#define _ESL_MQTT_H
+
+#include "mqtt_client.h"
+
+void esl_mqtt_handle_data(const esp_mqtt_event_t *event);
+
+#endif // _ESL_MQTT_H
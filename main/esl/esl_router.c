@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "esl_router.h"
+#include "esp_log.h"
+
+static const char *TAG_ROUTER = "ROUTER";
+
+typedef struct {
+    char topic[ESL_ROUTER_TOPIC_LEN];
+    int topic_len;
+    bool shared;                // Also accepted under every group prefix
+    esl_route_handler_t handler;
+    void *arg;
+} esl_route_t;
+
+static char topic_prefix[ESL_ROUTER_TOPIC_LEN];
+static int topic_prefix_len;
+static esl_route_t routes[ESL_ROUTER_MAX_ROUTES];
+static int route_count;
+
+// Group prefixes, e.g. "esl/group/<sku>", subscribed as "<prefix>/+"
+static char groups[ESL_ROUTER_MAX_GROUPS][ESL_ROUTER_TOPIC_LEN];
+static int group_count;
+
+// Remembered from the last subscribe, so group changes can be applied live
+static esp_mqtt_client_handle_t sub_client;
+static int sub_qos;
+
+static void subscribe_group(const char *prefix, bool subscribe)
+{
+    char filter[ESL_ROUTER_TOPIC_LEN + 2];
+
+    // esl_router_set_groups() keeps room for the suffix, so this only guards the invariant
+    int len = snprintf(filter, sizeof(filter), "%s/+", prefix);
+    if (len < 0 || len >= (int)sizeof(filter)) return;
+    if (subscribe) {
+        esp_mqtt_client_subscribe(sub_client, filter, sub_qos);
+    } else {
+        esp_mqtt_client_unsubscribe(sub_client, filter);
+    }
+}
+
+/**
+ * @brief Sets the topic prefix that registered suffixes are appended to.
+ *
+ * @param prefix Per-tag prefix, e.g. "esl/<mac>"
+ */
+void esl_router_init(const char *prefix)
+{
+    memset(routes, 0, sizeof(routes));
+    route_count = 0;
+    group_count = 0;
+    topic_prefix_len = snprintf(topic_prefix, sizeof(topic_prefix), "%s", prefix);
+}
+
+/**
+ * @brief Registers a handler for "<prefix>/<suffix>".
+ *
+ * @param suffix  Topic suffix, e.g. "price"
+ * @param handler Called with the complete payload once all chunks have arrived
+ * @param arg     Opaque argument passed back to the handler
+ *
+ * @return Route ID, or ESL_ROUTE_NONE if the table is full or the topic is too long
+ */
+int esl_router_register(const char *suffix, esl_route_handler_t handler, void *arg)
+{
+    if (route_count >= ESL_ROUTER_MAX_ROUTES) {
+        ESP_LOGE(TAG_ROUTER, "Route table full, cannot register %s", suffix);
+        return ESL_ROUTE_NONE;
+    }
+
+    esl_route_t *route = &routes[route_count];
+    int len = snprintf(route->topic, sizeof(route->topic), "%s/%s", topic_prefix, suffix);
+    if (len < 0 || len >= (int)sizeof(route->topic)) {
+        ESP_LOGE(TAG_ROUTER, "Topic too long for suffix %s", suffix);
+        return ESL_ROUTE_NONE;
+    }
+
+    route->topic_len = len;
+    route->handler = handler;
+    route->arg = arg;
+
+    ESP_LOGI(TAG_ROUTER, "Route %d: %s", route_count, route->topic);
+    return route_count++;
+}
+
+/**
+ * @brief Registers a handler for "<prefix>/<suffix>" that group topics can also reach.
+ *
+ * A message on "<group prefix>/<suffix>" is dispatched to the same handler as
+ * the per-tag topic, so one publish can update every tag in the group.
+ *
+ * @return Route ID, or ESL_ROUTE_NONE if the route could not be registered
+ */
+int esl_router_register_shared(const char *suffix, esl_route_handler_t handler, void *arg)
+{
+    int route = esl_router_register(suffix, handler, arg);
+    if (route != ESL_ROUTE_NONE) {
+        routes[route].shared = true;
+    }
+    return route;
+}
+
+/**
+ * @brief Replaces the group prefixes shared routes are reachable under.
+ *
+ * When already connected, the old group filters are unsubscribed and the new
+ * ones subscribed right away. Call from the MQTT task or before connecting.
+ *
+ * @param prefixes Full prefixes without a trailing slash, e.g. "esl/store/42"
+ * @param count    Number of prefixes, extra ones beyond ESL_ROUTER_MAX_GROUPS are ignored
+ */
+void esl_router_set_groups(const char *const *prefixes, int count)
+{
+    if (count > ESL_ROUTER_MAX_GROUPS) {
+        ESP_LOGW(TAG_ROUTER, "Only the first %d of %d groups are used", ESL_ROUTER_MAX_GROUPS, count);
+        count = ESL_ROUTER_MAX_GROUPS;
+    }
+
+    if (sub_client) {
+        for (int i = 0; i < group_count; i++) {
+            subscribe_group(groups[i], false);
+        }
+    }
+
+    group_count = 0;
+    for (int i = 0; i < count; i++) {
+        int len = snprintf(groups[group_count], sizeof(groups[0]), "%s", prefixes[i]);
+        if (len <= 0 || len >= (int)sizeof(groups[0]) - 2) {
+            ESP_LOGW(TAG_ROUTER, "Group prefix %s too long, skipped", prefixes[i]);
+            continue;
+        }
+        ESP_LOGI(TAG_ROUTER, "Group %d: %s", group_count, groups[group_count]);
+        group_count++;
+    }
+
+    if (sub_client) {
+        for (int i = 0; i < group_count; i++) {
+            subscribe_group(groups[i], true);
+        }
+    }
+}
+
+/**
+ * @brief Subscribes to every registered topic. Call on MQTT_EVENT_CONNECTED.
+ */
+void esl_router_subscribe(esp_mqtt_client_handle_t client, int qos)
+{
+    sub_client = client;
+    sub_qos = qos;
+
+    for (int i = 0; i < route_count; i++) {
+        esp_mqtt_client_subscribe(client, routes[i].topic, qos);
+    }
+    for (int i = 0; i < group_count; i++) {
+        subscribe_group(groups[i], true);
+    }
+}
+
+// Finds a shared route whose suffix follows a group prefix
+static int match_group(const char *topic, int topic_len)
+{
+    for (int g = 0; g < group_count; g++) {
+        int glen = strlen(groups[g]);
+        if (topic_len <= glen + 1 || memcmp(topic, groups[g], glen) != 0 || topic[glen] != '/') continue;
+
+        const char *suffix = topic + glen + 1;
+        int suffix_len = topic_len - glen - 1;
+        for (int i = 0; i < route_count; i++) {
+            const esl_route_t *route = &routes[i];
+            if (route->shared && route->topic_len - topic_prefix_len - 1 == suffix_len &&
+                memcmp(route->topic + topic_prefix_len + 1, suffix, suffix_len) == 0) {
+                return i;
+            }
+        }
+    }
+    return ESL_ROUTE_NONE;
+}
+
+/**
+ * @brief Resolves an incoming topic to its route ID.
+ *
+ * Topics are compared exactly, so "esl/<mac>/price_old" does not match "price".
+ * Topics under a group prefix resolve to the shared route with the same suffix.
+ * Called once per message, on the chunk at offset 0.
+ *
+ * @param topic     Topic as received (not null-terminated)
+ * @param topic_len Topic length
+ *
+ * @return Route ID, or ESL_ROUTE_NONE if no route matches
+ */
+int esl_router_match(const char *topic, int topic_len)
+{
+    for (int i = 0; i < route_count; i++) {
+        if (routes[i].topic_len == topic_len && memcmp(routes[i].topic, topic, topic_len) == 0) {
+            return i;
+        }
+    }
+    return match_group(topic, topic_len);
+}
+
+const char *esl_router_topic(int route)
+{
+    if (route < 0 || route >= route_count) return NULL;
+
+    return routes[route].topic;
+}
+
+/**
+ * @brief Invokes the handler of a route with a complete payload.
+ */
+void esl_router_dispatch(int route, const uint8_t *data, int len)
+{
+    if (route < 0 || route >= route_count) {
+        ESP_LOGW(TAG_ROUTER, "No handler for route %d", route);
+        return;
+    }
+
+    routes[route].handler(data, len, routes[route].arg);
+}
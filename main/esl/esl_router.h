@@ -0,0 +1,24 @@
+#ifndef _ESL_ROUTER_H
+#define _ESL_ROUTER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#define ESL_ROUTER_MAX_ROUTES 16
+#define ESL_ROUTER_MAX_GROUPS 6
+#define ESL_ROUTER_TOPIC_LEN  64
+#define ESL_ROUTE_NONE        (-1)
+
+typedef void (*esl_route_handler_t)(const uint8_t *data, int len, void *arg);
+
+void esl_router_init(const char *prefix);
+int esl_router_register(const char *suffix, esl_route_handler_t handler, void *arg);
+int esl_router_register_shared(const char *suffix, esl_route_handler_t handler, void *arg);
+void esl_router_set_groups(const char *const *prefixes, int count);
+void esl_router_subscribe(esp_mqtt_client_handle_t client, int qos);
+int esl_router_match(const char *topic, int topic_len);
+const char *esl_router_topic(int route);
+void esl_router_dispatch(int route, const uint8_t *data, int len);
+
+#endif // _ESL_ROUTER_H
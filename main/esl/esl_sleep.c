@@ -0,0 +1,159 @@
+#include <sys/time.h>
+#include "esl_sleep.h"
+#include "esl_trace.h"
+#include "esl_ui.h"
+#include "esl_inflight.h"
+#include "esl_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_sleep.h"
+#include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG_SLEEP = "SLEEP";
+
+static RTC_DATA_ATTR uint32_t wake_count;
+
+static esp_mqtt_client_handle_t mqtt_client;
+static volatile int64_t mqtt_connected_us;
+static volatile int64_t last_activity_us;
+
+#if CONFIG_ESL_TRACE
+static RTC_DATA_ATTR int64_t slept_at_us;    // RTC wall clock when deep sleep was entered
+
+static int64_t rtc_now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+#endif
+
+/**
+ * @brief Logs why the chip booted. Call first thing in app_main.
+ */
+void esl_sleep_init(void)
+{
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER) {
+        wake_count++;
+        ESP_LOGI(TAG_SLEEP, "Woke from deep sleep (%lu wakes)", (unsigned long)wake_count);
+#if CONFIG_ESL_TRACE
+        // The sleep began before this boot, so its start is negative on this boot's clock
+        int64_t now = esp_timer_get_time();
+        esl_trace_record(ESL_SPAN_SLEEP, now - (rtc_now_us() - slept_at_us), now);
+#endif
+    } else {
+        wake_count = 0;
+    }
+}
+
+/**
+ * @brief Records the moment the MQTT session came up and reports wake-to-connected time.
+ */
+void esl_sleep_note_connected(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    if (mqtt_connected_us == 0) {
+        mqtt_connected_us = now;
+        ESP_LOGI(TAG_SLEEP, "Wake to Wi-Fi %lld ms, to MQTT %lld ms (%s)",
+                 esl_wifi_connected_us() / 1000, now / 1000,
+                 esl_wifi_fast_reconnect() ? "fast reconnect" : "full scan");
+    }
+    last_activity_us = now;
+}
+
+/**
+ * @brief Postpones sleep by the awake window, e.g. when an MQTT chunk arrives.
+ */
+void esl_sleep_note_activity(void)
+{
+    last_activity_us = esp_timer_get_time();
+}
+
+/**
+ * @brief Disconnects cleanly and enters deep sleep until the next check-in.
+ */
+void esl_sleep_enter(void)
+{
+#if CONFIG_ESL_DUTY_CYCLE
+    ESP_LOGI(TAG_SLEEP, "Sleeping for %d s after %lld ms awake",
+             CONFIG_ESL_DUTY_CYCLE_SLEEP_S, esp_timer_get_time() / 1000);
+
+    if (mqtt_client) {
+        // Acks and stats enqueued by the last commit are only in RAM until the broker has them
+        int64_t deadline = esp_timer_get_time() + (int64_t)CONFIG_ESL_DUTY_CYCLE_DRAIN_TIMEOUT_MS * 1000;
+        int outbox;
+        while (mqtt_connected_us != 0 && (outbox = esp_mqtt_client_get_outbox_size(mqtt_client)) > 0) {
+            if (esp_timer_get_time() > deadline) {
+                ESP_LOGW(TAG_SLEEP, "Sleeping with %d bytes unacknowledged in the outbox", outbox);
+                break;
+            }
+            vTaskDelay(pdMS_TO_TICKS(20));
+        }
+        esp_mqtt_client_stop(mqtt_client);
+    }
+    esp_wifi_stop();
+
+    esp_sleep_enable_timer_wakeup((uint64_t)CONFIG_ESL_DUTY_CYCLE_SLEEP_S * 1000000);
+#if CONFIG_ESL_TRACE
+    slept_at_us = rtc_now_us();
+#endif
+    esp_deep_sleep_start();
+#endif
+}
+
+#if CONFIG_ESL_DUTY_CYCLE
+static void sleep_task(void *arg)
+{
+    const int64_t awake_us = (int64_t)CONFIG_ESL_DUTY_CYCLE_AWAKE_MS * 1000;
+    const int64_t connect_timeout_us = (int64_t)CONFIG_ESL_DUTY_CYCLE_CONNECT_TIMEOUT_MS * 1000;
+    esl_inflight_stats_t inflight;
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(100));
+        int64_t now = esp_timer_get_time();
+
+        // Broker unreachable: give up for this cycle rather than drain the battery,
+        // but never cut power in the middle of the boot refresh
+        if (mqtt_connected_us == 0) {
+            if (now > connect_timeout_us && esl_ui_idle()) {
+                ESP_LOGW(TAG_SLEEP, "No MQTT connection after %lld ms", now / 1000);
+                esl_wifi_forget();
+                esl_sleep_enter();
+            }
+            continue;
+        }
+
+        if (now - last_activity_us < awake_us) continue;
+
+        // Never sleep in the middle of a message or a refresh
+        esl_inflight_get_stats(&inflight);
+        if (inflight.in_use > 0 || !esl_ui_idle()) continue;
+
+        esl_sleep_enter();
+    }
+}
+#endif
+
+/**
+ * @brief Starts the duty-cycle supervisor when CONFIG_ESL_DUTY_CYCLE is enabled.
+ *
+ * The tag stays awake for CONFIG_ESL_DUTY_CYCLE_AWAKE_MS after connecting or
+ * after the last received chunk, waits for pending refreshes, then sleeps for
+ * CONFIG_ESL_DUTY_CYCLE_SLEEP_S.
+ */
+esp_err_t esl_sleep_start(esp_mqtt_client_handle_t client)
+{
+    mqtt_client = client;
+
+#if CONFIG_ESL_DUTY_CYCLE
+    if (xTaskCreate(sleep_task, "esl_sleep", 3072, NULL, 3, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    return ESP_OK;
+}
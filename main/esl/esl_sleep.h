@@ -0,0 +1,14 @@
+#ifndef _ESL_SLEEP_H
+#define _ESL_SLEEP_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+void esl_sleep_init(void);
+esp_err_t esl_sleep_start(esp_mqtt_client_handle_t client);
+void esl_sleep_note_connected(void);
+void esl_sleep_note_activity(void);
+void esl_sleep_enter(void);
+
+#endif // _ESL_SLEEP_H
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <string.h>
+#include "esl_stats.h"
+#include "esl_ui.h"
+#include "esl_inflight.h"
+#include "esl_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+static const char *TAG_STATS = "STATS";
+
+// Collectors decode the record by offset, see the layout in README.md
+_Static_assert(sizeof(esl_stats_t) == 80, "esl_stats_t wire layout changed, bump ESL_STATS_VERSION");
+
+static esp_mqtt_client_handle_t mqtt_client;
+static const char *stats_topic;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t bytes_received;
+static uint32_t mqtt_reconnects;
+static int64_t batch_first_chunk_us;    // First chunk of the batch not yet reported, 0 if none
+static int64_t batch_last_done_us;
+static uint32_t last_receive_us;
+static uint32_t last_total_us;
+
+static TaskHandle_t task_commit;
+static TaskHandle_t task_mqtt;
+static TaskHandle_t task_sleep;
+
+static uint16_t stack_free(TaskHandle_t *handle, const char *name)
+{
+    if (*handle == NULL) {
+        *handle = xTaskGetHandle(name);
+        if (*handle == NULL) return 0;
+    }
+    return (uint16_t)uxTaskGetStackHighWaterMark(*handle);
+}
+
+static uint32_t clamp_ms(int64_t us)
+{
+    return us > 0 ? (uint32_t)(us / 1000) : 0;
+}
+
+/**
+ * @brief Records a fully reassembled message for the byte count and the receive phase.
+ *
+ * @param first_chunk_us esp_timer time of the message's chunk at offset 0
+ * @param len            Payload length
+ */
+void esl_stats_note_receive(int64_t first_chunk_us, int len)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&stats_lock);
+    bytes_received += len;
+    if (batch_first_chunk_us == 0 || first_chunk_us < batch_first_chunk_us) {
+        batch_first_chunk_us = first_chunk_us;
+    }
+    batch_last_done_us = now;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void esl_stats_note_mqtt_reconnect(void)
+{
+    portENTER_CRITICAL(&stats_lock);
+    mqtt_reconnects++;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+/**
+ * @brief Fills a stats record from the UI, reassembly pool, Wi-Fi and heap.
+ *
+ * An ESL_STATS_UPDATE record closes the receive window of the batch just
+ * committed, so call it once per commit.
+ *
+ * @param out    Record to fill
+ * @param reason Why the record is produced
+ */
+void esl_stats_collect(esl_stats_t *out, esl_stats_reason_t reason)
+{
+    esl_ui_stats_t ui;
+    esl_inflight_stats_t inflight;
+    wifi_ap_record_t ap;
+    int64_t low_latency_us;
+    int64_t now = esp_timer_get_time();
+
+    esl_ui_get_stats(&ui);
+    esl_inflight_get_stats(&inflight);
+
+    memset(out, 0, sizeof(*out));
+    out->version = ESL_STATS_VERSION;
+    out->reason = reason;
+    out->refresh_mode = ui.last_mode;
+    out->rssi = esp_wifi_sta_get_ap_info(&ap) == ESP_OK ? ap.rssi : 0;
+    out->uptime_s = (uint32_t)(now / 1000000);
+    out->updates = ui.updates;
+    out->refreshes = ui.refreshes;
+    out->wifi_reconnects = (uint16_t)esl_wifi_reconnects();
+    out->slots_exhausted = inflight.exhausted;
+    out->slots_evicted = inflight.evicted;
+    esl_wifi_power_stats(&out->ps_mode, &out->listen_interval, &low_latency_us);
+    out->low_latency_s = (uint32_t)(low_latency_us / 1000000);
+
+    portENTER_CRITICAL(&stats_lock);
+    if (reason == ESL_STATS_UPDATE && batch_first_chunk_us != 0) {
+        last_receive_us = (uint32_t)(batch_last_done_us - batch_first_chunk_us);
+        last_total_us = (uint32_t)(now - batch_first_chunk_us);
+        batch_first_chunk_us = 0;
+    }
+    out->bytes_received = bytes_received;
+    out->mqtt_reconnects = (uint16_t)mqtt_reconnects;
+    out->receive_ms = last_receive_us / 1000;
+    out->total_ms = last_total_us / 1000;
+    portEXIT_CRITICAL(&stats_lock);
+
+    out->decode_ms = clamp_ms(ui.last_decode_us);
+    out->wait_ms = clamp_ms(ui.last_wait_us);
+    out->spi_ms = clamp_ms(ui.last_spi_us);
+    out->refresh_ms = clamp_ms(ui.last_refresh_us);
+
+    out->heap_free = esp_get_free_heap_size();
+    out->heap_min_free = esp_get_minimum_free_heap_size();
+    out->heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    out->stack_commit = stack_free(&task_commit, "esl_commit");
+    out->stack_mqtt = stack_free(&task_mqtt, "mqtt_task");
+    out->stack_sleep = stack_free(&task_sleep, "esl_sleep");
+}
+
+/**
+ * @brief Queues a stats record on esl/<mac>/stats.
+ *
+ * The record is handed to the MQTT outbox rather than sent inline, so this
+ * never blocks on the network.
+ */
+void esl_stats_publish(esl_stats_reason_t reason)
+{
+    esl_stats_t stats;
+
+    if (mqtt_client == NULL) return;
+
+    esl_stats_collect(&stats, reason);
+    if (esp_mqtt_client_enqueue(mqtt_client, stats_topic, (const char *)&stats, sizeof(stats), 0, 0, true) < 0) {
+        ESP_LOGW(TAG_STATS, "Could not queue stats");
+    }
+}
+
+// Heaps and tasks covered by the memory report
+static const struct {
+    const char *name;
+    uint32_t caps;
+} report_heaps[] = {
+    { "internal", MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT },
+    { "dma",      MALLOC_CAP_DMA },
+    { "spiram",   MALLOC_CAP_SPIRAM },
+};
+
+static const char *report_tasks[] = {
+    "esl_commit", "esl_sleep", "esl_stats", "epd_boot", "mqtt_task", "tiT", "wifi", "sys_evt",
+};
+
+/**
+ * @brief Formats heap and stack watermarks as text, one heap or task per line.
+ *
+ * Heaps show total, free, lowest free since boot and largest block. Tasks show
+ * the stack they never used, the margin a stack size can be cut by.
+ *
+ * @return Length written, excluding the terminator
+ */
+int esl_stats_format_memory(char *buf, size_t len)
+{
+    size_t n = 0;
+
+#define APPEND(...) \
+    if (n < len) n += snprintf(buf + n, len - n, __VA_ARGS__)
+
+    APPEND("heap total free min_free largest\n");
+    for (size_t i = 0; i < sizeof(report_heaps) / sizeof(report_heaps[0]); i++) {
+        uint32_t caps = report_heaps[i].caps;
+        size_t total = heap_caps_get_total_size(caps);
+        if (total == 0) continue;
+        APPEND("%s %u %u %u %u\n", report_heaps[i].name, (unsigned)total, (unsigned)heap_caps_get_free_size(caps),
+               (unsigned)heap_caps_get_minimum_free_size(caps), (unsigned)heap_caps_get_largest_free_block(caps));
+    }
+
+    APPEND("task stack_unused\n");
+    for (size_t i = 0; i < sizeof(report_tasks) / sizeof(report_tasks[0]); i++) {
+        // Looked up every time, since tasks such as epd_boot delete themselves
+        TaskHandle_t task = xTaskGetHandle(report_tasks[i]);
+        if (task == NULL) continue;
+        APPEND("%s %u\n", report_tasks[i], (unsigned)uxTaskGetStackHighWaterMark(task));
+    }
+#undef APPEND
+
+    return n < len ? (int)n : (int)len - 1;
+}
+
+/**
+ * @brief Prints the memory report, see esl_stats_format_memory().
+ */
+void esl_stats_dump_memory(void)
+{
+    char buf[512];
+    esl_stats_format_memory(buf, sizeof(buf));
+
+    char *save = NULL;
+    for (char *line = strtok_r(buf, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        ESP_LOGI(TAG_STATS, "%s", line);
+    }
+}
+
+#if CONFIG_ESL_STATS_PERIOD_S > 0
+static void stats_task(void *arg)
+{
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_ESL_STATS_PERIOD_S * 1000));
+        esl_stats_publish(ESL_STATS_PERIODIC);
+    }
+}
+#endif
+
+/**
+ * @brief Starts publishing stats, and the periodic report when CONFIG_ESL_STATS_PERIOD_S is set.
+ *
+ * @param client MQTT client used for publishing
+ * @param topic  Full stats topic, must outlive the module
+ *
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the periodic task could not be created
+ */
+esp_err_t esl_stats_start(esp_mqtt_client_handle_t client, const char *topic)
+{
+    mqtt_client = client;
+    stats_topic = topic;
+
+#if CONFIG_ESL_STATS_PERIOD_S > 0
+    if (xTaskCreate(stats_task, "esl_stats", 3072, NULL, 2, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    return ESP_OK;
+}
@@ -0,0 +1,56 @@
+#ifndef _ESL_STATS_H
+#define _ESL_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "mqtt_client.h"
+
+#define ESL_STATS_VERSION   2
+
+typedef enum {
+    ESL_STATS_PERIODIC = 0,
+    ESL_STATS_UPDATE,           // Published right after a commit
+} esl_stats_reason_t;
+
+// Payload of esl/<mac>/stats, little-endian with no padding.
+// Durations are in milliseconds and describe the most recent committed batch.
+typedef struct __attribute__((packed)) {
+    uint8_t version;            // ESL_STATS_VERSION
+    uint8_t reason;             // esl_stats_reason_t
+    uint8_t refresh_mode;       // esl_refresh_mode_t of the last commit
+    int8_t rssi;                // dBm, 0 when not associated
+    uint32_t uptime_s;
+    uint32_t updates;           // Region payloads handled since boot
+    uint32_t refreshes;         // Panel refreshes since boot
+    uint32_t bytes_received;    // Complete payload bytes since boot
+    uint16_t wifi_reconnects;
+    uint16_t mqtt_reconnects;
+    uint32_t slots_exhausted;   // Messages dropped for lack of a reassembly slot
+    uint32_t slots_evicted;     // Reassembly slots timed out
+    uint32_t receive_ms;        // First chunk of the batch to its last complete message
+    uint32_t decode_ms;         // Drawing into the framebuffer
+    uint32_t wait_ms;           // Coalescing window after the last message
+    uint32_t spi_ms;            // Pushing both planes to the panel
+    uint32_t refresh_ms;        // Panel BUSY
+    uint32_t total_ms;          // First chunk to glass
+    uint32_t heap_free;
+    uint32_t heap_min_free;     // Lowest free heap since boot
+    uint32_t heap_largest;      // Largest allocatable block
+    uint16_t stack_commit;      // Unused stack of the commit task, in bytes
+    uint16_t stack_mqtt;        // Unused stack of the MQTT task, in bytes
+    uint16_t stack_sleep;       // Unused stack of the duty-cycle task, 0 when not running
+    uint8_t ps_mode;            // wifi_ps_type_t in effect, WIFI_PS_NONE while boosted
+    uint8_t listen_interval;    // Beacons between wakes in max modem sleep, 0 otherwise
+    uint32_t low_latency_s;     // Time spent boosted since boot
+} esl_stats_t;
+
+esp_err_t esl_stats_start(esp_mqtt_client_handle_t client, const char *topic);
+void esl_stats_note_receive(int64_t first_chunk_us, int len);
+void esl_stats_note_mqtt_reconnect(void);
+void esl_stats_collect(esl_stats_t *out, esl_stats_reason_t reason);
+void esl_stats_publish(esl_stats_reason_t reason);
+int esl_stats_format_memory(char *buf, size_t len);
+void esl_stats_dump_memory(void);
+
+#endif // _ESL_STATS_H
@@ -0,0 +1,44 @@
+#include <sys/time.h>
+#include "esl_time.h"
+#include "esp_sntp.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+// Anything earlier means the clock was never set since power-on
+#define TIME_VALID_AFTER    1704067200  // 2024-01-01T00:00:00Z
+
+static const char *TAG_TIME = "TIME";
+
+static esl_time_sync_cb_t sync_cb;
+
+static void on_time_sync(struct timeval *tv)
+{
+    ESP_LOGI(TAG_TIME, "Clock synchronized to %lld", (long long)tv->tv_sec);
+    if (sync_cb) sync_cb();
+}
+
+/**
+ * @brief Starts SNTP against CONFIG_ESL_SNTP_SERVER. Call once Wi-Fi is up.
+ *
+ * The RTC keeps counting through deep sleep, so after a wake the clock is
+ * usable before the first sync completes.
+ *
+ * @param on_sync Called from the network stack after every sync, may be NULL
+ */
+void esl_time_init(esl_time_sync_cb_t on_sync)
+{
+    sync_cb = on_sync;
+
+    esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, CONFIG_ESL_SNTP_SERVER);
+    sntp_set_time_sync_notification_cb(on_time_sync);
+    esp_sntp_init();
+}
+
+/**
+ * @brief Whether the wall clock has been set, by SNTP now or before the last deep sleep.
+ */
+bool esl_time_valid(void)
+{
+    return time(NULL) >= TIME_VALID_AFTER;
+}
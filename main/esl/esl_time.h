@@ -0,0 +1,12 @@
+#ifndef _ESL_TIME_H
+#define _ESL_TIME_H
+
+#include <stdbool.h>
+#include <time.h>
+
+typedef void (*esl_time_sync_cb_t)(void);
+
+void esl_time_init(esl_time_sync_cb_t on_sync);
+bool esl_time_valid(void);
+
+#endif // _ESL_TIME_H
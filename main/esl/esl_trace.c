@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include "esl_trace.h"
+
+#if CONFIG_ESL_TRACE
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#define TRACE_RING_SIZE CONFIG_ESL_TRACE_RING_SIZE
+
+static const char *TAG_TRACE = "TRACE";
+
+static const char *span_names[ESL_SPAN_COUNT] = {
+    [ESL_SPAN_WIFI_CONNECT]  = "wifi_connect",
+    [ESL_SPAN_MQTT_CONNECT]  = "mqtt_connect",
+    [ESL_SPAN_CHUNK_RECEIVE] = "chunk_receive",
+    [ESL_SPAN_DECODE]        = "decode",
+    [ESL_SPAN_SPI_PUSH_OLD]  = "spi_push_old",
+    [ESL_SPAN_SPI_PUSH_NEW]  = "spi_push_new",
+    [ESL_SPAN_REFRESH_BUSY]  = "refresh_busy",
+    [ESL_SPAN_SLEEP]         = "sleep",
+};
+
+static esl_trace_record_t ring[TRACE_RING_SIZE];
+static uint32_t ring_head;      // Total records ever written, the slot is head % size
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+
+const char *esl_trace_span_name(esl_span_t span)
+{
+    return span < ESL_SPAN_COUNT ? span_names[span] : "?";
+}
+
+/**
+ * @brief Appends a span to the trace ring, overwriting the oldest record when full.
+ *
+ * Safe to call from any task on either core.
+ */
+void esl_trace_record(esl_span_t span, int64_t start_us, int64_t end_us)
+{
+    esl_trace_record_t rec = {
+        .start_us = start_us,
+        .duration_us = (uint32_t)(end_us - start_us),
+        .span = (uint8_t)span,
+    };
+
+    portENTER_CRITICAL(&ring_lock);
+    ring[ring_head % TRACE_RING_SIZE] = rec;
+    ring_head++;
+    portEXIT_CRITICAL(&ring_lock);
+}
+
+static uint32_t snapshot(esl_trace_record_t *out)
+{
+    uint32_t count;
+
+    portENTER_CRITICAL(&ring_lock);
+    count = ring_head < TRACE_RING_SIZE ? ring_head : TRACE_RING_SIZE;
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = ring[(ring_head - count + i) % TRACE_RING_SIZE];
+    }
+    portEXIT_CRITICAL(&ring_lock);
+    return count;
+}
+
+/**
+ * @brief Logs every record in the ring, oldest first.
+ */
+void esl_trace_dump(void)
+{
+    static esl_trace_record_t records[TRACE_RING_SIZE];
+    uint32_t count = snapshot(records);
+
+    ESP_LOGI(TAG_TRACE, "%lu span(s)", (unsigned long)count);
+    for (uint32_t i = 0; i < count; i++) {
+        ESP_LOGI(TAG_TRACE, "%-14s start=%lld us dur=%lu us", esl_trace_span_name(records[i].span),
+                 records[i].start_us, (unsigned long)records[i].duration_us);
+    }
+}
+
+/**
+ * @brief Formats the ring as "name,start_us,duration_us" lines, oldest first.
+ *
+ * @param buf Output buffer
+ * @param len Buffer size, records that do not fit are left out
+ *
+ * @return Number of characters written, excluding the terminator
+ */
+int esl_trace_format(char *buf, size_t len)
+{
+    static esl_trace_record_t records[TRACE_RING_SIZE];
+    uint32_t count = snapshot(records);
+    size_t used = 0;
+
+    if (len == 0) return 0;
+    buf[0] = '\0';
+
+    for (uint32_t i = 0; i < count; i++) {
+        int n = snprintf(buf + used, len - used, "%s,%lld,%lu\n", esl_trace_span_name(records[i].span),
+                         records[i].start_us, (unsigned long)records[i].duration_us);
+        if (n < 0 || (size_t)n >= len - used) {
+            buf[used] = '\0';
+            break;
+        }
+        used += n;
+    }
+    return (int)used;
+}
+
+#endif // CONFIG_ESL_TRACE
@@ -0,0 +1,49 @@
+#ifndef _ESL_TRACE_H
+#define _ESL_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+typedef enum {
+    ESL_SPAN_WIFI_CONNECT = 0,
+    ESL_SPAN_MQTT_CONNECT,
+    ESL_SPAN_CHUNK_RECEIVE,
+    ESL_SPAN_DECODE,
+    ESL_SPAN_SPI_PUSH_OLD,
+    ESL_SPAN_SPI_PUSH_NEW,
+    ESL_SPAN_REFRESH_BUSY,
+    ESL_SPAN_SLEEP,
+    ESL_SPAN_COUNT
+} esl_span_t;
+
+typedef struct {
+    int64_t start_us;       // esp_timer time, negative for spans that began before this boot
+    uint32_t duration_us;
+    uint8_t span;
+} esl_trace_record_t;
+
+#if CONFIG_ESL_TRACE
+
+#include "esp_timer.h"
+
+void esl_trace_record(esl_span_t span, int64_t start_us, int64_t end_us);
+void esl_trace_dump(void);
+int esl_trace_format(char *buf, size_t len);
+const char *esl_trace_span_name(esl_span_t span);
+
+// Times the code between BEGIN and END in the same scope
+#define ESL_TRACE_BEGIN(name)       int64_t esl_trace_##name = esp_timer_get_time()
+#define ESL_TRACE_END(name, span)   esl_trace_record((span), esl_trace_##name, esp_timer_get_time())
+
+#else
+
+#define esl_trace_record(span, start_us, end_us)    ((void)0)
+#define esl_trace_dump()                            ((void)0)
+#define esl_trace_format(buf, len)                  (0)
+#define ESL_TRACE_BEGIN(name)                       ((void)0)
+#define ESL_TRACE_END(name, span)                   ((void)0)
+
+#endif // CONFIG_ESL_TRACE
+
+#endif // _ESL_TRACE_H
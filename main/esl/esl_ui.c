@@ -1 +1,414 @@
-#include "esl_ui.h"
\ No newline at end of file
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "esl_ui.h"
+#include "esl_layout.h"
+#include "esl_draw.h"
+#include "esl_cache.h"
+#include "esl_fbstore.h"
+#include "esl_trace.h"
+#include "esl_ack.h"
+#include "esl_time.h"
+#include "epd_display/epd_display.h"
+#include "epd_display/epd_graphics.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#define UI_READY_BIT        BIT0
+#define COALESCE_WINDOW_US  ((int64_t)CONFIG_ESL_COALESCE_WINDOW_MS * 1000)
+#define COALESCE_MAX_US     ((int64_t)CONFIG_ESL_COALESCE_MAX_LATENCY_MS * 1000)
+#define ACTIVATION_RECHECK_S    600     // Re-read the wall clock at least this often while waiting
+
+static const char *TAG_UI = "UI";
+
+static SemaphoreHandle_t fb_lock;       // Guards the framebuffer and the pending batch
+static EventGroupHandle_t ui_events;
+static TaskHandle_t commit_task_handle;
+static esl_ui_commit_cb_t on_commit;
+
+static uint8_t *commit_fb;              // Copy of the frame being pushed to the panel
+static bool refreshing;                 // commit_fb is on its way to glass, guarded by fb_lock
+
+static uint32_t pending;                // Region payloads since the last commit
+static int64_t first_update_us;
+static int64_t last_update_us;
+static int64_t batch_decode_us;         // Time spent drawing the pending batch
+static esl_ui_stats_t stats;
+
+// Frame staged for a scheduled activation, guarded by fb_lock
+static uint8_t *pending_fb;
+static volatile uint32_t pending_at;    // Unix time to go live
+static uint32_t pending_mask;           // Regions drawn for the activation
+static uint32_t pending_hash[ESL_LAYOUT_MAX_REGIONS];
+static esp_timer_handle_t activation_timer;
+static volatile bool activation_due;
+static uint32_t dispatch_activate_at;   // Activation time of the message being dispatched
+
+// Fires when the activation time is reached, re-checking the wall clock on long waits
+static void arm_activation(void)
+{
+    if (!esl_time_valid()) return;      // Re-armed from the time sync callback
+
+    int64_t remaining = (int64_t)pending_at - time(NULL);
+    if (remaining <= 0) {
+        activation_due = true;
+        xTaskNotifyGive(commit_task_handle);
+        return;
+    }
+
+    if (remaining > ACTIVATION_RECHECK_S) remaining = ACTIVATION_RECHECK_S;
+    esp_timer_stop(activation_timer);
+    esp_timer_start_once(activation_timer, (uint64_t)remaining * 1000000);
+}
+
+static void activation_timer_cb(void *arg)
+{
+    if (pending_at != 0) arm_activation();
+}
+
+// Moves the pending frame into the live framebuffer as one update. Call with fb_lock held.
+static void activate_pending(void)
+{
+    if (pending_fb == NULL) return;
+
+    ESP_LOGI(TAG_UI, "Activating frame scheduled for %lu", (unsigned long)pending_at);
+    memcpy(epd_fb.buffer, pending_fb, EPD_BUF_SIZE);
+    for (int region = 0; region < ESL_LAYOUT_MAX_REGIONS; region++) {
+        if (pending_mask & (1u << region)) esl_cache_set(region, pending_hash[region]);
+    }
+
+    free(pending_fb);
+    pending_fb = NULL;
+    pending_mask = 0;
+    pending_at = 0;
+
+    last_update_us = esp_timer_get_time();
+    if (pending++ == 0) {
+        first_update_us = last_update_us;
+    }
+}
+
+// Starts a pending frame from the live one. Regions already staged were acknowledged for
+// their time, so an update for another time waits until that frame has gone live.
+static esp_err_t stage_pending(uint32_t activate_at)
+{
+    if (pending_fb != NULL) {
+        return activate_at == pending_at ? ESP_OK : ESP_ERR_INVALID_STATE;
+    }
+
+    pending_fb = heap_caps_malloc(EPD_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    if (pending_fb == NULL) pending_fb = malloc(EPD_BUF_SIZE);
+    if (pending_fb == NULL) return ESP_ERR_NO_MEM;
+    memcpy(pending_fb, epd_fb.buffer, EPD_BUF_SIZE);
+    pending_mask = 0;
+    pending_at = activate_at;
+    return ESP_OK;
+}
+
+// Closes the pending batch and copies the frame to push. Call with fb_lock held.
+static bool commit_begin(esl_ack_batch_t *acks)
+{
+    bool refreshed = esl_cache_dirty();
+    int64_t start = esp_timer_get_time();
+
+    stats.last_wait_us = (uint32_t)(start - last_update_us);
+    stats.last_decode_us = (uint32_t)batch_decode_us;
+    stats.last_spi_us = 0;
+    stats.last_refresh_us = 0;
+    stats.last_mode = ESL_REFRESH_NONE;
+    batch_decode_us = 0;
+
+    if (refreshed) {
+        memcpy(commit_fb, epd_fb.buffer, EPD_BUF_SIZE);
+        esl_cache_snapshot();
+        refreshing = true;
+    } else {
+        ESP_LOGI(TAG_UI, "Content unchanged, skipping refresh");
+    }
+
+    // Still under the lock, so no later update is acknowledged with this batch
+    esl_ack_take(acks);
+
+    ESP_LOGI(TAG_UI, "Committing %lu update(s)", (unsigned long)pending);
+    stats.commits++;
+    stats.coalesced += pending - 1;
+    stats.last_batch = pending;
+    pending = 0;
+    return refreshed;
+}
+
+// Pushes the copied frame and refreshes the panel. Updates keep drawing into the
+// live framebuffer meanwhile, so fb_lock is only taken to record the timings.
+static uint32_t commit_push(void)
+{
+    epd_part_init();
+    int64_t pushed = esp_timer_get_time();
+    epd_display(commit_fb);
+    int64_t updated = esp_timer_get_time();
+    epd_update();
+    int64_t refreshed = esp_timer_get_time();
+    epd_deep_sleep();
+    esl_cache_commit();
+    esl_fbstore_save(commit_fb, EPD_BUF_SIZE);
+
+    xSemaphoreTake(fb_lock, portMAX_DELAY);
+    stats.last_spi_us = (uint32_t)(updated - pushed);
+    stats.last_refresh_us = (uint32_t)(refreshed - updated);
+    stats.last_mode = ESL_REFRESH_PARTIAL;
+    stats.refreshes++;
+    refreshing = false;
+    xSemaphoreGive(fb_lock);
+
+    return (uint32_t)((refreshed - pushed) / 1000);
+}
+
+/**
+ * @brief Waits for region updates and commits them once the coalescing window closes.
+ *
+ * The window closes when no update has arrived for CONFIG_ESL_COALESCE_WINDOW_MS,
+ * or CONFIG_ESL_COALESCE_MAX_LATENCY_MS after the first update of the batch,
+ * whichever comes first.
+ */
+static void commit_task(void *arg)
+{
+    static esl_ack_batch_t acks;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        for (;;) {
+            // A scheduled frame goes live at once, with whatever else is pending
+            if (activation_due) break;
+
+            xSemaphoreTake(fb_lock, portMAX_DELAY);
+            int64_t quiet_deadline = last_update_us + COALESCE_WINDOW_US;
+            int64_t max_deadline = first_update_us + COALESCE_MAX_US;
+            xSemaphoreGive(fb_lock);
+
+            int64_t deadline = quiet_deadline < max_deadline ? quiet_deadline : max_deadline;
+            int64_t now = esp_timer_get_time();
+            if (now >= deadline) break;
+
+            // A new update wakes us early to recompute the deadline
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((deadline - now) / 1000) + 1);
+        }
+
+        xSemaphoreTake(fb_lock, portMAX_DELAY);
+        if (activation_due) {
+            activation_due = false;
+            activate_pending();
+        }
+        uint32_t batch = pending;
+        bool refreshed = false;
+        if (batch > 0) {
+            refreshed = commit_begin(&acks);
+        }
+        xSemaphoreGive(fb_lock);
+
+        if (batch == 0) continue;
+
+        // Publishing waits for the MQTT client lock, which the MQTT task may hold while
+        // it waits for fb_lock in the region handler, so acks go out after the give
+        uint32_t refresh_ms = refreshed ? commit_push() : 0;
+        esl_ack_commit(&acks, refreshed, refresh_ms);
+        if (on_commit) {
+            on_commit(refreshed, batch);
+        }
+    }
+}
+
+/**
+ * @brief Starts the commit task.
+ *
+ * @param commit_cb Called from the commit task after each batch, e.g. to report status
+ *
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the task, lock or frame copy could not be created
+ */
+esp_err_t esl_ui_init(esl_ui_commit_cb_t commit_cb)
+{
+    on_commit = commit_cb;
+
+    fb_lock = xSemaphoreCreateMutex();
+    ui_events = xEventGroupCreate();
+    if (!fb_lock || !ui_events) return ESP_ERR_NO_MEM;
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = activation_timer_cb,
+        .name = "esl_activate",
+    };
+    if (esp_timer_create(&timer_args, &activation_timer) != ESP_OK) return ESP_ERR_NO_MEM;
+
+    commit_fb = heap_caps_malloc(EPD_BUF_SIZE, MALLOC_CAP_SPIRAM);
+    if (commit_fb == NULL) commit_fb = malloc(EPD_BUF_SIZE);
+    if (commit_fb == NULL) return ESP_ERR_NO_MEM;
+
+    if (xTaskCreate(commit_task, "esl_commit", 4096, NULL, 5, &commit_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Marks the messages dispatched until esl_ui_schedule_end() as scheduled.
+ *
+ * Called by the MQTT task around each dispatch with the activation time from
+ * the message header.
+ *
+ * @param activate_at Unix time the update goes live, 0 for immediately
+ */
+void esl_ui_schedule_begin(uint32_t activate_at)
+{
+    dispatch_activate_at = activate_at;
+}
+
+void esl_ui_schedule_end(void)
+{
+    dispatch_activate_at = 0;
+}
+
+/**
+ * @brief Re-arms the activation timer, e.g. once SNTP has set the clock.
+ */
+void esl_ui_schedule_rearm(void)
+{
+    if (pending_at != 0) arm_activation();
+}
+
+/**
+ * @brief Lets region updates through once the boot splash is composed and the panel is up.
+ *
+ * Updates received before this block in the handler, so they are drawn on top
+ * of the splash rather than under it.
+ */
+void esl_ui_set_ready(void)
+{
+    xEventGroupSetBits(ui_events, UI_READY_BIT);
+}
+
+/**
+ * @brief Router handler that draws a region payload into the framebuffer.
+ *
+ * Bitmap regions take a column-major 1-bpp payload, text regions a string drawn
+ * with the region font. Payloads identical to what is already on glass are not drawn.
+ *
+ * @param data Complete payload
+ * @param len  Payload length, must be w * ceil(h / 8) bytes for bitmap regions
+ * @param arg  Index of the region in the active layout
+ */
+void esl_ui_region_handler(const uint8_t *data, int len, void *arg)
+{
+    const esl_layout_t *layout = esl_layout_get();
+    int region = (int)(intptr_t)arg;
+    uint32_t hash = esl_cache_hash(data, len);
+    if (region < 0 || region >= layout->region_count) {
+        esl_ack_note(ESL_ACK_REJECTED, hash);
+        return;
+    }
+
+    const esl_region_desc_t *desc = &layout->regions[region];
+
+    int expected = desc->w * ((desc->h + 7) / 8);
+    if (desc->font == 0 && len != expected) {
+        ESP_LOGW(TAG_UI, "Ignoring %s: %d bytes, expected %d", desc->name, len, expected);
+        esl_ack_note(ESL_ACK_REJECTED, hash);
+        return;
+    }
+
+    // Until the clock is set every activation time counts as future
+    bool scheduled = dispatch_activate_at != 0 &&
+                     (!esl_time_valid() || (time_t)dispatch_activate_at > time(NULL));
+    if (scheduled && esl_time_valid() &&
+        (time_t)dispatch_activate_at - time(NULL) > CONFIG_ESL_SCHEDULE_MAX_AHEAD_S) {
+        ESP_LOGW(TAG_UI, "Ignoring %s: activation %lu is too far ahead", desc->name,
+                 (unsigned long)dispatch_activate_at);
+        esl_ack_note(ESL_ACK_REJECTED, hash);
+        return;
+    }
+
+    xEventGroupWaitBits(ui_events, UI_READY_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    xSemaphoreTake(fb_lock, portMAX_DELAY);
+
+    if (scheduled) {
+        esp_err_t err = stage_pending(dispatch_activate_at);
+        if (err == ESP_ERR_INVALID_STATE) {
+            uint32_t staged_at = pending_at;
+            xSemaphoreGive(fb_lock);
+            ESP_LOGW(TAG_UI, "Rejecting %s for %lu: a frame is already staged for %lu", desc->name,
+                     (unsigned long)dispatch_activate_at, (unsigned long)staged_at);
+            esl_ack_note(ESL_ACK_REJECTED, hash);
+            return;
+        }
+        if (err != ESP_OK) {
+            xSemaphoreGive(fb_lock);
+            ESP_LOGW(TAG_UI, "No memory for a pending frame, dropping %s", desc->name);
+            esl_ack_note(ESL_ACK_DROPPED, hash);
+            return;
+        }
+        esl_draw_region_into(pending_fb, desc, data, len);
+        pending_mask |= 1u << region;
+        pending_hash[region] = hash;
+        stats.updates++;
+        xSemaphoreGive(fb_lock);
+
+        ESP_LOGI(TAG_UI, "%s staged for %lu", desc->name, (unsigned long)dispatch_activate_at);
+        esl_ack_note(ESL_ACK_SCHEDULED, hash);
+        arm_activation();
+        return;
+    }
+
+    if (esl_cache_matches(region, hash)) {
+        ESP_LOGI(TAG_UI, "%s unchanged (hash=%08lx)", desc->name, (unsigned long)hash);
+        esl_ack_stage(ESL_ACK_UNCHANGED, hash);
+    } else {
+        int64_t decode_start = esp_timer_get_time();
+        esl_draw_region(desc, data, len);
+        int64_t decode_end = esp_timer_get_time();
+        esl_trace_record(ESL_SPAN_DECODE, decode_start, decode_end);
+        batch_decode_us += decode_end - decode_start;
+        esl_cache_set(region, hash);
+        esl_ack_stage(ESL_ACK_APPLIED, hash);
+
+        // Keep the pending frame current where the scheduled update leaves it alone
+        if (pending_fb != NULL && !(pending_mask & (1u << region))) {
+            esl_draw_region_into(pending_fb, desc, data, len);
+        }
+    }
+
+    last_update_us = esp_timer_get_time();
+    if (pending++ == 0) {
+        first_update_us = last_update_us;
+    }
+    stats.updates++;
+    xSemaphoreGive(fb_lock);
+
+    xTaskNotifyGive(commit_task_handle);
+}
+
+/**
+ * @brief Checks that no update is waiting for or undergoing a commit.
+ */
+bool esl_ui_idle(void)
+{
+    if (!(xEventGroupGetBits(ui_events) & UI_READY_BIT)) return false;
+
+    if (xSemaphoreTake(fb_lock, 0) != pdTRUE) return false;
+
+    // A pending frame must stay in RAM until it goes live
+    bool idle = pending == 0 && pending_fb == NULL && !refreshing;
+    xSemaphoreGive(fb_lock);
+    return idle;
+}
+
+void esl_ui_get_stats(esl_ui_stats_t *out)
+{
+    xSemaphoreTake(fb_lock, portMAX_DELAY);
+    *out = stats;
+    xSemaphoreGive(fb_lock);
+}
@@ -1,6 +1,11 @@
 #ifndef _ESL_UI_H
 #define _ESL_UI_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Geometry of the built-in layout, used until one is pushed to esl/<mac>/layout
 #define PRICE_X 265
 #define PRICE_Y 90
 #define PRICE_W 121
@@ -11,4 +16,34 @@
 #define DESC_W 215
 #define DESC_H 92
 
+typedef enum {
+    ESL_REFRESH_NONE = 0,   // Content unchanged, panel left alone
+    ESL_REFRESH_PARTIAL,
+    ESL_REFRESH_FULL,
+} esl_refresh_mode_t;
+
+typedef struct {
+    uint32_t updates;       // Region payloads handled
+    uint32_t commits;       // Coalesced batches committed
+    uint32_t refreshes;     // Commits that refreshed the panel
+    uint32_t coalesced;     // Region payloads merged into an earlier payload's commit
+    uint32_t last_batch;    // Region payloads in the most recent commit
+    uint8_t last_mode;      // esl_refresh_mode_t of the most recent commit
+    uint32_t last_decode_us;    // Drawing the batch into the framebuffer
+    uint32_t last_wait_us;      // Last update of the batch to commit start (coalescing window)
+    uint32_t last_spi_us;       // Pushing both planes to the panel
+    uint32_t last_refresh_us;   // Panel BUSY during the refresh
+} esl_ui_stats_t;
+
+typedef void (*esl_ui_commit_cb_t)(bool refreshed, uint32_t batch_size);
+
+esp_err_t esl_ui_init(esl_ui_commit_cb_t commit_cb);
+void esl_ui_set_ready(void);
+void esl_ui_region_handler(const uint8_t *data, int len, void *arg);
+void esl_ui_schedule_begin(uint32_t activate_at);
+void esl_ui_schedule_end(void);
+void esl_ui_schedule_rearm(void);
+bool esl_ui_idle(void);
+void esl_ui_get_stats(esl_ui_stats_t *stats);
+
 #endif // _ESL_UI_H
\ No newline at end of file
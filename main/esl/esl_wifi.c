@@ -0,0 +1,361 @@
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include "esl_wifi.h"
+#include "esl_trace.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_event.h"
+#include "esp_wifi.h"
+#include "esp_netif.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#if CONFIG_ESL_LIGHT_SLEEP
+#include "esp_pm.h"
+#endif
+
+#define WIFI_CONNECTED_BIT  BIT0
+#define WIFI_RTC_MAGIC      0x45534C57  // "ESLW"
+
+#ifdef CONFIG_ESL_WIFI_LEASE_REUSE_S
+#define WIFI_LEASE_REUSE_S  CONFIG_ESL_WIFI_LEASE_REUSE_S
+#else
+#define WIFI_LEASE_REUSE_S  0
+#endif
+
+#if CONFIG_ESL_WIFI_PS_MAX_MODEM
+#define WIFI_PS_POLICY          WIFI_PS_MAX_MODEM
+#define WIFI_LISTEN_INTERVAL    CONFIG_ESL_WIFI_LISTEN_INTERVAL
+#elif CONFIG_ESL_WIFI_PS_MIN_MODEM
+#define WIFI_PS_POLICY          WIFI_PS_MIN_MODEM
+#define WIFI_LISTEN_INTERVAL    0
+#else
+#define WIFI_PS_POLICY          WIFI_PS_NONE
+#define WIFI_LISTEN_INTERVAL    0
+#endif
+
+static const char *TAG_WIFI = "WIFI";
+
+// Association and lease of the last successful connection, kept across deep sleep
+typedef struct {
+    uint32_t magic;
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_dns_info_t dns;
+    time_t leased_at;
+} wifi_rtc_cache_t;
+
+static RTC_DATA_ATTR wifi_rtc_cache_t rtc_cache;
+
+static EventGroupHandle_t wifi_event_group;
+static esp_netif_t *sta_netif;
+static wifi_config_t wifi_config;
+static bool fast_reconnect;
+static bool static_ip;
+static int64_t connected_us;
+static int64_t connect_started_us;
+static uint32_t disconnects;
+
+static esp_timer_handle_t boost_timer;
+static portMUX_TYPE boost_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool boosted;
+static int64_t boost_started_us;
+static int64_t boost_total_us;          // Time spent in low-latency mode since boot
+#if CONFIG_ESL_LIGHT_SLEEP
+static esp_pm_lock_handle_t boost_pm_lock;
+#endif
+
+static time_t now_s(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec;
+}
+
+// Drops the cached association and goes back to a full scan with DHCP
+static void fall_back_to_scan(void)
+{
+    ESP_LOGW(TAG_WIFI, "Fast reconnect failed, doing full scan");
+    rtc_cache.magic = 0;
+    fast_reconnect = false;
+
+    wifi_config.sta.bssid_set = false;
+    wifi_config.sta.channel = 0;
+    wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+
+    if (static_ip) {
+        esp_netif_dhcpc_start(sta_netif);
+        static_ip = false;
+    }
+}
+
+// Ends a low-latency window and returns to the configured power-save policy
+static void boost_end(void *arg)
+{
+    portENTER_CRITICAL(&boost_lock);
+    bool was_boosted = boosted;
+    if (boosted) {
+        boost_total_us += esp_timer_get_time() - boost_started_us;
+        boosted = false;
+    }
+    portEXIT_CRITICAL(&boost_lock);
+    if (!was_boosted) return;
+
+    esp_wifi_set_ps(WIFI_PS_POLICY);
+#if CONFIG_ESL_LIGHT_SLEEP
+    esp_pm_lock_release(boost_pm_lock);
+#endif
+    ESP_LOGI(TAG_WIFI, "Low-latency mode ended");
+}
+
+// Applies the configured power-save policy once the station is up
+static void power_save_init(void)
+{
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_POLICY));
+
+#if CONFIG_ESL_LIGHT_SLEEP
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+        .light_sleep_enable = true,
+    };
+    ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "esl_boost", &boost_pm_lock));
+#endif
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = boost_end,
+        .name = "wifi_boost",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &boost_timer));
+}
+
+static void wifi_event_handler(void* arg, esp_event_base_t event_base,
+    int32_t event_id, void* event_data)
+{
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *) event_data;
+        memcpy(rtc_cache.bssid, event->bssid, sizeof(rtc_cache.bssid));
+        rtc_cache.channel = event->channel;
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
+        ESP_LOGI(TAG_WIFI, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+        ESP_LOGI(TAG_WIFI, "Gateway: " IPSTR, IP2STR(&event->ip_info.gw));
+
+        // Only a DHCP lease restarts the reuse period
+        if (!static_ip) {
+            rtc_cache.ip_info = event->ip_info;
+            esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &rtc_cache.dns);
+            rtc_cache.leased_at = now_s();
+        }
+        rtc_cache.magic = WIFI_RTC_MAGIC;
+
+        connected_us = esp_timer_get_time();
+        esl_trace_record(ESL_SPAN_WIFI_CONNECT, connect_started_us, connected_us);
+        xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        if (fast_reconnect && !(xEventGroupGetBits(wifi_event_group) & WIFI_CONNECTED_BIT)) {
+            fall_back_to_scan();
+        }
+        ESP_LOGI(TAG_WIFI, "Disconnected, retrying...");
+        disconnects++;
+        connect_started_us = esp_timer_get_time();
+        esp_wifi_connect();
+    }
+}
+
+/**
+ * @brief Connects to the access point in station mode.
+ *
+ * After a deep sleep wake with a cached association, the AP is joined by BSSID
+ * and channel without scanning, and the previous DHCP lease is reused as a
+ * static address while it is younger than CONFIG_ESL_WIFI_LEASE_REUSE_S.
+ * If that attempt fails, the station falls back to a full scan with DHCP.
+ *
+ * @param ssid       Network name
+ * @param password   Network password
+ * @param timeout_ms Time to wait for an IP address, 0 to wait forever
+ *
+ * @return ESP_OK once an IP address is obtained, ESP_ERR_TIMEOUT otherwise
+ */
+esp_err_t esl_wifi_init_sta(const char *ssid, const char *password, uint32_t timeout_ms)
+{
+    wifi_event_group = xEventGroupCreate();
+    connect_started_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG_WIFI, "Initializing Wi-Fi...");
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    sta_netif = esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    esp_event_handler_instance_t instance_any_id;
+    esp_event_handler_instance_t instance_got_ip;
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        ESP_EVENT_ANY_ID,
+                                                        &wifi_event_handler,
+                                                        NULL,
+                                                        &instance_any_id));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_GOT_IP,
+                                                        &wifi_event_handler,
+                                                        NULL,
+                                                        &instance_got_ip));
+
+    memset(&wifi_config, 0, sizeof(wifi_config));
+    wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+    wifi_config.sta.pmf_cfg.capable = true;
+    wifi_config.sta.pmf_cfg.required = false;
+
+    strncpy((char *)wifi_config.sta.ssid, ssid, sizeof(wifi_config.sta.ssid));
+    strncpy((char *)wifi_config.sta.password, password, sizeof(wifi_config.sta.password));
+    wifi_config.sta.listen_interval = WIFI_LISTEN_INTERVAL;
+
+    fast_reconnect = rtc_cache.magic == WIFI_RTC_MAGIC && esp_reset_reason() == ESP_RST_DEEPSLEEP;
+    if (fast_reconnect) {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, rtc_cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.channel = rtc_cache.channel;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+
+        if (WIFI_LEASE_REUSE_S > 0 && now_s() - rtc_cache.leased_at < WIFI_LEASE_REUSE_S) {
+            esp_netif_dhcpc_stop(sta_netif);
+            esp_netif_set_ip_info(sta_netif, &rtc_cache.ip_info);
+            esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &rtc_cache.dns);
+            static_ip = true;
+        }
+        ESP_LOGI(TAG_WIFI, "Fast reconnect on channel %d%s", rtc_cache.channel,
+                 static_ip ? " with cached lease" : "");
+    }
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_start());
+    power_save_init();
+
+    ESP_LOGI(TAG_WIFI, "Waiting for IP...");
+
+    EventBits_t bits = xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE,
+                                           timeout_ms ? pdMS_TO_TICKS(timeout_ms) : portMAX_DELAY);
+    if (!(bits & WIFI_CONNECTED_BIT)) {
+        ESP_LOGW(TAG_WIFI, "No IP after %lu ms", (unsigned long)timeout_ms);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    ESP_LOGI(TAG_WIFI, "Connected to Wi-Fi in %lld ms", connected_us / 1000);
+    return ESP_OK;
+}
+
+/**
+ * @brief Whether this boot reconnected from the RTC-cached association.
+ */
+bool esl_wifi_fast_reconnect(void)
+{
+    return fast_reconnect;
+}
+
+/**
+ * @brief Time from boot (or wake) to IP address, in microseconds.
+ */
+int64_t esl_wifi_connected_us(void)
+{
+    return connected_us;
+}
+
+/**
+ * @brief Number of disconnects from the AP since boot, each followed by a reconnect attempt.
+ */
+uint32_t esl_wifi_reconnects(void)
+{
+    return disconnects;
+}
+
+/**
+ * @brief Keeps the radio awake for low-latency delivery, then returns to the power-save policy.
+ *
+ * Disables modem sleep (and automatic light sleep when CONFIG_ESL_LIGHT_SLEEP is
+ * set) so queued chunks arrive without waiting for the next beacon. Calling it
+ * again while boosted extends the window.
+ *
+ * @param duration_ms Length of the low-latency window, 0 ends it now
+ */
+void esl_wifi_boost(uint32_t duration_ms)
+{
+    if (boost_timer == NULL) return;
+
+    esp_timer_stop(boost_timer);
+    if (duration_ms == 0) {
+        boost_end(NULL);
+        return;
+    }
+
+    portENTER_CRITICAL(&boost_lock);
+    bool was_boosted = boosted;
+    if (!boosted) {
+        boost_started_us = esp_timer_get_time();
+        boosted = true;
+    }
+    portEXIT_CRITICAL(&boost_lock);
+
+    if (!was_boosted) {
+#if CONFIG_ESL_LIGHT_SLEEP
+        esp_pm_lock_acquire(boost_pm_lock);
+#endif
+        esp_wifi_set_ps(WIFI_PS_NONE);
+        ESP_LOGI(TAG_WIFI, "Low-latency mode for %lu ms", (unsigned long)duration_ms);
+    }
+    esp_timer_start_once(boost_timer, (uint64_t)duration_ms * 1000);
+}
+
+/**
+ * @brief Router handler for esl/<mac>/boost.
+ *
+ * The payload is the window length in seconds as decimal text, empty for
+ * CONFIG_ESL_WIFI_BOOST_S and "0" to return to power save immediately.
+ */
+void esl_wifi_boost_handler(const uint8_t *data, int len, void *arg)
+{
+    char text[8];
+    uint32_t seconds = CONFIG_ESL_WIFI_BOOST_S;
+
+    if (len > 0 && len < (int)sizeof(text)) {
+        memcpy(text, data, len);
+        text[len] = '\0';
+        seconds = strtoul(text, NULL, 10);
+    }
+    esl_wifi_boost(seconds * 1000);
+}
+
+/**
+ * @brief Reports the active power-save mode and the total time spent boosted.
+ *
+ * @param ps_mode         Current wifi_ps_type_t
+ * @param listen_interval Configured listen interval in beacons, 0 when unused
+ * @param low_latency_us  Time in low-latency mode since boot, including the current window
+ */
+void esl_wifi_power_stats(uint8_t *ps_mode, uint8_t *listen_interval, int64_t *low_latency_us)
+{
+    portENTER_CRITICAL(&boost_lock);
+    *ps_mode = boosted ? WIFI_PS_NONE : WIFI_PS_POLICY;
+    *low_latency_us = boost_total_us + (boosted ? esp_timer_get_time() - boost_started_us : 0);
+    portEXIT_CRITICAL(&boost_lock);
+    *listen_interval = WIFI_LISTEN_INTERVAL;
+}
+
+/**
+ * @brief Invalidates the cached association so the next wake does a full scan.
+ */
+void esl_wifi_forget(void)
+{
+    rtc_cache.magic = 0;
+}
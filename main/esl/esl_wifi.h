@@ -0,0 +1,17 @@
+#ifndef _ESL_WIFI_H
+#define _ESL_WIFI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+esp_err_t esl_wifi_init_sta(const char *ssid, const char *password, uint32_t timeout_ms);
+bool esl_wifi_fast_reconnect(void);
+int64_t esl_wifi_connected_us(void);
+uint32_t esl_wifi_reconnects(void);
+void esl_wifi_boost(uint32_t duration_ms);
+void esl_wifi_boost_handler(const uint8_t *data, int len, void *arg);
+void esl_wifi_power_stats(uint8_t *ps_mode, uint8_t *listen_interval, int64_t *low_latency_us);
+void esl_wifi_forget(void);
+
+#endif // _ESL_WIFI_H
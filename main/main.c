@@ -1,14 +1,33 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "epd_display/epd_display.h"
 #include "epd_display/epd_graphics.h"
+#include "epd_display/epd_spi_trace.h"
 #include  "esl/esl_ui.h"
+#include "esl/esl_cache.h"
+#include "esl/esl_inflight.h"
+#include "esl/esl_router.h"
+#include "esl/esl_layout.h"
+#include "esl/esl_wifi.h"
+#include "esl/esl_sleep.h"
+#include "esl/esl_fbstore.h"
+#include "esl/esl_trace.h"
+#include "esl/esl_stats.h"
+#include "esl/esl_ack.h"
+#include "esl/esl_time.h"
+#include "esl/esl_groups.h"
+#include "esl/esl_mqtt.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
 #include "nvs_flash.h"
 #include "esp_event.h"
 #include "esp_wifi.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "mqtt_client.h"
 
 #include "esp_ping.h"
@@ -20,9 +39,8 @@
 #include "assets/hello_images.h"
 #include "assets/price_tag_image.h"
 
-#define WIFI_CONNECTED_BIT      BIT0
-#define MAX_INFLIGHT_MSGS       4
-#define MAX_MQTT_PAYLOAD_LEN    4096
+#define BOOT_DISPLAY_READY_BIT  BIT0
+#define BOOT_MQTT_CONNECTED_BIT BIT1
 
 #define STR(x) #x
 #define XSTR(x) STR(x)
@@ -31,209 +49,111 @@ const char* wifi_ssid = XSTR(WIFI_SSID);
 const char* wifi_pass = XSTR(WIFI_PASSWORD);
 const char* broker_addr = MQTT_BROKER;
 
-static const char *TAG_WIFI = "WIFI";
 static const char *TAG_MAIN = "MAIN";
 static const char *TAG_PING = "PING";
 
-static EventGroupHandle_t wifi_event_group;
+static EventGroupHandle_t boot_event_group;
 
 uint8_t fb[EPD_WIDTH * EPD_HEIGHT / 8];
 
 uint8_t mac[6];
 char mac_str[13];
-char topic_price[64];
-char topic_description[64];
-
-typedef struct {
-    bool in_use;
-    int msg_id;
-    int total_len;
-    int received_len;
-    char topic[64];
-    uint8_t data[MAX_MQTT_PAYLOAD_LEN];
-} inflight_msg_t;
-
-static inflight_msg_t inflight_msgs[MAX_INFLIGHT_MSGS] = {0};
-
-static inflight_msg_t *create_inflight_msg(int msg_id, const char *topic, int total_len)
+char topic_prefix[32];
+char topic_status[64];
+static char topic_stats[64];
+static char topic_memory[64];
+static char topic_ack[64];
+#if CONFIG_ESL_TRACE
+static char topic_trace[64];
+#endif
+#if CONFIG_ESL_SPI_TRACE
+static char topic_spi_trace[64];
+#endif
+char mqtt_client_id[24];
+
+static esp_mqtt_client_handle_t mqtt_client;
+static int64_t mqtt_connect_started_us;
+
+static void on_ui_commit(bool refreshed, uint32_t batch_size)
 {
-    for (int i = 0; i < MAX_INFLIGHT_MSGS; i++) {
-        if (!inflight_msgs[i].in_use) {
-            inflight_msgs[i].in_use = true;
-            inflight_msgs[i].msg_id = msg_id;
-            inflight_msgs[i].total_len = total_len;
-            inflight_msgs[i].received_len = 0;
-            memset(inflight_msgs[i].topic, 0, sizeof(inflight_msgs[i].topic));
-            strncpy(inflight_msgs[i].topic, topic, sizeof(inflight_msgs[i].topic) - 1);
-            return &inflight_msgs[i];
-        }
-    }
-    return NULL;
+    ESP_LOGI(TAG_MAIN, "%s after %lu update(s)", refreshed ? "Refreshed" : "Unchanged", (unsigned long)batch_size);
+    esp_mqtt_client_publish(mqtt_client, topic_status, refreshed ? "updated" : "unchanged", 0, 0, 0);
+    esl_stats_publish(ESL_STATS_UPDATE);
 }
 
-static inflight_msg_t *find_inflight_msg(int msg_id)
+#if CONFIG_ESL_TRACE
+/**
+ * @brief Publishes the trace ring to esl/<mac>/trace, one "span,start_us,duration_us" line per record.
+ */
+static void on_trace_request(const uint8_t *data, int len, void *arg)
 {
-    for (int i = 0; i < MAX_INFLIGHT_MSGS; i++) {
-        if (inflight_msgs[i].in_use && inflight_msgs[i].msg_id == msg_id) {
-            return &inflight_msgs[i];
-        }
+    char *buf = malloc(CONFIG_ESL_TRACE_RING_SIZE * 48);
+    if (buf == NULL) {
+        ESP_LOGW(TAG_MAIN, "No memory for trace dump");
+        return;
     }
-    return NULL;
+    int n = esl_trace_format(buf, CONFIG_ESL_TRACE_RING_SIZE * 48);
+    esp_mqtt_client_publish(mqtt_client, topic_trace, buf, n, 0, 0);
+    free(buf);
+    esl_trace_dump();
 }
+#endif
 
-static void finish_inflight_msg(inflight_msg_t *msg)
+/**
+ * @brief Publishes the heap and stack watermark report to esl/<mac>/stats/memory and prints it.
+ */
+static void on_memory_request(const uint8_t *data, int len, void *arg)
 {
-    msg->in_use = false;
+    char buf[512];
+    int n = esl_stats_format_memory(buf, sizeof(buf));
+    esp_mqtt_client_enqueue(mqtt_client, topic_memory, buf, n, 0, 0, true);
+    esl_stats_dump_memory();
 }
 
-static void wifi_event_handler(void* arg, esp_event_base_t event_base,
-    int32_t event_id, void* event_data)
+#if CONFIG_ESL_SPI_TRACE
+/**
+ * @brief Publishes the panel SPI trace to esl/<mac>/trace/spi and prints it, for host/spi/epd_spi_analyze.
+ */
+static void on_spi_trace_request(const uint8_t *data, int len, void *arg)
 {
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-        ESP_LOGI(TAG_WIFI, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
-        ESP_LOGI(TAG_WIFI, "Gateway: " IPSTR, IP2STR(&event->ip_info.gw));
-        xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
-    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        ESP_LOGI(TAG_WIFI, "Disconnected, retrying...");
-        esp_wifi_connect();
+    size_t size = epd_spi_trace_format_size();
+    char *buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (buf == NULL) buf = malloc(size);
+    if (buf == NULL) {
+        ESP_LOGW(TAG_MAIN, "No memory for SPI trace dump");
+        return;
     }
+    int n = epd_spi_trace_format(buf, size);
+    esp_mqtt_client_enqueue(mqtt_client, topic_spi_trace, buf, n, 0, 0, true);
+    free(buf);
+    epd_spi_trace_dump();
 }
-
-void wifi_init_sta(void)
-{
-    wifi_event_group = xEventGroupCreate();
-
-    ESP_LOGI(TAG_WIFI, "Initializing Wi-Fi...");
-
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
-
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &wifi_event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &wifi_event_handler,
-                                                        NULL,
-                                                        &instance_got_ip));
-
-    wifi_config_t wifi_config = {
-        .sta = {
-            .threshold.authmode = WIFI_AUTH_WPA2_PSK,
-            .pmf_cfg = {
-                .capable = true,
-                .required = false
-            },
-        },
-    };
-
-    strncpy((char *)wifi_config.sta.ssid, wifi_ssid, sizeof(wifi_config.sta.ssid));
-    strncpy((char *)wifi_config.sta.password, wifi_pass, sizeof(wifi_config.sta.password));
-
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
-
-    ESP_LOGI(TAG_WIFI, "Waiting for IP...");
-
-    xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT,
-                        pdFALSE, pdTRUE, portMAX_DELAY);
-
-    ESP_LOGI(TAG_WIFI, "Connected to Wi-Fi");
-}
-
-bool price_received = false;
-bool description_received = false;
+#endif
 
 void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) {
     esp_mqtt_event_handle_t event = event_data;
 
     switch ((esp_mqtt_event_id_t)event_id) {
         case MQTT_EVENT_CONNECTED:
-            ESP_LOGI("MQTT", "Connected to broker");
-            esp_mqtt_client_subscribe(event->client, topic_price, 0);
-            esp_mqtt_client_subscribe(event->client, topic_description, 0);
+            ESP_LOGI("MQTT", "Connected to broker (session %s)", event->session_present ? "resumed" : "new");
+            esl_sleep_note_connected();
+            xEventGroupSetBits(boot_event_group, BOOT_MQTT_CONNECTED_BIT);
+            esl_trace_record(ESL_SPAN_MQTT_CONNECT, mqtt_connect_started_us, esp_timer_get_time());
+            // Subscriptions survive in a resumed session, resubscribing is harmless
+            esl_router_subscribe(event->client, CONFIG_ESL_MQTT_SUBSCRIBE_QOS);
             break;
 
-        case MQTT_EVENT_DATA: {
-            // If this chunk has a topic (offset==0), create a new inflight slot
-            inflight_msg_t *msg = NULL;
-        
-            if (event->current_data_offset == 0 && event->topic_len > 0) {
-                // Extract the topic into a null-terminated string
-                char topic_str[64];
-                snprintf(topic_str, sizeof(topic_str), "%.*s", event->topic_len, event->topic);
-        
-                // Create a new inflight message for this msg_id
-                msg = create_inflight_msg(event->msg_id, topic_str, event->total_data_len);
-                if (msg) {
-                    ESP_LOGI("MQTT", "📥 Start receiving %s (%d bytes) [msg_id=%d]",
-                                msg->topic, msg->total_len, msg->msg_id);
-                } else {
-                    ESP_LOGW("MQTT", "No free inflight slots for msg_id=%d", event->msg_id);
-                    break;
-                }
-            } else {
-                // It's a subsequent chunk. Find existing message by msg_id
-                msg = find_inflight_msg(event->msg_id);
-                if (!msg) {
-                    ESP_LOGW("MQTT", "Unknown msg_id=%d for chunk offset=%d", event->msg_id, event->current_data_offset);
-                    break;
-                }
-            }
-        
-            // Append this chunk's data
-            if (msg->received_len + event->data_len <= msg->total_len && msg->received_len + event->data_len < MAX_MQTT_PAYLOAD_LEN) {
-                memcpy(&msg->data[event->current_data_offset], event->data, event->data_len);
-                msg->received_len += event->data_len;
-            } else {
-                ESP_LOGW("MQTT", "Overflow in msg_id=%d, ignoring chunk!", event->msg_id);
-                break;
-            }
-        
-            // Check if this was the final chunk
-            if (event->current_data_offset + event->data_len == msg->total_len) {
-                ESP_LOGI("MQTT", "✅ Received full %s (%d bytes) [msg_id=%d]", msg->topic, msg->received_len, msg->msg_id);
-        
-                // Decide where to draw
-                // ...
-                if (strstr(msg->topic, "price")) {
-                    epd_draw_bin_image(msg->data, PRICE_X, PRICE_Y, PRICE_W, PRICE_H);
-                    price_received = true;
-                } else if (strstr(msg->topic, "description")) {
-                    epd_draw_bin_image(msg->data, DESC_X, DESC_Y, DESC_W, DESC_H);
-                    description_received = true;
-                }
-
-                // Mark inflight slot free
-                finish_inflight_msg(msg);
-
-                if(price_received && description_received) {
-                    epd_part_init();
-                    epd_display(fb);
-                    epd_update();
-                    epd_deep_sleep();
-                    price_received = false;
-                    description_received = false;
-                }
-            }
-        
+        case MQTT_EVENT_DATA:
+            esl_sleep_note_activity();
+            esl_mqtt_handle_data(event);
             break;
-        }
 
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGW("MQTT", "Disconnected");
+            esl_stats_note_mqtt_reconnect();
+            mqtt_connect_started_us = esp_timer_get_time();
+            // Partially received payloads will never complete
+            esl_inflight_reclaim(true);
             break;
 
         default:
@@ -284,6 +204,64 @@ void ping_test(const char *ip)
     ESP_ERROR_CHECK(esp_ping_start(ping));
 }
 
+static void compose_splash(void)
+{
+    epd_clear_buffer(WHITE);
+    epd_draw_image(0, 0, 416, 240, price_tag_empty_rotated, WHITE);
+    epd_draw_string(70, 213, mac_str, 16, BLACK);
+}
+
+static void display_boot_task(void *arg)
+{
+    bool restored = (bool)(intptr_t)arg;
+    bool condition = false;
+
+#if CONFIG_ESL_BOOT_CONDITION_ALWAYS
+    condition = true;
+#elif CONFIG_ESL_BOOT_CONDITION_UNKNOWN
+    condition = !restored;
+#endif
+
+    epd_spi_init();
+
+    epd_gpio_init();
+    epd_enable_power();
+
+    if (restored) {
+        // The panel already shows fb, the next update is a partial refresh against it
+        epd_set_old_image(fb);
+    } else {
+        compose_splash();
+    }
+
+    if (restored && !condition) {
+        ESP_LOGI(TAG_MAIN, "UC8253 EPD resumed with content on glass.");
+    } else {
+        epd_fast_init();
+        if (condition) {
+            // Conditioning pass to white, against ghosting from unknown or aged content
+            epd_clear();
+            epd_update();
+        }
+        epd_display(fb);
+        epd_update();
+        epd_deep_sleep();
+
+        if (!restored) {
+            // The splash replaced whatever regions were on glass
+            esl_cache_invalidate();
+        }
+        esl_fbstore_save(fb, sizeof(fb));
+
+        ESP_LOGI(TAG_MAIN, "UC8253 EPD Initialized with %d refresh(es).", condition ? 2 : 1);
+    }
+
+    // Region updates that arrived meanwhile were held back until now
+    esl_ui_set_ready();
+    xEventGroupSetBits(boot_event_group, BOOT_DISPLAY_READY_BIT);
+    vTaskDelete(NULL);
+}
+
 void app_main(void) {
     ESP_LOGI(TAG_MAIN, "Initializing ESL E-Paper Display...");
 
@@ -291,8 +269,72 @@ void app_main(void) {
     ESP_LOGI("WIFI", "PASS: %s", wifi_pass);
     ESP_LOGI("WIFI", "BROKER: %s", broker_addr);
 
+    esl_sleep_init();
+    boot_event_group = xEventGroupCreate();
+
     ESP_ERROR_CHECK(nvs_flash_init());
-    wifi_init_sta();
+    esl_cache_init();
+    esl_layout_init();
+
+    // The MAC is read from eFuse, Wi-Fi does not need to be up
+    ESP_ERROR_CHECK(esp_read_mac(mac, ESP_MAC_WIFI_STA));
+    snprintf(mac_str, sizeof(mac_str),
+         "%02x%02x%02x%02x%02x%02x",
+         mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    
+    snprintf(topic_prefix, sizeof(topic_prefix), "esl/%s", mac_str);
+    snprintf(topic_status, sizeof(topic_status), "%s/status", topic_prefix);
+    snprintf(topic_stats, sizeof(topic_stats), "%s/stats", topic_prefix);
+    snprintf(topic_memory, sizeof(topic_memory), "%s/stats/memory", topic_prefix);
+    snprintf(topic_ack, sizeof(topic_ack), "%s/ack", topic_prefix);
+#if CONFIG_ESL_TRACE
+    snprintf(topic_trace, sizeof(topic_trace), "%s/trace", topic_prefix);
+#endif
+#if CONFIG_ESL_SPI_TRACE
+    snprintf(topic_spi_trace, sizeof(topic_spi_trace), "%s/trace/spi", topic_prefix);
+#endif
+
+    const esl_layout_t *layout = esl_layout_get();
+    esl_router_init(topic_prefix);
+    esl_router_register("layout", esl_layout_handler, NULL);
+    esl_router_register("groups", esl_groups_handler, NULL);
+    esl_router_register_shared("boost", esl_wifi_boost_handler, NULL);
+    esl_router_register("stats/memory/get", on_memory_request, NULL);
+#if CONFIG_ESL_TRACE
+    esl_router_register("trace/get", on_trace_request, NULL);
+#endif
+#if CONFIG_ESL_SPI_TRACE
+    esl_router_register("trace/spi/get", on_spi_trace_request, NULL);
+#endif
+    // Region updates are also accepted on esl/group/<sku>/<region> and esl/store/<id>/<region>
+    for (int i = 0; i < layout->region_count; i++) {
+        esl_router_register_shared(layout->regions[i].name, esl_ui_region_handler, (void *)(intptr_t)i);
+    }
+    esl_groups_init();
+
+    // Region updates draw into fb, so it must hold what is on glass before MQTT starts
+    epd_set_buffer(fb, EPD_WIDTH, EPD_HEIGHT, EPD_ROTATE_0, WHITE);
+    bool restored = esl_fbstore_restore(fb, sizeof(fb));
+
+    ESP_ERROR_CHECK(esl_inflight_init());
+    ESP_ERROR_CHECK(esl_ui_init(on_ui_commit));
+
+    // Bring up the panel on the app core while this core associates with the AP
+    xTaskCreatePinnedToCore(display_boot_task, "epd_boot", 4096, (void *)(intptr_t)restored, 5, NULL, 1);
+
+#if CONFIG_ESL_DUTY_CYCLE
+    if (esl_wifi_init_sta(wifi_ssid, wifi_pass, CONFIG_ESL_DUTY_CYCLE_CONNECT_TIMEOUT_MS) != ESP_OK) {
+        // Never cut power in the middle of the boot refresh
+        xEventGroupWaitBits(boot_event_group, BOOT_DISPLAY_READY_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+        esl_wifi_forget();
+        esl_sleep_enter();
+    }
+#else
+    esl_wifi_init_sta(wifi_ssid, wifi_pass, 0);
+#endif
+
+    // Scheduled updates wait for the clock, a sync re-arms their activation
+    esl_time_init(esl_ui_schedule_rearm);
 
     esp_netif_ip_info_t ip_info;
     esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
@@ -302,42 +344,33 @@ void app_main(void) {
         ESP_LOGI("NETIF", "Netmask: " IPSTR, IP2STR(&ip_info.netmask));
     }
 
-    ESP_ERROR_CHECK(esp_read_mac(mac, ESP_MAC_WIFI_STA));
-    snprintf(mac_str, sizeof(mac_str),
-         "%02x%02x%02x%02x%02x%02x",
-         mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-    
-    snprintf(topic_price, sizeof(topic_price), "esl/%s/price", mac_str);
-    snprintf(topic_description, sizeof(topic_description), "esl/%s/description", mac_str);
-
     // ping_test("test.mosquitto.org");
 
+    // A stable client ID lets the broker queue updates while the tag sleeps
+    snprintf(mqtt_client_id, sizeof(mqtt_client_id), "esl-%s", mac_str);
+
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = broker_addr,
+        .credentials.client_id = mqtt_client_id,
+#if CONFIG_ESL_MQTT_PERSISTENT_SESSION
+        .session.disable_clean_session = true,
+#endif
     };
 
-    esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
-    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
-    esp_mqtt_client_start(client);
-
-    epd_set_buffer(fb, EPD_WIDTH, EPD_HEIGHT, EPD_ROTATE_0, WHITE);
-    epd_clear_buffer(WHITE);
-
-    epd_spi_init();
-
-    epd_gpio_init();
-    epd_enable_power();
-
-    epd_fast_init();
-    epd_clear();
-    epd_update();
-    epd_display(fb);
-    epd_update();
-    epd_draw_image(0, 0, 416, 240, price_tag_empty_rotated, WHITE);
-    epd_draw_string(70, 213, mac_str, 16, BLACK);
-    epd_display(fb);
-    epd_update();
-    epd_deep_sleep();
-
-    ESP_LOGI(TAG_MAIN, "UC8253 EPD Initialized and Cleared.");
-}
\ No newline at end of file
+    mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
+    esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    // A queued QoS 1 update can arrive right after connecting and must find the ack topic set
+    ESP_ERROR_CHECK(esl_stats_start(mqtt_client, topic_stats));
+    ESP_ERROR_CHECK(esl_ack_init(mqtt_client, topic_ack));
+    mqtt_connect_started_us = esp_timer_get_time();
+    esp_mqtt_client_start(mqtt_client);
+    ESP_ERROR_CHECK(esl_sleep_start(mqtt_client));
+
+    // Readiness barrier: both halves of the boot must finish before the tag is ready
+    xEventGroupWaitBits(boot_event_group, BOOT_DISPLAY_READY_BIT | BOOT_MQTT_CONNECTED_BIT,
+                        pdFALSE, pdTRUE, portMAX_DELAY);
+    ESP_LOGI(TAG_MAIN, "Ready for updates after %lld ms", esp_timer_get_time() / 1000);
+    esl_trace_dump();
+    epd_spi_trace_dump();
+    esl_stats_dump_memory();
+}
@@ -0,0 +1,210 @@
+# Per-symbol RAM/flash/RTC budget of a static library, compared with a committed baseline.
+#
+#   cmake -DOBJDUMP=<objdump> -DARCHIVE=<libmain.a> -DREPORT=<out.txt> -DBASELINE=<memory_budget.txt>
+#         [-DRAM_SLACK=bytes] [-DFLASH_SLACK=bytes] [-DRTC_SLACK=bytes] [-DRTC_LIMIT=bytes]
+#         [-DUPDATE=ON] [-DREQUIRE_BASELINE=ON] -P memory_budget.cmake
+#
+# Sizes come from the symbol table of the archive, before the linker drops
+# unused sections, and are classed by the output section the symbol is in:
+# .rtc* is RTC memory, .iram* and .dram* are internal RAM loaded from flash,
+# .bss/.data internal RAM, .text/.literal/.rodata and .flash.* flash, and
+# .ext_ram* PSRAM, listed but not budgeted. Fails when RAM, flash or RTC grew
+# by more than its slack over the baseline, when RTC memory is over
+# RTC_LIMIT, or when there is no baseline and REQUIRE_BASELINE is ON;
+# UPDATE=ON writes the report as the new baseline.
+
+foreach(var OBJDUMP ARCHIVE REPORT BASELINE)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "memory_budget: ${var} is not set")
+    endif()
+endforeach()
+if(NOT DEFINED RAM_SLACK)
+    set(RAM_SLACK 256)
+endif()
+if(NOT DEFINED FLASH_SLACK)
+    set(FLASH_SLACK 1024)
+endif()
+if(NOT DEFINED RTC_SLACK)
+    set(RTC_SLACK 0)
+endif()
+if(NOT DEFINED RTC_LIMIT)
+    set(RTC_LIMIT 8192)
+endif()
+
+execute_process(
+    COMMAND ${OBJDUMP} -t ${ARCHIVE}
+    OUTPUT_VARIABLE objdump_output
+    RESULT_VARIABLE objdump_result
+)
+if(NOT objdump_result EQUAL 0)
+    message(FATAL_ERROR "memory_budget: ${OBJDUMP} failed on ${ARCHIVE}")
+endif()
+
+# objdump prints "<object>:     file format ..." before the symbols of every object
+# in the archive, then one "<value> <flags> <section>\t<size> <name>" line per symbol
+string(REPLACE "\n" ";" objdump_lines "${objdump_output}")
+set(entries)
+set(object "?")
+set(ram 0)
+set(flash 0)
+set(rtc 0)
+foreach(line IN LISTS objdump_lines)
+    if(line MATCHES "^(.+):[ \t]+file format")
+        set(object "${CMAKE_MATCH_1}")
+        continue()
+    endif()
+    # Functions and data objects only, not section, file or debug symbols
+    if(NOT line MATCHES "^[0-9a-fA-F]+ ......[FO] ([^\t ]+)\t([0-9a-fA-F]+) (.+)$")
+        continue()
+    endif()
+    set(section "${CMAKE_MATCH_1}")
+    math(EXPR size "0x${CMAKE_MATCH_2}")
+    set(symbol "${CMAKE_MATCH_3}")
+    if(size EQUAL 0)
+        continue()
+    endif()
+
+    if(section MATCHES "^\\.rtc")
+        set(class rtc)
+        math(EXPR rtc "${rtc} + ${size}")
+    elseif(section MATCHES "^\\.iram")
+        set(class iram)
+        math(EXPR ram "${ram} + ${size}")
+        math(EXPR flash "${flash} + ${size}")
+    elseif(section MATCHES "^\\.dram")
+        set(class dram)
+        math(EXPR ram "${ram} + ${size}")
+        math(EXPR flash "${flash} + ${size}")
+    elseif(section MATCHES "^\\.ext_ram")
+        set(class psram)
+    elseif(section MATCHES "^\\.flash\\.text")
+        set(class text)
+        math(EXPR flash "${flash} + ${size}")
+    elseif(section MATCHES "^\\.flash\\.")
+        set(class rodata)
+        math(EXPR flash "${flash} + ${size}")
+    elseif(section MATCHES "^\\.s?bss|^\\.noinit|^\\*COM\\*$")
+        set(class bss)
+        math(EXPR ram "${ram} + ${size}")
+    elseif(section MATCHES "^\\.s?data")
+        set(class data)
+        math(EXPR ram "${ram} + ${size}")
+        math(EXPR flash "${flash} + ${size}")
+    elseif(section MATCHES "^\\.(text|literal)")
+        set(class text)
+        math(EXPR flash "${flash} + ${size}")
+    elseif(section MATCHES "^\\.s?rodata")
+        set(class rodata)
+        math(EXPR flash "${flash} + ${size}")
+    else()
+        continue()
+    endif()
+
+# Zero-padded so a plain string sort orders by size
+    string(LENGTH "${size}" digits)
+    math(EXPR pad "10 - ${digits}")
+    string(REPEAT "0" ${pad} zeros)
+    list(APPEND entries "${zeros}${size} ${class} ${object} ${symbol}")
+endforeach()
+list(SORT entries ORDER DESCENDING)
+
+set(report "# Memory budget of ${ARCHIVE}, per symbol in bytes\n")
+string(APPEND report "total ram ${ram} flash ${flash} rtc ${rtc}\n")
+foreach(entry IN LISTS entries)
+    string(REGEX REPLACE "^0*([0-9]+) " "\\1 " entry "${entry}")
+    string(APPEND report "${entry}\n")
+endforeach()
+file(WRITE ${REPORT} "${report}")
+
+if(UPDATE)
+    file(WRITE ${BASELINE} "${report}")
+    message(STATUS "memory_budget: baseline ${BASELINE} updated, ram ${ram} B, flash ${flash} B, rtc ${rtc} B")
+    return()
+endif()
+
+# RTC memory has a fixed size, so it is checked with or without a baseline
+if(rtc GREATER RTC_LIMIT)
+    message(FATAL_ERROR "memory_budget: RTC memory is ${rtc} B, more than the ${RTC_LIMIT} B available")
+endif()
+
+if(NOT EXISTS ${BASELINE})
+    if(REQUIRE_BASELINE)
+        set(level FATAL_ERROR)
+    else()
+        set(level WARNING)
+    endif()
+    message(${level} "memory_budget: no baseline at ${BASELINE}, create it with the memory_budget_update target "
+                     "and commit it. Now: ram ${ram} B, flash ${flash} B, rtc ${rtc} B")
+    return()
+endif()
+
+# Index the baseline by class, object and symbol
+file(STRINGS ${BASELINE} baseline_lines)
+set(base_keys)
+foreach(line IN LISTS baseline_lines)
+    if(line MATCHES "^total ram ([0-9]+) flash ([0-9]+) rtc ([0-9]+)$")
+        set(base_ram ${CMAKE_MATCH_1})
+        set(base_flash ${CMAKE_MATCH_2})
+        set(base_rtc ${CMAKE_MATCH_3})
+    elseif(line MATCHES "^([0-9]+) ([a-z]+ .+)$")
+        set("base_${CMAKE_MATCH_2}" ${CMAKE_MATCH_1})
+        list(APPEND base_keys "${CMAKE_MATCH_2}")
+    endif()
+endforeach()
+if(NOT DEFINED base_ram)
+    message(FATAL_ERROR "memory_budget: ${BASELINE} has no total line")
+endif()
+
+# Every symbol whose size changed, added or removed
+set(changes)
+set(seen_keys)
+foreach(entry IN LISTS entries)
+    string(REGEX MATCH "^0*([0-9]+) (.+)$" match "${entry}")
+    set(size ${CMAKE_MATCH_1})
+    set(key "${CMAKE_MATCH_2}")
+    list(APPEND seen_keys "${key}")
+    set(old 0)
+    if(DEFINED "base_${key}")
+        set(old ${base_${key}})
+    endif()
+    if(NOT size EQUAL old)
+        math(EXPR delta "${size} - ${old}")
+        list(APPEND changes "${delta}|${old}|${size}|${key}")
+    endif()
+endforeach()
+foreach(key IN LISTS base_keys)
+    list(FIND seen_keys "${key}" found)
+    if(found EQUAL -1)
+        list(APPEND changes "-${base_${key}}|${base_${key}}|0|${key}")
+    endif()
+endforeach()
+
+math(EXPR ram_delta "${ram} - ${base_ram}")
+math(EXPR flash_delta "${flash} - ${base_flash}")
+math(EXPR rtc_delta "${rtc} - ${base_rtc}")
+message(STATUS "memory_budget: ram ${ram} B (${ram_delta} vs baseline), flash ${flash} B (${flash_delta} vs baseline), "
+               "rtc ${rtc} B (${rtc_delta} vs baseline)")
+foreach(change IN LISTS changes)
+    string(REPLACE "|" ";" fields "${change}")
+    list(GET fields 0 delta)
+    list(GET fields 1 old)
+    list(GET fields 2 size)
+    list(GET fields 3 key)
+    message(STATUS "  ${delta}\t${old} -> ${size}\t${key}")
+endforeach()
+
+set(failed)
+if(ram_delta GREATER RAM_SLACK)
+    list(APPEND failed "RAM grew by ${ram_delta} B, more than ${RAM_SLACK} B")
+endif()
+if(flash_delta GREATER FLASH_SLACK)
+    list(APPEND failed "flash grew by ${flash_delta} B, more than ${FLASH_SLACK} B")
+endif()
+if(rtc_delta GREATER RTC_SLACK)
+    list(APPEND failed "RTC memory grew by ${rtc_delta} B, more than ${RTC_SLACK} B")
+endif()
+if(failed)
+    string(REPLACE ";" ", " failed "${failed}")
+    message(FATAL_ERROR "memory_budget: ${failed}. If intended, refresh ${BASELINE} with the "
+                        "memory_budget_update target.")
+endif()
@@ -76,41 +76,20 @@ tagIdInput.addEventListener("input", () => {
   tagIdOverlay.textContent = tagIdInput.value;
 });
 
-async function createDescriptionCanvas() {
-    const editorEl = document.getElementById("editor");
-  
-    // Render the entire editor image at native resolution
-    const scale = 1;
-    const canvas = await html2canvas(editorEl, {
-      backgroundColor: null,
-      scale: scale,
-      width: 416,
-      height: 240
-    });
-  
-    // Define the description crop region
-    const cropX = 10;         // left padding
-    const cropY = 80;         // top of first line
-    const cropWidth = 215;    // enough for 3 short lines
-    const cropHeight = 92;    // 3 lines with spacing
-  
-    // Create a cropped canvas
-    const croppedCanvas = document.createElement("canvas");
-    croppedCanvas.width = cropWidth;
-    croppedCanvas.height = cropHeight;
-  
-    const ctx = croppedCanvas.getContext("2d");
-    ctx.drawImage(
-      canvas,
-      cropX, cropY, cropWidth, cropHeight,
-      0, 0, cropWidth, cropHeight
-    );
-  
-    console.log(`✅ Exported description area: ${cropWidth}x${cropHeight}`);
-    return croppedCanvas;
+const LAYOUT_URL = "layouts/default.json";
+
+let layout = null;
+
+// Region geometry is shared with the firmware through the layout descriptor
+async function loadLayout() {
+  if (!layout) {
+    const response = await fetch(LAYOUT_URL);
+    layout = await response.json();
+  }
+  return layout;
 }
 
-async function createPriceCanvas() {
+async function createRegionCanvas(region) {
     const editorEl = document.getElementById("editor");
   
     // Render the entire editor at native resolution
@@ -122,25 +101,19 @@ async function createPriceCanvas() {
       height: 240
     });
   
-    // Define crop area based on known pixel position of the price tag
-    const cropX = 265;
-    const cropY = 90;
-    const cropWidth = 121;
-    const cropHeight = 58;
-  
-    // Crop only the price tag region
+    // Crop only the region
     const croppedCanvas = document.createElement("canvas");
-    croppedCanvas.width = cropWidth;
-    croppedCanvas.height = cropHeight;
+    croppedCanvas.width = region.w;
+    croppedCanvas.height = region.h;
   
     const ctx = croppedCanvas.getContext("2d");
     ctx.drawImage(
       canvas,
-      cropX, cropY, cropWidth, cropHeight, // source
-      0, 0, cropWidth, cropHeight          // destination
+      region.x, region.y, region.w, region.h, // source
+      0, 0, region.w, region.h                // destination
     );
   
-    console.log(`✅ Exported price area: ${cropWidth}x${cropHeight}`);
+    console.log(`✅ Exported ${region.name} area: ${region.w}x${region.h}`);
     return croppedCanvas;
 }
 
@@ -208,40 +181,145 @@ function showStatusMessage(text) {
 }
 
 
+// Updates carry a sequence header the tag echoes on esl/<tag>/ack
+const ACK_WINDOW = 4;           // Updates in flight per tag
+const ACK_TIMEOUT_MS = 30000;   // Sleeping tags may take a whole duty cycle to answer
+const MAX_RETRIES = 3;
+
+let nextSeq = Date.now() >>> 0;
+
+function le32(value) {
+  return [value & 0xff, (value >>> 8) & 0xff, (value >>> 16) & 0xff, (value >>> 24) & 0xff];
+}
+
+// Version 2 adds the Unix time the tag should commit the update at
+function withSeqHeader(seq, data, activateAt = 0) {
+  const header = activateAt
+    ? [0xE5, 0x51, 2, 0, ...le32(seq), ...le32(activateAt)]
+    : [0xE5, 0x51, 1, 0, ...le32(seq)];
+  const framed = new Uint8Array(header.length + data.length);
+  framed.set(header);
+  framed.set(data, header.length);
+  return framed;
+}
+
+// Publishes updates with at most ACK_WINDOW unacknowledged, retrying those the tag dropped or never acknowledged
+function sendWithAcks(client, tagId, updates, activateAt, onDone) {
+  const queue = updates.map((u) => ({ ...u, retries: 0 }));
+  const inFlight = new Map();     // seq -> { update, timer }
+  const results = [];
+
+  function settle(seq, outcome) {
+    const entry = inFlight.get(seq);
+    if (!entry) return;
+    clearTimeout(entry.timer);
+    inFlight.delete(seq);
+
+    const { update } = entry;
+    // A rejected update would be rejected again, only lost ones are worth resending
+    const lost = outcome.result === "dropped" || outcome.result === "timeout";
+    // A scheduled update is settled once staged, it goes live on the tag's own timer
+    if (lost && update.retries < MAX_RETRIES) {
+      update.retries++;
+      console.warn(`Retrying ${update.name} (${outcome.result}), attempt ${update.retries}`);
+      queue.unshift(update);
+    } else {
+      results.push({ name: update.name, ...outcome });
+      showStatusMessage(`${update.name}: ${outcome.result}` +
+        (outcome.refresh_ms ? ` in ${outcome.refresh_ms} ms` : ""));
+    }
+    pump();
+  }
+
+  function pump() {
+    while (inFlight.size < ACK_WINDOW && queue.length > 0) {
+      const update = queue.shift();
+      const seq = nextSeq++ >>> 0;
+      const topic = `esl/${tagId}/${update.name}`;
+      const timer = setTimeout(() => settle(seq, { result: "timeout" }), ACK_TIMEOUT_MS);
+      inFlight.set(seq, { update, timer });
+
+      console.log(`Sending ${update.name} (${update.data.length} bytes) to ${topic} [seq=${seq}]`);
+      // QoS 1 so the broker queues the update for sleeping tags
+      client.publish(topic, withSeqHeader(seq, update.data, activateAt), { qos: 1 });
+    }
+    if (inFlight.size === 0 && queue.length === 0) {
+      onDone(results);
+    }
+  }
+
+  client.on("message", (topic, message) => {
+    if (topic !== `esl/${tagId}/ack`) return;
+    let ack;
+    try {
+      ack = JSON.parse(message.toString());
+    } catch (err) {
+      console.warn("Ignoring malformed ack:", err);
+      return;
+    }
+    if (!ack || typeof ack.seq !== "number") return;
+    settle(ack.seq >>> 0, ack);
+  });
+
+  pump();
+}
+
 async function updateESL() {
-    const descCanvas = await createDescriptionCanvas();
-    const priceCanvas = await createPriceCanvas();
+    const { regions } = await loadLayout();
 
-    const descBin = canvasToBin(descCanvas);
-    const priceBin = canvasToBin(priceCanvas);
+    // Text regions are rendered on the tag, only bitmap regions are exported here
+    const payloads = [];
+    for (const region of regions.filter((r) => !r.font)) {
+      const canvas = await createRegionCanvas(region);
+      payloads.push({ name: region.name, data: canvasToBin(canvas) });
+    }
 
     // Optionally download locally for testing
-    // downloadBin(descBin, "description.bin");
-    // downloadBin(priceBin, "price.bin");
+    // payloads.forEach((p) => downloadBin(p.data, `${p.name}.bin`));
 
     const tagId = document.getElementById("tagIdInput").value || tagIdOverlay.textContent;
 
-    const mqttTopicDesc = `esl/${tagId}/description`;
-    const mqttTopicPrice = `esl/${tagId}/price`;
+    // Empty means now, otherwise every tag commits at the same second
+    const activateInput = document.getElementById("activateAtInput").value;
+    const activateAt = activateInput ? Math.floor(new Date(activateInput).getTime() / 1000) : 0;
 
     // Connect to local or public broker via WebSocket
     const client = mqtt.connect(MQTT_BROKER);
 
     client.on("connect", () => {
       console.log("✅ MQTT connected!");
-    
-      console.log(`Sending description (${descBin.length} bytes) to ${mqttTopicDesc}`);
-      client.publish(mqttTopicDesc, descBin);
-      showStatusMessage(`Sending description (${descBin.length} bytes) to ${mqttTopicDesc}`);
 
-      console.log(`Sending price (${priceBin.length} bytes) to ${mqttTopicPrice}`);
-      client.publish(mqttTopicPrice, priceBin);
-      showStatusMessage(`Sending price (${priceBin.length} bytes) to ${mqttTopicPrice}`);
+      client.subscribe(`esl/${tagId}/ack`, { qos: 1 }, () => {
+        // Keep the radio awake so the region payloads are not held until the next beacon
+        client.publish(`esl/${tagId}/boost`, "", { qos: 1 });
 
-      showStatusMessage(`Done updating ESL!`);
+        sendWithAcks(client, tagId, payloads, activateAt, (results) => {
+          const ok = results.filter((r) => ["applied", "unchanged", "scheduled"].includes(r.result)).length;
+          showStatusMessage(`Done updating ESL! ${ok}/${results.length} confirmed`);
+          client.end();
+        });
+      });
+    });
+
+    client.on("error", (err) => {
+      console.error("❌ MQTT error:", err);
+    });
+}
+
+async function pushLayout() {
+    const descriptor = JSON.stringify(await loadLayout());
+    const tagId = document.getElementById("tagIdInput").value || tagIdOverlay.textContent;
+    const topic = `esl/${tagId}/layout`;
+
+    const client = mqtt.connect(MQTT_BROKER);
+
+    client.on("connect", () => {
+      console.log(`Sending layout v${layout.version} to ${topic}`);
+      client.publish(topic, descriptor, { qos: 1 });
+      showStatusMessage(`Sent layout v${layout.version} to ${topic}`);
 
       setTimeout(() => client.end(), 500);
-    });    
+    });
 
     client.on("error", (err) => {
       console.error("❌ MQTT error:", err);